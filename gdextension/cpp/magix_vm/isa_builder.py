@@ -5,13 +5,18 @@ from SCons.Action import Action
 
 from typing import Any
 
+import hashlib
 import pathlib
+import struct
 
 import jinja2
 from jinja2 import Template
 
 import toml
 
+# keep in sync with instruction_data.hpp
+MAX_REGISTERS_PER_INSTRUCTION = 8
+
 
 def load_config_from_file(file: str) -> dict[str, Any]:
     ext = pathlib.Path(file).suffix
@@ -32,19 +37,136 @@ def store_config_to_file(conf: dict[str, Any], file: str) -> None:
             raise ValueError(f"unknown extension {ext}")
 
 
+def render_template(template_file: str, config: dict[str, Any], target_file: str):
+    # templates can import macros from the templates next to them
+    template_path = pathlib.Path(template_file)
+    jinja_env = jinja2.Environment(
+        loader=jinja2.FileSystemLoader(str(template_path.parent)),
+        keep_trailing_newline=True,
+    )
+    template: Template = jinja_env.get_template(template_path.name)
+    with open(target_file, "wt") as outfile:
+        outfile.write(template.render(config))
+
+
 def jinja_configure(target, source, env: Environment):
-    template: Template
-    with open(str(source[0]), "rt") as in_template:
-        template = Template(in_template.read(), keep_trailing_newline=True)
     config = load_config_from_file(str(source[1]))
-    with open(str(target[0]), "wt") as outfile:
-        outfile.write(template.render(config))
+    render_template(str(source[0]), config, str(target[0]))
     return 0
 
 
+def expand_superinstructions(
+    instructions: list[dict[str, Any]], superinstructions: list[dict[str, Any]]
+) -> None:
+    """Append one instruction per superinstruction, running its parts in order.
+    It is encoded like its parts with the first opcode replaced, so each part keeps
+    its opcode word."""
+    by_mnenomic = {
+        inst["mnenomic"]: index
+        for index, inst in enumerate(instructions)
+        if not inst.get("pseudo", False)
+    }
+
+    for superinst in superinstructions:
+        sequence: list[str] = superinst["sequence"]
+        if len(sequence) < 2:
+            raise ValueError(f"superinstruction {sequence} fuses less than two")
+
+        fused = {
+            "mnenomic": "__fused." + "__".join(sequence),
+            "registers": [],
+            "fused": [],
+        }
+        # code word of the opcode of the current part
+        word = 0
+        for position, mnenomic in enumerate(sequence):
+            if mnenomic not in by_mnenomic:
+                raise ValueError(
+                    f"superinstruction {sequence} uses unknown instruction {mnenomic}"
+                )
+            part = instructions[by_mnenomic[mnenomic]]
+            part_registers = part.get("registers", [])
+            is_last = position + 1 == len(sequence)
+            if part.get("stack_pointer", "none") != "none":
+                raise ValueError(
+                    f"superinstruction {sequence} can't fuse {mnenomic}, "
+                    "it moves the stack pointer"
+                )
+            jumps = part.get("terminator", False) or any(
+                reg.get("code_address", False) for reg in part_registers
+            )
+            if jumps and not is_last:
+                raise ValueError(
+                    f"superinstruction {sequence} can't fuse {mnenomic}, "
+                    "only the last part may jump"
+                )
+
+            fused["fused"].append(
+                {
+                    "index": by_mnenomic[mnenomic],
+                    "offset": len(fused["registers"]),
+                    "word_offset": word,
+                }
+            )
+            offset = len(fused["registers"])
+            for reg in part_registers:
+                fused_reg = dict(reg)
+                if "bytes_index" in reg:
+                    fused_reg["bytes_index"] = reg["bytes_index"] + offset
+                fused_reg["word"] = word + reg["word"]
+                fused["registers"].append(fused_reg)
+            word += part["code_words"]
+            if part.get("host_call", False):
+                fused["host_call"] = True
+            if is_last:
+                fused["terminator"] = part.get("terminator", False)
+                fused["yields"] = part.get("yields", False)
+
+        if len(fused["registers"]) > MAX_REGISTERS_PER_INSTRUCTION:
+            raise ValueError(
+                f"superinstruction {sequence} takes more than "
+                f"{MAX_REGISTERS_PER_INSTRUCTION} registers"
+            )
+        fused["code_words"] = word
+        instructions.append(fused)
+
+
+def resolve_byte_registers(instructions: list[dict[str, Any]]) -> None:
+    """Replace the register name of each "bytes" key by its index."""
+    for inst in instructions:
+        registers = inst.get("registers", [])
+        names = [reg["name"] for reg in registers]
+        for reg in registers:
+            if "bytes" not in reg:
+                continue
+            if reg["bytes"] not in names:
+                raise ValueError(
+                    f"{inst['mnenomic']} register {reg['name']} spans unknown "
+                    f"register {reg['bytes']}"
+                )
+            reg["bytes_index"] = names.index(reg["bytes"])
+
+
+def assign_code_words(instructions: list[dict[str, Any]]) -> None:
+    """Give every instruction its length in code words, and every register the code
+    word it is encoded in. The opcode is word 0."""
+    for inst in instructions:
+        registers = inst.get("registers", [])
+        inst["code_words"] = 1 + len(registers)
+        for index, reg in enumerate(registers):
+            reg["word"] = 1 + index
+
+
 def preprocess_isa(target, source, env: Environment):
     isa_description = load_config_from_file(str(source[0]))
     instructions: list[dict[str, Any]] = isa_description["instructions"]
+    resolve_byte_registers(instructions)
+    assign_code_words(instructions)
+    expand_superinstructions(
+        instructions, isa_description.get("superinstructions", [])
+    )
+
+    isa_description["max_registers_per_instruction"] = MAX_REGISTERS_PER_INSTRUCTION
 
     custom_instructions: list[int] = []
     instruction_classes = [{"name": "custom", "list": custom_instructions}]
@@ -63,10 +185,197 @@ def preprocess_isa(target, source, env: Environment):
                 inst["opcode"] = current_op_code
                 current_op_code += 1
 
+    # anything that changes the ISA changes what bytecode means, a string as toml has no u64
+    digest = hashlib.sha256(toml.dumps(isa_description).encode()).hexdigest()
+    isa_description["isa_version"] = "0x" + digest[:16]
+
     store_config_to_file(isa_description, str(target[0]))
     return 0
 
 
+# x86-64 ELF constants, see the System V x86-64 psABI
+EM_X86_64 = 62
+SHT_SYMTAB = 2
+SHT_RELA = 4
+SHT_NOBITS = 8
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+SHN_LORESERVE = 0xFF00
+R_X86_64_64 = 1
+R_X86_64_PC32 = 2
+R_X86_64_PLT32 = 4
+R_X86_64_32 = 10
+R_X86_64_32S = 11
+
+STENCIL_SECTION_PREFIX = ".text.magix_stencil_"
+STENCIL_OPERAND_PREFIX = "magix_hole_operand_"
+STENCIL_ABSOLUTE_PATCHES = {
+    R_X86_64_64: "ABSOLUTE_64",
+    R_X86_64_32: "ABSOLUTE_32",
+    R_X86_64_32S: "ABSOLUTE_32_SIGNED",
+}
+STENCIL_LIBC_CALLS = {"memcpy": "MEMCPY", "memmove": "MEMMOVE", "memset": "MEMSET"}
+
+
+def read_elf(
+    file: str,
+) -> tuple[list[dict[str, Any]], list[dict[str, Any]], dict[int, list[dict[str, Any]]]]:
+    with open(file, "rb") as f:
+        data = f.read()
+    if data[:4] != b"\x7fELF" or data[4] != 2 or data[5] != 1:
+        raise ValueError(f"{file} is not a little endian ELF64 object")
+    (machine,) = struct.unpack_from("<H", data, 0x12)
+    if machine != EM_X86_64:
+        raise ValueError(f"{file} is not an x86-64 object")
+    (section_offset,) = struct.unpack_from("<Q", data, 0x28)
+    entry_size, section_count, names_index = struct.unpack_from("<HHH", data, 0x3A)
+
+    sections: list[dict[str, Any]] = []
+    for index in range(section_count):
+        name, kind, flags, _, offset, size, link, info, align, _ = struct.unpack_from(
+            "<IIQQQQIIQQ", data, section_offset + index * entry_size
+        )
+        contents = bytes(size) if kind == SHT_NOBITS else data[offset : offset + size]
+        sections.append(
+            {
+                "name": name,
+                "kind": kind,
+                "flags": flags,
+                "data": contents,
+                "link": link,
+                "info": info,
+                "align": max(align, 1),
+            }
+        )
+
+    def string(table: int, offset: int) -> str:
+        strings: bytes = sections[table]["data"]
+        return strings[offset : strings.index(b"\0", offset)].decode()
+
+    for section in sections:
+        section["name"] = string(names_index, section["name"])
+
+    symbols: list[dict[str, Any]] = []
+    relocations: dict[int, list[dict[str, Any]]] = {}
+    for section in sections:
+        if section["kind"] == SHT_SYMTAB:
+            for name, _, _, index, value, _ in struct.iter_unpack(
+                "<IBBHQQ", section["data"]
+            ):
+                symbols.append(
+                    {
+                        "name": string(section["link"], name),
+                        "section": index,
+                        "value": value,
+                    }
+                )
+        elif section["kind"] == SHT_RELA:
+            relocations[section["info"]] = [
+                {
+                    "offset": offset,
+                    "symbol": info >> 32,
+                    "kind": info & 0xFFFFFFFF,
+                    "addend": addend,
+                }
+                for offset, info, addend in struct.iter_unpack("<QQq", section["data"])
+            ]
+    return sections, symbols, relocations
+
+
+def extract_stencil(
+    sections: list[dict[str, Any]],
+    symbols: list[dict[str, Any]],
+    relocations: list[dict[str, Any]],
+    text_index: int,
+) -> dict[str, Any] | None:
+    """Machine code and holes of one stencil, None if it needs anything the jit can't
+    patch in, like calls to other functions or mutable data."""
+    code = bytearray(sections[text_index]["data"])
+    holes: list[dict[str, Any]] = []
+    # read only data is copied behind the code, so relative accesses stay the same
+    copied_sections: dict[int, int] = {}
+
+    def hole(relocation: dict[str, Any], value: str, patch: str, operand: int = 0):
+        holes.append(
+            {
+                "offset": relocation["offset"],
+                "value": value,
+                "patch": patch,
+                "operand": operand,
+                "addend": relocation["addend"],
+            }
+        )
+
+    for relocation in relocations:
+        symbol = symbols[relocation["symbol"]]
+        name: str = symbol["name"]
+        kind: int = relocation["kind"]
+        relative = kind in (R_X86_64_PC32, R_X86_64_PLT32)
+        if name.startswith(STENCIL_OPERAND_PREFIX) and kind in STENCIL_ABSOLUTE_PATCHES:
+            operand = int(name.removeprefix(STENCIL_OPERAND_PREFIX))
+            hole(relocation, "OPERAND", STENCIL_ABSOLUTE_PATCHES[kind], operand)
+        elif (
+            name == "magix_hole_instruction_pointer"
+            and kind in STENCIL_ABSOLUTE_PATCHES
+        ):
+            hole(relocation, "INSTRUCTION_POINTER", STENCIL_ABSOLUTE_PATCHES[kind])
+        elif name in STENCIL_LIBC_CALLS and symbol["section"] == 0 and relative:
+            hole(relocation, STENCIL_LIBC_CALLS[name], "RELATIVE_32")
+        elif relative and 0 < symbol["section"] < SHN_LORESERVE:
+            target_index: int = symbol["section"]
+            target = sections[target_index]
+            if target_index == text_index:
+                base = 0
+            elif target["flags"] & (SHF_WRITE | SHF_EXECINSTR) or not (
+                target["flags"] & SHF_ALLOC
+            ):
+                return None
+            else:
+                if target_index not in copied_sections:
+                    code += b"\xCC" * (-len(code) % target["align"])
+                    copied_sections[target_index] = len(code)
+                    code += target["data"]
+                base = copied_sections[target_index]
+            value = base + symbol["value"] + relocation["addend"] - relocation["offset"]
+            struct.pack_into("<i", code, relocation["offset"], value)
+        else:
+            return None
+    return {"code": list(code), "holes": holes}
+
+
+def stencil_table(target, source, env: Environment):
+    """Render the stencil table template with the stencils of the object file, if there
+    is one. Without it the table is empty and the jit has no stencils."""
+    isa_description = load_config_from_file(str(source[1]))
+    mnenomics: dict[int, str] = {
+        inst["opcode"]: inst["mnenomic"]
+        for inst in isa_description["instructions"]
+        if "opcode" in inst
+    }
+
+    stencils: list[dict[str, Any]] = []
+    if len(source) > 2:
+        sections, symbols, relocations = read_elf(str(source[2]))
+        for index, section in enumerate(sections):
+            if not section["name"].startswith(STENCIL_SECTION_PREFIX):
+                continue
+            stencil = extract_stencil(
+                sections, symbols, relocations.get(index, []), index
+            )
+            if stencil is None:
+                # the jit calls the interpreter for this one
+                continue
+            opcode = int(section["name"].removeprefix(STENCIL_SECTION_PREFIX))
+            stencil["opcode"] = opcode
+            stencil["mnenomic"] = mnenomics[opcode]
+            stencils.append(stencil)
+    stencils.sort(key=lambda stencil: stencil["opcode"])
+
+    render_template(str(source[0]), {"stencils": stencils}, str(target[0]))
+    return 0
+
+
 def exists(env: Environment) -> bool:
     return True
 
@@ -76,5 +385,6 @@ def generate(env: Environment):
         BUILDERS={
             "JinjaConfigure": Builder(action=jinja_configure),
             "IsaPreprocess": Builder(action=preprocess_isa),
+            "StencilTable": Builder(action=stencil_table),
         }
     )
@@ -1,12 +1,15 @@
 #include "magix_vm/MagixAsmProgram.hpp"
 #include "godot_cpp/classes/global_constants.hpp"
+#include "godot_cpp/classes/worker_thread_pool.hpp"
 #include "godot_cpp/core/error_macros.hpp"
 #include "godot_cpp/core/object.hpp"
 #include "godot_cpp/variant/array.hpp"
+#include "godot_cpp/variant/callable_method_pointer.hpp"
 #include "godot_cpp/variant/dictionary.hpp"
 #include "godot_cpp/variant/packed_string_array.hpp"
 #include "godot_cpp/variant/string.hpp"
 #include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/bytecode_cache.hpp"
 #include "magix_vm/compilation/assembler.hpp"
 #include "magix_vm/compilation/lexer.hpp"
 #include "magix_vm/convert_magix_godot.hpp"
@@ -22,6 +25,7 @@ magix::MagixAsmProgram::_bind_methods()
     );
 
     godot::ClassDB::bind_method(godot::D_METHOD("compile"), &magix::MagixAsmProgram::compile);
+    godot::ClassDB::bind_method(godot::D_METHOD("compile_async"), &magix::MagixAsmProgram::compile_async);
 
     godot::ClassDB::bind_method(godot::D_METHOD("get_bytecode"), &MagixAsmProgram::get_bytecode);
 
@@ -46,6 +50,7 @@ void
 magix::MagixAsmProgram::reset()
 {
     tried_compile = false;
+    ++source_revision;
     if (byte_code.is_valid())
     {
         emit_signal(MAGIX_ASM_PROGRAM_SIG_BYTECODE_INVALIDATED);
@@ -55,27 +60,52 @@ magix::MagixAsmProgram::reset()
     asm_source = godot::String{};
 }
 
+auto
+magix::MagixAsmProgram::assemble_source(const godot::String &source, std::vector<magix::compile::AssemblerError> &errors)
+    -> godot::Ref<MagixByteCode>
+{
+    errors.clear();
+    // programs with the same source share their bytecode, sources that fail are assembled again for their errors
+    godot::Ref<MagixByteCode> new_bc = ByteCodeCache::global().find(source);
+    if (new_bc.is_valid())
+    {
+        return new_bc;
+    }
+    new_bc.instantiate();
+    errors = incremental.update(magix::compile::strview_from_godot(source), new_bc->get_code_write());
+    if (!errors.empty())
+    {
+        return {};
+    }
+    new_bc->decode();
+    return ByteCodeCache::global().insert(source, std::move(new_bc));
+}
+
 auto
 magix::MagixAsmProgram::compile() -> bool
 {
+    // a stale background compilation starts one of the current source, wait for that too
+    while (compile_task >= 0)
+    {
+        finish_compile();
+    }
     if (tried_compile)
     {
         return errors.empty();
     }
     tried_compile = true;
 
-    godot::Ref<MagixByteCode> new_bc;
-    new_bc.instantiate();
-
-    const godot::String &source = get_asm_source();
-
-    std::vector<magix::compile::SrcToken> tokens = magix::compile::lex(magix::compile::strview_from_godot(source));
-    errors = assemble(tokens, new_bc->get_code_write());
+    byte_code = assemble_source(get_asm_source(), errors);
+    emit_compile_signals();
+    return errors.empty();
+}
 
+void
+magix::MagixAsmProgram::emit_compile_signals()
+{
     bool result = errors.empty();
     if (result)
     {
-        byte_code = std::move(new_bc);
         emit_signal(MAGIX_ASM_PROGRAM_SIG_COMPILE_OK);
     }
     else
@@ -83,7 +113,82 @@ magix::MagixAsmProgram::compile() -> bool
         emit_signal(MAGIX_ASM_PROGRAM_SIG_COMPILE_FAILED);
     }
     emit_signal(MAGIX_ASM_PROGRAM_SIG_COMPILED, result);
-    return result;
+}
+
+void
+magix::MagixAsmProgram::compile_async()
+{
+    if (tried_compile || compile_task >= 0)
+    {
+        return;
+    }
+    if (ByteCodeCache::global().find(asm_source).is_valid())
+    {
+        // nothing to assemble
+        compile();
+        return;
+    }
+
+    pending_revision = source_revision;
+    pending_source = asm_source;
+    pending_keep_alive = godot::Ref<MagixAsmProgram>(this);
+    compile_task = godot::WorkerThreadPool::get_singleton()->add_task(
+        callable_mp(this, &MagixAsmProgram::compile_in_background), false, "MagixAsmProgram compile"
+    );
+}
+
+void
+magix::MagixAsmProgram::compile_in_background()
+{
+    pending_bytecode = assemble_source(pending_source, pending_errors);
+    callable_mp(this, &MagixAsmProgram::finish_background_compile).bind(pending_revision).call_deferred();
+}
+
+void
+magix::MagixAsmProgram::finish_background_compile(magix::u64 revision)
+{
+    if (compile_task < 0 || revision != pending_revision)
+    {
+        // compile() took it over already, a running task is another one and not waited for here
+        return;
+    }
+    finish_compile();
+}
+
+void
+magix::MagixAsmProgram::finish_compile()
+{
+    if (compile_task < 0)
+    {
+        // already waited for by compile()
+        return;
+    }
+    godot::WorkerThreadPool::get_singleton()->wait_for_task_completion(compile_task);
+    compile_task = -1;
+    // released last, it may hold the last reference
+    godot::Ref<MagixAsmProgram> keep_alive = std::move(pending_keep_alive);
+
+    godot::Ref<MagixByteCode> new_bc = std::move(pending_bytecode);
+    std::vector<magix::compile::AssemblerError> new_errors = std::move(pending_errors);
+    pending_bytecode.unref();
+    pending_errors.clear();
+    // the errors point into the incremental assembler, which only the next compilation updates
+    pending_source = godot::String{};
+    if (tried_compile)
+    {
+        return;
+    }
+    if (pending_revision != source_revision)
+    {
+        // the source changed while assembling, whoever waits for the compile signals waits for the current one
+        compile_async();
+        return;
+    }
+
+    tried_compile = true;
+    byte_code = std::move(new_bc);
+    errors = std::move(new_errors);
+    emit_compile_signals();
 }
 
 auto
@@ -93,6 +198,17 @@ magix::MagixAsmProgram::get_bytecode() -> godot::Ref<magix::MagixByteCode>
     return byte_code;
 }
 
+auto
+magix::MagixAsmProgram::try_get_bytecode() -> godot::Ref<magix::MagixByteCode>
+{
+    if (!tried_compile)
+    {
+        compile_async();
+        return {};
+    }
+    return byte_code;
+}
+
 auto
 magix::MagixAsmProgram::get_error_count() -> size_t
 {
@@ -36,12 +36,31 @@ class MagixAsmProgram : public godot::Resource
     void
     reset();
 
+    /** Assemble now, or wait for the background compilation if one is running. */
     auto
     compile() -> bool;
 
+    /** Assemble on the WorkerThreadPool. The compile signals are emitted on the main thread once it is done. Does nothing if the
+     * program is compiled or being compiled already.
+     */
+    void
+    compile_async();
+
+    /** Shared with every program of the same source, it must not be written. */
     [[nodiscard]] auto
     get_bytecode() -> godot::Ref<magix::MagixByteCode>;
 
+    /** The bytecode if compilation finished, null otherwise. Never assembles on the calling thread, starts compile_async() instead. */
+    [[nodiscard]] auto
+    try_get_bytecode() -> godot::Ref<magix::MagixByteCode>;
+
+    /** Compilation of the current source finished, successful or not. */
+    [[nodiscard]] auto
+    is_compiled() const noexcept -> bool
+    {
+        return tried_compile;
+    }
+
     [[nodiscard]] auto
     is_compilation_ok() -> bool
     {
@@ -62,15 +81,62 @@ class MagixAsmProgram : public godot::Resource
     [[nodiscard]] auto
     get_error_info(size_t index) -> godot::Dictionary;
 
+#ifdef MAGIX_BUILD_TESTS
+    /** Stands in for the frame the deferred end of the running background compilation is called in. */
+    void
+    finish_background_compile_now()
+    {
+        finish_background_compile(pending_revision);
+    }
+#endif
+
   protected:
     static void
     _bind_methods();
 
   private:
+    /** The bytecode of the source, shared through the ByteCodeCache, null if it has errors. Only lexes and assembles what changed
+     * since the last call, one call at a time. Errors point into the incremental assembler and stay valid until the next call.
+     */
+    [[nodiscard]] auto
+    assemble_source(const godot::String &source, std::vector<magix::compile::AssemblerError> &errors) -> godot::Ref<magix::MagixByteCode>;
+
+    void
+    emit_compile_signals();
+
+    /** Runs on a worker, only touches the pending fields. */
+    void
+    compile_in_background();
+
+    /** Wait for the background compilation and take over its result. If the source changed since it started, compile the current
+     * one in the background instead.
+     */
+    void
+    finish_compile();
+
+    /** Deferred by the task compiling the given revision, finishes it unless compile() did already. */
+    void
+    finish_background_compile(magix::u64 revision);
+
     godot::String asm_source;
+    /** Counts source changes, a background compilation of an older one is dropped. */
+    magix::u64 source_revision = 0;
     bool tried_compile = false;
     godot::Ref<magix::MagixByteCode> byte_code;
     std::vector<magix::compile::AssemblerError> errors;
+    /** Keeps the lines and blocks of the last source assembled, edits only assemble again what they touch. */
+    magix::compile::IncrementalAssembler incremental;
+
+    /** WorkerThreadPool task of the background compilation, -1 if none is running. Everything pending belongs to it until
+     * finish_compile() waited for it.
+     */
+    int64_t compile_task = -1;
+    magix::u64 pending_revision = 0;
+    godot::String pending_source;
+    godot::Ref<magix::MagixByteCode> pending_bytecode;
+    std::vector<magix::compile::AssemblerError> pending_errors;
+    /** The program must outlive the task. */
+    godot::Ref<MagixAsmProgram> pending_keep_alive;
 };
 
 } // namespace magix
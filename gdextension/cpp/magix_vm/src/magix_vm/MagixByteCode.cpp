@@ -7,6 +7,15 @@ magix::MagixByteCode::_bind_methods()
     godot::ClassDB::bind_method(godot::D_METHOD("get_rom_bytes"), &MagixByteCode::get_rom_bytes);
 }
 
+void
+magix::MagixByteCode::decode()
+{
+    decoded = execute::decode(bytecode);
+    execute::verify(decoded);
+    jit = execute::jit_compile(decoded);
+    lockstep = execute::lockstep_compile(decoded);
+}
+
 auto
 magix::MagixByteCode::list_entry_points() const -> godot::Dictionary
 {
@@ -22,11 +31,11 @@ auto
 magix::MagixByteCode::get_rom_bytes() const -> godot::PackedByteArray
 {
     godot::PackedByteArray ret;
-    godot::Error err = static_cast<godot::Error>(ret.resize(sizeof(bytecode.code)));
+    godot::Error err = static_cast<godot::Error>(ret.resize(static_cast<int64_t>(bytecode.code.size())));
     if (err != godot::Error::OK)
     {
         return ret;
     }
-    std::memcpy(ret.ptrw(), bytecode.code, sizeof(bytecode.code));
+    std::memcpy(ret.ptrw(), bytecode.code.data(), bytecode.code.size());
     return ret;
 }
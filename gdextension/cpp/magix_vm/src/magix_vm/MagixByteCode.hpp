@@ -2,15 +2,19 @@
 #define MAGIX_MAGIXBYTECODE_HPP_
 
 #include "magix_vm/compilation/compiled.hpp"
-#include <godot_cpp/classes/ref_counted.hpp>
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/jit.hpp"
+#include "magix_vm/execution/lockstep.hpp"
+#include <godot_cpp/classes/resource.hpp>
 #include <godot_cpp/templates/rb_map.hpp>
 
 namespace magix
 {
 
-class MagixByteCode : public godot::RefCounted
+/** Assembled program. A resource so it can be saved to and loaded from precompiled .mxbc files, see bytecode_file.hpp. */
+class MagixByteCode : public godot::Resource
 {
-    GDCLASS(MagixByteCode, godot::RefCounted)
+    GDCLASS(MagixByteCode, godot::Resource)
 
   public:
     MagixByteCode() = default;
@@ -28,6 +32,31 @@ class MagixByteCode : public godot::RefCounted
         return bytecode;
     }
 
+    /** Instruction stream executed by the runner, only valid after decode() */
+    [[nodiscard]] auto
+    get_decoded() const -> const execute::DecodedByteCode &
+    {
+        return decoded;
+    }
+
+    /** Native code executed by the runner, falls back to the decoded stream. Only valid after decode() */
+    [[nodiscard]] auto
+    get_jit() const -> const execute::JitProgram &
+    {
+        return jit;
+    }
+
+    /** Ops for running instances at the same entry side by side. Only valid after decode() */
+    [[nodiscard]] auto
+    get_lockstep() const -> const execute::LockstepProgram &
+    {
+        return lockstep;
+    }
+
+    /** Rebuild and verify the decoded instruction stream, its native code and lockstep ops, call after writing the code. */
+    void
+    decode();
+
     [[nodiscard]] auto
     list_entry_points() const -> godot::Dictionary;
 
@@ -40,6 +69,9 @@ class MagixByteCode : public godot::RefCounted
 
   private:
     compile::ByteCodeRaw bytecode;
+    execute::DecodedByteCode decoded;
+    execute::JitProgram jit;
+    execute::LockstepProgram lockstep;
 };
 
 } // namespace magix
@@ -0,0 +1,67 @@
+#include "magix_vm/MagixByteCodeLoader.hpp"
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/compilation/bytecode_file.hpp"
+
+#include "godot_cpp/classes/file_access.hpp"
+
+#include <array>
+#include <vector>
+
+void
+magix::MagixByteCodeLoader::_bind_methods()
+{
+}
+
+auto
+magix::MagixByteCodeLoader::_get_recognized_extensions() const -> godot::PackedStringArray
+{
+    godot::PackedStringArray extensions;
+    extensions.push_back("mxbc");
+    return extensions;
+}
+
+auto
+magix::MagixByteCodeLoader::_handles_type(const godot::StringName &type) const -> bool
+{
+    return type == godot::StringName(MagixByteCode::get_class_static());
+}
+
+auto
+magix::MagixByteCodeLoader::_get_resource_type(const godot::String &path) const -> godot::String
+{
+    return path.get_extension().to_lower() == "mxbc" ? MagixByteCode::get_class_static() : godot::String{};
+}
+
+auto
+magix::MagixByteCodeLoader::_load(
+    const godot::String &path, const godot::String & /*original_path*/, bool /*use_sub_threads*/, int32_t /*cache_mode*/
+) const -> godot::Variant
+{
+    godot::Ref<godot::FileAccess> file = godot::FileAccess::open(path, godot::FileAccess::READ);
+    ERR_FAIL_COND_V_MSG(file.is_null(), godot::FileAccess::get_open_error(), "could not open " + path);
+
+    godot::Ref<MagixByteCode> bytecode;
+    bytecode.instantiate();
+    compile::ByteCodeRaw &code = bytecode->get_code_write();
+    compile::BytecodeFileLayout layout;
+
+    std::array<std::byte, compile::bytecode_file_header_size> header{};
+    file->get_buffer(reinterpret_cast<uint8_t *>(header.data()), header.size());
+    compile::BytecodeFileError error = compile::read_bytecode_header(header, file->get_length(), code, layout);
+    ERR_FAIL_COND_V_MSG(
+        error != compile::BytecodeFileError::OK,
+        godot::ERR_FILE_UNRECOGNIZED,
+        path + ": not a loadable .mxbc file, " + compile::enum_name(error)
+    );
+
+    // the ROM goes right where it runs from, only the small entry table is buffered
+    uint64_t read = file->get_buffer(reinterpret_cast<uint8_t *>(code.code.data()), code.code.size());
+    std::vector<std::byte> table(layout.entry_table_size);
+    read += file->get_buffer(reinterpret_cast<uint8_t *>(table.data()), table.size());
+    ERR_FAIL_COND_V_MSG(read != code.code.size() + table.size(), godot::ERR_FILE_CORRUPT, path + ": file ends early");
+    error = compile::read_bytecode_entries(table, layout, code);
+    ERR_FAIL_COND_V_MSG(error != compile::BytecodeFileError::OK, godot::ERR_FILE_CORRUPT, path + ": " + compile::enum_name(error));
+
+    bytecode->decode();
+    return bytecode;
+}
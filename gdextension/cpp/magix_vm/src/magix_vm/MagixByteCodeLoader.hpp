@@ -0,0 +1,45 @@
+#ifndef MAGIX_MAGIXBYTECODELOADER_HPP_
+#define MAGIX_MAGIXBYTECODELOADER_HPP_
+
+#include "godot_cpp/classes/resource_format_loader.hpp"
+#include "godot_cpp/classes/wrapped.hpp"
+#include "godot_cpp/variant/packed_string_array.hpp"
+#include "godot_cpp/variant/string.hpp"
+#include "godot_cpp/variant/string_name.hpp"
+#include "godot_cpp/variant/variant.hpp"
+
+namespace magix
+{
+
+/** Loads precompiled .mxbc files as MagixByteCode. The ROM is read straight into the buffer the program runs from, nothing is
+ * assembled. Files of another format version or ISA fail to load, they have to be saved again from their source.
+ */
+class MagixByteCodeLoader : public godot::ResourceFormatLoader
+{
+    GDCLASS(MagixByteCodeLoader, godot::ResourceFormatLoader)
+
+  public:
+    MagixByteCodeLoader() = default;
+    ~MagixByteCodeLoader() override = default;
+
+    [[nodiscard]] auto
+    _get_recognized_extensions() const -> godot::PackedStringArray override;
+
+    [[nodiscard]] auto
+    _handles_type(const godot::StringName &type) const -> bool override;
+
+    [[nodiscard]] auto
+    _get_resource_type(const godot::String &path) const -> godot::String override;
+
+    [[nodiscard]] auto
+    _load(const godot::String &path, const godot::String &original_path, bool use_sub_threads, int32_t cache_mode) const
+        -> godot::Variant override;
+
+  protected:
+    static void
+    _bind_methods();
+};
+
+} // namespace magix
+
+#endif // MAGIX_MAGIXBYTECODELOADER_HPP_
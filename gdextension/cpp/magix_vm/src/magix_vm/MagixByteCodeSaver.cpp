@@ -0,0 +1,44 @@
+#include "magix_vm/MagixByteCodeSaver.hpp"
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/compilation/bytecode_file.hpp"
+
+#include "godot_cpp/classes/file_access.hpp"
+
+#include <vector>
+
+void
+magix::MagixByteCodeSaver::_bind_methods()
+{
+}
+
+auto
+magix::MagixByteCodeSaver::_save(const godot::Ref<godot::Resource> &resource, const godot::String &path, uint32_t /*flags*/)
+    -> godot::Error
+{
+    godot::Ref<MagixByteCode> bytecode = resource;
+    ERR_FAIL_COND_V(bytecode.is_null(), godot::ERR_INVALID_PARAMETER);
+
+    godot::Ref<godot::FileAccess> file = godot::FileAccess::open(path, godot::FileAccess::WRITE);
+    ERR_FAIL_COND_V_MSG(file.is_null(), godot::FileAccess::get_open_error(), "could not open " + path);
+
+    const std::vector<std::byte> contents = compile::write_bytecode_file(bytecode->get_code());
+    file->store_buffer(reinterpret_cast<const uint8_t *>(contents.data()), contents.size());
+    return file->get_error();
+}
+
+auto
+magix::MagixByteCodeSaver::_recognize(const godot::Ref<godot::Resource> &resource) const -> bool
+{
+    return godot::Ref<MagixByteCode>(resource).is_valid();
+}
+
+auto
+magix::MagixByteCodeSaver::_get_recognized_extensions(const godot::Ref<godot::Resource> &resource) const -> godot::PackedStringArray
+{
+    godot::PackedStringArray extensions;
+    if (_recognize(resource))
+    {
+        extensions.push_back("mxbc");
+    }
+    return extensions;
+}
@@ -0,0 +1,39 @@
+#ifndef MAGIX_MAGIXBYTECODESAVER_HPP_
+#define MAGIX_MAGIXBYTECODESAVER_HPP_
+
+#include "godot_cpp/classes/ref.hpp"
+#include "godot_cpp/classes/resource.hpp"
+#include "godot_cpp/classes/resource_format_saver.hpp"
+#include "godot_cpp/classes/wrapped.hpp"
+#include "godot_cpp/variant/packed_string_array.hpp"
+#include "godot_cpp/variant/string.hpp"
+
+namespace magix
+{
+
+/** Saves MagixByteCode as precompiled .mxbc files, so shipped programs skip the assembler. */
+class MagixByteCodeSaver : public godot::ResourceFormatSaver
+{
+    GDCLASS(MagixByteCodeSaver, godot::ResourceFormatSaver)
+
+  public:
+    MagixByteCodeSaver() = default;
+    ~MagixByteCodeSaver() override = default;
+
+    [[nodiscard]] auto
+    _save(const godot::Ref<godot::Resource> &resource, const godot::String &path, uint32_t flags) -> godot::Error override;
+
+    [[nodiscard]] auto
+    _recognize(const godot::Ref<godot::Resource> &resource) const -> bool override;
+
+    [[nodiscard]] auto
+    _get_recognized_extensions(const godot::Ref<godot::Resource> &resource) const -> godot::PackedStringArray override;
+
+  protected:
+    static void
+    _bind_methods();
+};
+
+} // namespace magix
+
+#endif // MAGIX_MAGIXBYTECODESAVER_HPP_
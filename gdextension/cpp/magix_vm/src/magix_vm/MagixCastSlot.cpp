@@ -2,6 +2,7 @@
 #include "godot_cpp/classes/global_constants.hpp"
 #include "godot_cpp/classes/ref.hpp"
 #include "godot_cpp/core/error_macros.hpp"
+#include "godot_cpp/core/object.hpp"
 
 #include "godot_cpp/variant/array.hpp"
 #include "godot_cpp/variant/callable.hpp"
@@ -31,6 +32,11 @@ magix::MagixCastSlot::_bind_methods()
 void
 magix::MagixCastSlot::set_program(godot::Ref<magix::MagixAsmProgram> program)
 {
+    godot::Callable compiled_callable = callable_mp(this, &MagixCastSlot::_program_compiled);
+    if (this->program.is_valid())
+    {
+        this->program->disconnect(MAGIX_ASM_PROGRAM_SIG_COMPILED, compiled_callable);
+    }
 #ifdef TOOLS_ENABLED
     godot::Callable callable = callable_mp(this, &MagixCastSlot::_program_updated);
     if (this->program.is_valid())
@@ -40,6 +46,11 @@ magix::MagixCastSlot::set_program(godot::Ref<magix::MagixAsmProgram> program)
 #endif
 
     this->program = program;
+    if (this->program.is_valid())
+    {
+        this->program->connect(MAGIX_ASM_PROGRAM_SIG_COMPILED, compiled_callable);
+        this->program->compile_async();
+    }
 
 #ifdef TOOLS_ENABLED
     this->program->connect("changed", callable);
@@ -70,17 +81,40 @@ magix::MagixCastSlot::cast_spell(MagixVirtualMachine *vm, const godot::String &e
     {
         return;
     }
-    if (!program->is_compilation_ok())
+    // assembling here would stall the frame, casts before the program is ready wait for it
+    godot::Ref<MagixByteCode> bc = program->try_get_bytecode();
+    if (bc.is_null())
     {
+        if (!program->is_compiled())
+        {
+            pending_casts.push_back({vm->get_instance_id(), entry});
+        }
         return;
     }
-    godot::Ref<MagixByteCode> bc = program->get_bytecode();
-    ERR_FAIL_NULL(bc);
     MagixCaster *caster_parent = Object::cast_to<MagixCaster>(get_parent());
     ERR_FAIL_NULL(caster_parent);
     vm->queue_execution(bc, entry, caster_parent);
 }
 
+void
+magix::MagixCastSlot::_program_compiled(bool success)
+{
+    std::vector<PendingCast> casts = std::move(pending_casts);
+    pending_casts.clear();
+    if (!success)
+    {
+        return;
+    }
+    for (const PendingCast &cast : casts)
+    {
+        auto *vm = Object::cast_to<MagixVirtualMachine>(godot::ObjectDB::get_instance(cast.vm_id));
+        if (vm != nullptr)
+        {
+            cast_spell(vm, cast.entry);
+        }
+    }
+}
+
 [[nodiscard]] auto
 magix::MagixCastSlot::_get_configuration_warnings() const -> godot::PackedStringArray
 {
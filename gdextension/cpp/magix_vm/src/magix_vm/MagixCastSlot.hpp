@@ -7,6 +7,9 @@
 #include "godot_cpp/variant/string.hpp"
 #include "magix_vm/MagixAsmProgram.hpp"
 
+#include <cstdint>
+#include <vector>
+
 namespace magix
 {
 
@@ -36,6 +39,7 @@ class MagixCastSlot : public godot::Node
         return caster_id;
     }
 
+    /** Queue the entry on the vm. Casts before the program finished compiling are held until it has, never dropped. */
     void
     cast_spell(MagixVirtualMachine *vm, const godot::String &entry);
 
@@ -50,9 +54,22 @@ class MagixCastSlot : public godot::Node
     void
     _program_updated();
 
+    /** Hands the held casts to their vm, or drops them if the program failed. */
+    void
+    _program_compiled(bool success);
+
   private:
+    /** A cast waiting for the program to compile. */
+    struct PendingCast
+    {
+        /** Instance id, the vm may be gone by then. */
+        uint64_t vm_id;
+        godot::String entry;
+    };
+
     godot::Ref<magix::MagixAsmProgram> program;
     int64_t caster_id;
+    std::vector<PendingCast> pending_casts;
 };
 } // namespace magix
 
@@ -1,6 +1,9 @@
 #include "magix_vm/MagixCaster.hpp"
 #include "godot_cpp/classes/wrapped.hpp"
 #include "godot_cpp/core/class_db.hpp"
+#include "magix_vm/execution/runner.hpp"
+
+#include <algorithm>
 
 void
 magix::MagixCaster::_bind_methods()
@@ -14,6 +17,8 @@ magix::MagixCaster::_bind_methods()
     ADD_PROPERTY(godot::PropertyInfo(godot::Variant::FLOAT, "max_mana"), "set_max_mana", "get_max_mana");
 
     GDVIRTUAL_BIND(_allocate_mana, "requested");
+    GDVIRTUAL_BIND(_reserve_mana);
+    GDVIRTUAL_BIND(_settle_mana, "reserved", "used");
 
     godot::ClassDB::bind_method(godot::D_METHOD("try_consume_mana"), &magix::MagixCaster::try_consume_mana, "requested");
 }
@@ -32,3 +37,32 @@ magix::MagixCaster::try_consume_mana(magix::f32 requested) -> magix::f32
         return requested;
     }
 }
+
+void
+magix::MagixCaster::register_runner(execute::ExecRunner *runner)
+{
+    if (std::find(_runners.begin(), _runners.end(), runner) == _runners.end())
+    {
+        _runners.push_back(runner);
+    }
+}
+
+void
+magix::MagixCaster::unregister_runner(execute::ExecRunner *runner)
+{
+    _runners.erase(std::remove(_runners.begin(), _runners.end(), runner), _runners.end());
+}
+
+void
+magix::MagixCaster::_notification(int what)
+{
+    // leaving the tree is not the end, the caster may just be moved somewhere else
+    if (what == NOTIFICATION_PREDELETE)
+    {
+        for (execute::ExecRunner *runner : _runners)
+        {
+            runner->caster_gone(this);
+        }
+        _runners.clear();
+    }
+}
@@ -8,9 +8,18 @@
 #include "magix_vm/execution/executor.hpp"
 
 #include "types.hpp"
+
+#include <algorithm>
+#include <vector>
+
 namespace magix
 {
 
+namespace execute
+{
+class ExecRunner;
+}
+
 class MagixCaster : public godot::Node
 {
     GDCLASS(MagixCaster, godot::Node)
@@ -62,13 +71,53 @@ class MagixCaster : public godot::Node
         }
     }
 
+    GDVIRTUAL0R(magix::f32, _reserve_mana);
+    GDVIRTUAL2(_settle_mana, magix::f32, magix::f32);
+
+    /** Mana a runner with a ledger may hand to the spells of this caster during one tick. Without a script, all that is
+     * available, it is gone from the caster until settle_mana().
+     */
+    [[nodiscard]] auto
+    reserve_mana() -> magix::f32
+    {
+        magix::f32 out{};
+        if (GDVIRTUAL_CALL(_reserve_mana, out))
+        {
+            return out;
+        }
+        out = _mana_available;
+        _mana_available = 0.0f;
+        return out;
+    }
+
+    /** End of the tick for a reservation, the part not used goes back, up to the max. */
+    void
+    settle_mana(magix::f32 reserved, magix::f32 used)
+    {
+        if (!GDVIRTUAL_CALL(_settle_mana, reserved, used))
+        {
+            _mana_available = std::min(_mana_available + (reserved - used), _mana_max);
+        }
+    }
+
+    /** Tell the runner when this caster is deleted, so it can drop its users without looking the caster up. */
+    void
+    register_runner(execute::ExecRunner *runner);
+
+    void
+    unregister_runner(execute::ExecRunner *runner);
+
   protected:
     static void
     _bind_methods();
 
+    void
+    _notification(int what);
+
   private:
     magix::f32 _mana_available = 1000.0;
     magix::f32 _mana_max = 1000.0;
+    std::vector<execute::ExecRunner *> _runners;
 };
 
 } // namespace magix
@@ -1,8 +1,26 @@
 #include "magix_vm/MagixVirtualMachine.hpp"
+#include "godot_cpp/classes/multi_mesh.hpp"
+#include "godot_cpp/classes/physics_direct_space_state3d.hpp"
+#include "godot_cpp/classes/physics_ray_query_parameters3d.hpp"
+#include "godot_cpp/classes/rendering_server.hpp"
+#include "godot_cpp/classes/viewport.hpp"
+#include "godot_cpp/classes/world3d.hpp"
 #include "godot_cpp/core/error_macros.hpp"
+#include "godot_cpp/core/object.hpp"
 #include "magix_vm/MagixByteCode.hpp"
 #include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/execution/config.hpp"
 #include "magix_vm/execution/executor.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+magix::MagixVirtualMachine::MagixVirtualMachine()
+{
+    runner.set_host_call_handler([this](magix::u16 kind, magix::span<execute::HostCall> calls) { handle_host_calls(kind, calls); });
+}
 
 void
 magix::MagixVirtualMachine::_bind_methods()
@@ -10,8 +28,27 @@ magix::MagixVirtualMachine::_bind_methods()
     godot::ClassDB::bind_method(godot::D_METHOD("queue_execution", "bytecode", "entry", "caster"), &MagixVirtualMachine::queue_execution);
     godot::ClassDB::bind_method(godot::D_METHOD("run", "delta"), &MagixVirtualMachine::run);
 
+    godot::ClassDB::bind_method(godot::D_METHOD("get_worker_count"), &MagixVirtualMachine::get_worker_count);
+    godot::ClassDB::bind_method(godot::D_METHOD("set_worker_count", "count"), &MagixVirtualMachine::set_worker_count);
+    ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "worker_count"), "set_worker_count", "get_worker_count");
+
+    godot::ClassDB::bind_method(godot::D_METHOD("get_frame_budget_usec"), &MagixVirtualMachine::get_frame_budget_usec);
+    godot::ClassDB::bind_method(godot::D_METHOD("set_frame_budget_usec", "budget"), &MagixVirtualMachine::set_frame_budget_usec);
+    ADD_PROPERTY(godot::PropertyInfo(godot::Variant::INT, "frame_budget_usec"), "set_frame_budget_usec", "get_frame_budget_usec");
+    godot::ClassDB::bind_method(godot::D_METHOD("get_budget_metrics"), &MagixVirtualMachine::get_budget_metrics);
+
+    godot::ClassDB::bind_method(godot::D_METHOD("get_render_buffer", "bytecode"), &MagixVirtualMachine::get_render_buffer);
+    godot::ClassDB::bind_method(godot::D_METHOD("bind_multimesh", "bytecode", "target"), &MagixVirtualMachine::bind_multimesh);
+
+    GDVIRTUAL_BIND(_host_requests, "kind", "records", "casters");
+
+    godot::ClassDB::bind_method(godot::D_METHOD("get_mana_ledger"), &MagixVirtualMachine::get_mana_ledger);
+    godot::ClassDB::bind_method(godot::D_METHOD("set_mana_ledger", "enabled"), &MagixVirtualMachine::set_mana_ledger);
+    ADD_PROPERTY(godot::PropertyInfo(godot::Variant::BOOL, "mana_ledger"), "set_mana_ledger", "get_mana_ledger");
+
 #if MAGIX_BUILD_TESTS
     godot::ClassDB::bind_static_method("MagixVirtualMachine", godot::D_METHOD("run_tests"), &MagixVirtualMachine::run_tests);
+    godot::ClassDB::bind_static_method("MagixVirtualMachine", godot::D_METHOD("run_benchmarks"), &MagixVirtualMachine::run_benchmarks);
 #endif
 }
 
@@ -24,19 +61,212 @@ magix::MagixVirtualMachine::queue_execution(godot::Ref<MagixByteCode> bytecode,
     {
         return false;
     }
-    runner.enqueue_cast_spell(caster, std::move(bytecode), find->value());
-    return true;
+    return runner.enqueue_cast_spell(caster, std::move(bytecode), find->value()).is_valid();
+}
+
+auto
+magix::MagixVirtualMachine::run_with_result(float delta) -> execute::ExecRunner::RunResult
+{
+    last_delta = delta;
+    if (frame_budget_usec == 0)
+    {
+        auto result = runner.run_all();
+        update_multimeshes();
+        return result;
+    }
+    auto result = runner.run_budgeted(std::chrono::microseconds(frame_budget_usec));
+    // the render buffers only change when a round is done
+    if (runner.budget_metrics().users_waiting == 0)
+    {
+        update_multimeshes();
+    }
+    return result;
+}
+
+auto
+magix::MagixVirtualMachine::get_render_buffer(godot::Ref<MagixByteCode> bytecode) const -> godot::PackedFloat32Array
+{
+    godot::PackedFloat32Array result;
+    ERR_FAIL_COND_V(bytecode.is_null(), result);
+    const magix::span<const magix::f32> items = runner.render_buffer(bytecode.ptr());
+    result.resize(static_cast<int64_t>(items.size()));
+    std::copy(items.begin(), items.end(), result.ptrw());
+    return result;
+}
+
+void
+magix::MagixVirtualMachine::bind_multimesh(godot::Ref<MagixByteCode> bytecode, godot::MultiMeshInstance3D *target)
+{
+    ERR_FAIL_COND(bytecode.is_null());
+    auto find = std::find_if(multimesh_bindings.begin(), multimesh_bindings.end(),
+                             [&](const MultiMeshBinding &binding) { return binding.bytecode == bytecode; });
+    if (target == nullptr)
+    {
+        if (find != multimesh_bindings.end())
+        {
+            multimesh_bindings.erase(find);
+        }
+        return;
+    }
+    if (find == multimesh_bindings.end())
+    {
+        find = multimesh_bindings.insert(multimesh_bindings.end(), MultiMeshBinding{bytecode, 0, {}});
+    }
+    find->target_id = target->get_instance_id();
+}
+
+void
+magix::MagixVirtualMachine::update_multimeshes()
+{
+    constexpr size_t item_floats = execute::render_item_floats;
+    // targets that were freed are unbound
+    multimesh_bindings.erase(std::remove_if(multimesh_bindings.begin(), multimesh_bindings.end(),
+                                            [](const MultiMeshBinding &binding) {
+                                                return godot::Object::cast_to<godot::MultiMeshInstance3D>(
+                                                           godot::ObjectDB::get_instance(binding.target_id)) == nullptr;
+                                            }),
+                             multimesh_bindings.end());
+    for (MultiMeshBinding &binding : multimesh_bindings)
+    {
+        auto *target = godot::Object::cast_to<godot::MultiMeshInstance3D>(godot::ObjectDB::get_instance(binding.target_id));
+        godot::Ref<godot::MultiMesh> multimesh = target->get_multimesh();
+        if (multimesh.is_null())
+        {
+            continue;
+        }
+        const magix::span<const magix::f32> items = runner.render_buffer(binding.bytecode.ptr());
+        const auto count = static_cast<int64_t>(items.size() / item_floats);
+
+        // the layout only changes while there are no instances, it grows by doubling so it rarely reallocates
+        if (multimesh->get_instance_count() < count || multimesh->get_transform_format() != godot::MultiMesh::TRANSFORM_3D
+            || !multimesh->is_using_colors() || multimesh->is_using_custom_data())
+        {
+            int64_t capacity = std::max<int64_t>(multimesh->get_instance_count(), 16);
+            while (capacity < count)
+            {
+                capacity *= 2;
+            }
+            multimesh->set_instance_count(0);
+            multimesh->set_transform_format(godot::MultiMesh::TRANSFORM_3D);
+            multimesh->set_use_colors(true);
+            multimesh->set_use_custom_data(false);
+            multimesh->set_instance_count(capacity);
+        }
+
+        binding.buffer.resize(multimesh->get_instance_count() * static_cast<int64_t>(item_floats));
+        std::copy(items.begin(), items.end(), binding.buffer.ptrw());
+        godot::RenderingServer::get_singleton()->multimesh_set_buffer(multimesh->get_rid(), binding.buffer);
+        multimesh->set_visible_instance_count(count);
+    }
+}
+
+auto
+magix::MagixVirtualMachine::get_budget_metrics() const -> godot::Dictionary
+{
+    const execute::ExecRunner::BudgetMetrics &metrics = runner.budget_metrics();
+    godot::Dictionary result;
+    result["users_run"] = static_cast<int64_t>(metrics.users_run);
+    result["users_waiting"] = static_cast<int64_t>(metrics.users_waiting);
+    result["elapsed_usec"] = static_cast<int64_t>(metrics.elapsed.count());
+    result["overrun_usec"] = static_cast<int64_t>(metrics.overrun.count());
+    result["frames_over_budget"] = static_cast<int64_t>(metrics.frames_over_budget);
+    result["max_overrun_usec"] = static_cast<int64_t>(metrics.max_overrun.count());
+    result["rounds_completed"] = static_cast<int64_t>(metrics.rounds_completed);
+    result["frame_share"] = last_delta > 0.0f ? std::chrono::duration<double>(metrics.elapsed).count() / last_delta : 0.0;
+    return result;
+}
+
+void
+magix::MagixVirtualMachine::handle_host_calls(magix::u16 kind, magix::span<execute::HostCall> calls)
+{
+    if (kind == static_cast<magix::u16>(execute::HostRequestKind::RAYCAST))
+    {
+        raycast(calls);
+        return;
+    }
+
+    constexpr size_t record_size = execute::host_request_record_size;
+    godot::PackedByteArray records;
+    records.resize(static_cast<int64_t>(calls.size() * record_size));
+    godot::Array casters;
+    for (auto index : magix::ranges::num_range(calls.size()))
+    {
+        std::memcpy(records.ptrw() + index * record_size, calls[index].record.data(), record_size);
+        casters.push_back(calls[index].caster);
+    }
+    godot::PackedByteArray answers;
+    if (!GDVIRTUAL_CALL(_host_requests, kind, records, casters, answers) || answers.size() != records.size())
+    {
+        return;
+    }
+    for (auto index : magix::ranges::num_range(calls.size()))
+    {
+        std::memcpy(calls[index].record.data(), answers.ptr() + index * record_size, record_size);
+    }
+}
+
+void
+magix::MagixVirtualMachine::raycast(magix::span<execute::HostCall> calls)
+{
+    // written after the two points the request reads
+    struct RaycastResult
+    {
+        magix::u32 hit;
+        magix::f32 position[3];
+        magix::f32 normal[3];
+        magix::u32 padding;
+        magix::u64 collider_id;
+    };
+    constexpr size_t result_offset = 6 * sizeof(magix::f32);
+    static_assert(result_offset + sizeof(RaycastResult) <= execute::host_request_record_size);
+
+    godot::Viewport *viewport = get_viewport();
+    godot::Ref<godot::World3D> world = viewport != nullptr ? viewport->get_world_3d() : godot::Ref<godot::World3D>{};
+    godot::PhysicsDirectSpaceState3D *space = world.is_valid() ? world->get_direct_space_state() : nullptr;
+    ERR_FAIL_NULL_MSG(space, "raycast requests need the virtual machine in a 3d world");
+
+    godot::Ref<godot::PhysicsRayQueryParameters3D> query;
+    query.instantiate();
+    for (execute::HostCall &call : calls)
+    {
+        magix::f32 points[6];
+        std::memcpy(points, call.record.data(), sizeof(points));
+        query->set_from(godot::Vector3(points[0], points[1], points[2]));
+        query->set_to(godot::Vector3(points[3], points[4], points[5]));
+        const godot::Dictionary hit = space->intersect_ray(query);
+
+        RaycastResult result{};
+        if (!hit.is_empty())
+        {
+            const godot::Vector3 position = hit["position"];
+            const godot::Vector3 normal = hit["normal"];
+            result = RaycastResult{
+                1,
+                {position.x, position.y, position.z},
+                {normal.x, normal.y, normal.z},
+                0,
+                static_cast<magix::u64>(static_cast<int64_t>(hit["collider_id"])),
+            };
+        }
+        std::memcpy(call.record.data() + result_offset, &result, sizeof(result));
+    }
 }
 
 #if MAGIX_BUILD_TESTS
 
 extern auto
-magix_run_doctest() -> int;
+magix_run_doctest(bool benchmarks) -> int;
 
 auto
 magix::MagixVirtualMachine::run_tests() -> int
 {
-    return magix_run_doctest();
+    return magix_run_doctest(false);
+}
+
+auto
+magix::MagixVirtualMachine::run_benchmarks() -> int
+{
+    return magix_run_doctest(true);
 }
 
 #endif
@@ -1,12 +1,22 @@
 #ifndef MAGIX_MAGIXVIRTUALMACHINE_HPP_
 #define MAGIX_MAGIXVIRTUALMACHINE_HPP_
 
+#include <godot_cpp/classes/multi_mesh_instance3d.hpp>
 #include <godot_cpp/classes/node.hpp>
+#include <godot_cpp/core/gdvirtual.gen.inc>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
 
 #include "magix_vm/MagixByteCode.hpp"
 #include "magix_vm/MagixCaster.hpp"
 #include "magix_vm/execution/runner.hpp"
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
 namespace magix
 {
 
@@ -17,7 +27,7 @@ class MagixVirtualMachine : public godot::Node
     GDCLASS(MagixVirtualMachine, godot::Node)
 
   public:
-    MagixVirtualMachine() = default;
+    MagixVirtualMachine();
     ~MagixVirtualMachine() override = default;
 
     auto
@@ -26,18 +36,75 @@ class MagixVirtualMachine : public godot::Node
     void
     run(float delta)
     {
-        (void)runner.run_all();
+        (void)run_with_result(delta);
+    }
+
+    /** Run every spell once, or with a frame budget, as many as fit and the rest in the next frames. */
+    [[nodiscard]] auto
+    run_with_result(float delta) -> execute::ExecRunner::RunResult;
+
+    /** Microseconds a run may take, 0 to run every spell each frame. */
+    void
+    set_frame_budget_usec(int64_t budget)
+    {
+        frame_budget_usec = std::max<int64_t>(budget, 0);
+    }
+
+    [[nodiscard]] auto
+    get_frame_budget_usec() const -> int64_t
+    {
+        return frame_budget_usec;
+    }
+
+    /** How runs with a frame budget keep up, frame_share is the part of the last frame the run took. */
+    [[nodiscard]] auto
+    get_budget_metrics() const -> godot::Dictionary;
+
+    /** Spells draw mana from what each caster reserves once per tick, with one settling call per caster at the end. */
+    void
+    set_mana_ledger(bool enabled)
+    {
+        runner.set_mana_ledger(enabled);
+    }
+
+    [[nodiscard]] auto
+    get_mana_ledger() const -> bool
+    {
+        return runner.get_mana_ledger();
+    }
+
+    /** Threads spells run on, the main thread included, 0 for one per hardware thread. */
+    void
+    set_worker_count(int64_t count)
+    {
+        runner.set_worker_count(static_cast<size_t>(std::max<int64_t>(count, 0)));
     }
 
     [[nodiscard]] auto
-    run_with_result(float delta) -> execute::ExecRunner::RunResult
+    get_worker_count() const -> int64_t
     {
-        return runner.run_all();
+        return static_cast<int64_t>(runner.get_worker_count());
     }
 
+    /** What the spells of the program drew in the last tick, laid out for MultiMesh.buffer with 3d transforms and colors. */
+    [[nodiscard]] auto
+    get_render_buffer(godot::Ref<MagixByteCode> bytecode) const -> godot::PackedFloat32Array;
+
+    /** Write what the spells of the program draw into the multimesh of the target after every tick, null to stop. */
+    void
+    bind_multimesh(godot::Ref<MagixByteCode> bytecode, godot::MultiMeshInstance3D *target);
+
+    /** Answers the host_requests that are not handled natively, one call per kind with the records of all of them. Returns the
+     * records with the results filled in, anything else leaves them as they are.
+     */
+    GDVIRTUAL3R(godot::PackedByteArray, _host_requests, int64_t, godot::PackedByteArray, godot::Array);
+
 #if MAGIX_BUILD_TESTS
     static auto
     run_tests() -> int;
+
+    static auto
+    run_benchmarks() -> int;
 #endif
 
   protected:
@@ -45,7 +112,30 @@ class MagixVirtualMachine : public godot::Node
     _bind_methods();
 
   private:
+    void
+    handle_host_calls(magix::u16 kind, magix::span<execute::HostCall> calls);
+
+    /** Push the render buffers to the bound multimeshes, straight to the rendering server. */
+    void
+    update_multimeshes();
+
+    /** All of them through one space state and query. */
+    void
+    raycast(magix::span<execute::HostCall> calls);
+
+    struct MultiMeshBinding
+    {
+        godot::Ref<MagixByteCode> bytecode;
+        /** Instance id, the target may be freed while bound. */
+        uint64_t target_id = 0;
+        /** Kept between ticks, so it only allocates when the multimesh grows. */
+        godot::PackedFloat32Array buffer;
+    };
+
     execute::ExecRunner runner;
+    std::vector<MultiMeshBinding> multimesh_bindings;
+    int64_t frame_budget_usec = 0;
+    float last_delta = 0.0f;
 };
 
 } // namespace magix
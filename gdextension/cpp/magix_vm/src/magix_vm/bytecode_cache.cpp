@@ -0,0 +1,84 @@
+#include "magix_vm/bytecode_cache.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+
+#include <algorithm>
+
+auto
+magix::ByteCodeCache::global() -> ByteCodeCache &
+{
+    static ByteCodeCache cache;
+    return cache;
+}
+
+auto
+magix::ByteCodeCache::key_of(const godot::String &source) -> magix::u64
+{
+    // FNV-1a over the characters, seeded with the ISA version
+    magix::u64 hash = 0xcbf29ce484222325ull ^ compile::isa_version();
+    const char32_t *characters = source.ptr();
+    for (int64_t index = 0; index < source.length(); ++index)
+    {
+        hash ^= static_cast<magix::u64>(characters[index]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+auto
+magix::ByteCodeCache::find(const godot::String &source) -> godot::Ref<MagixByteCode>
+{
+    const magix::u64 key = key_of(source);
+    std::lock_guard lock{mutex};
+    auto [begin, end] = entries.equal_range(key);
+    auto found = std::find_if(begin, end, [&](const auto &entry) { return entry.second.source == source; });
+    return found != end ? found->second.bytecode : godot::Ref<MagixByteCode>{};
+}
+
+auto
+magix::ByteCodeCache::insert(const godot::String &source, godot::Ref<MagixByteCode> bytecode) -> godot::Ref<MagixByteCode>
+{
+    const magix::u64 key = key_of(source);
+    std::lock_guard lock{mutex};
+    auto [begin, end] = entries.equal_range(key);
+    auto found = std::find_if(begin, end, [&](const auto &entry) { return entry.second.source == source; });
+    if (found != end)
+    {
+        return found->second.bytecode;
+    }
+    if (entries.size() >= sweep_at)
+    {
+        drop_unused();
+        sweep_at = std::max<size_t>(entries.size() * 2, 64);
+    }
+    entries.emplace(key, Entry{source, bytecode});
+    return bytecode;
+}
+
+auto
+magix::ByteCodeCache::size() const -> size_t
+{
+    std::lock_guard lock{mutex};
+    return entries.size();
+}
+
+void
+magix::ByteCodeCache::clear()
+{
+    std::lock_guard lock{mutex};
+    entries.clear();
+    sweep_at = 64;
+}
+
+void
+magix::ByteCodeCache::drop_unused()
+{
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (it->second.bytecode->get_reference_count() == 1)
+        {
+            it = entries.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
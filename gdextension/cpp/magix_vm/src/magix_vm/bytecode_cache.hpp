@@ -0,0 +1,66 @@
+#ifndef MAGIX_BYTECODE_CACHE_HPP_
+#define MAGIX_BYTECODE_CACHE_HPP_
+
+#include "godot_cpp/classes/ref.hpp"
+#include "godot_cpp/variant/string.hpp"
+
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+
+namespace magix
+{
+
+/** Programs by the source they were assembled from, so every resource with the same source shares one MagixByteCode, and the
+ * runner one user per caster for all of them. Programs handed out are shared and must not be written. Entries only the cache
+ * still holds are dropped as it grows.
+ */
+class ByteCodeCache
+{
+  public:
+    /** The one MagixAsmProgram compiles through. */
+    [[nodiscard]] static auto
+    global() -> ByteCodeCache &;
+
+    /** The program assembled from the source, null if there is none. */
+    [[nodiscard]] auto
+    find(const godot::String &source) -> godot::Ref<MagixByteCode>;
+
+    /** Keep the program assembled from the source. If another one for it came first, that one is kept and returned. */
+    auto
+    insert(const godot::String &source, godot::Ref<MagixByteCode> bytecode) -> godot::Ref<MagixByteCode>;
+
+    [[nodiscard]] auto
+    size() const -> size_t;
+
+    void
+    clear();
+
+    /** Hash of the source and the ISA version, equal sources may not share bytecode across ISAs. */
+    [[nodiscard]] static auto
+    key_of(const godot::String &source) -> magix::u64;
+
+  private:
+    /** Drop the entries no one else holds, call with the mutex held. */
+    void
+    drop_unused();
+
+    struct Entry
+    {
+        /** Compared in full, the key is only a hash. */
+        godot::String source;
+        godot::Ref<MagixByteCode> bytecode;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_multimap<magix::u64, Entry> entries;
+    /** Size at which insert() drops unused entries next, twice what was left the last time. */
+    size_t sweep_at = 64;
+};
+
+} // namespace magix
+
+#endif // MAGIX_BYTECODE_CACHE_HPP_
@@ -9,17 +9,26 @@
 #include "magix_vm/ranges.hpp"
 #include "magix_vm/span.hpp"
 #include "magix_vm/types.hpp"
+#include "magix_vm/variant_helper.hpp"
 
 #include "godot_cpp/variant/string.hpp"
 
+#include <algorithm>
 #include <array>
 #include <charconv>
 #include <cstddef>
 #include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
 #include <optional>
 #include <system_error>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace
@@ -160,6 +169,13 @@ struct TrackRemapInstruction
     }
 };
 
+/** A fully remapped instruction, waiting in the fuse window to be encoded. */
+struct PendingInstruction
+{
+    TrackRemapInstruction instruction;
+    const magix::compile::InstructionSpec *spec;
+};
+
 struct ParsePreparePseudoResult
 {
     bool parse_ok;
@@ -174,6 +190,13 @@ struct EatTokenResult
 
 using ErrorStack = std::vector<magix::compile::AssemblerError>;
 
+/** A size directive, with where it was given, to point at when a later block redefines it. */
+struct ConfigValue
+{
+    magix::u32 value;
+    magix::compile::SrcToken directive;
+};
+
 struct Assembler
 {
     using span_type = magix::span<const magix::compile::SrcToken>;
@@ -191,6 +214,9 @@ struct Assembler
 
     void
     parse_program();
+    /** Parse the statements of one line, its tokens end in its LINE_END. Instructions are left in the fuse window. */
+    void
+    parse_line(span_type line);
     auto
     parse_statement() -> bool;
     auto
@@ -217,6 +243,9 @@ struct Assembler
     remap_emit_instruction();
     void
     emit_instruction(const TrackRemapInstruction &inst, const magix::compile::InstructionSpec &spec);
+    /** Encode every pending instruction, fusing sequences into superinstructions where possible. */
+    void
+    flush_fuse_window();
 
     void
     align_data_segment(size_t alignment);
@@ -237,14 +266,16 @@ struct Assembler
     std::vector<magix::compile::SrcView> entry_labels;
     std::map<magix::compile::SrcView, LabelData> labels;
 
-    std::optional<magix::u32> stack_size;
-    std::optional<magix::u32> fork_size;
-    std::optional<magix::u32> shared_size;
-    std::optional<magix::u32> obj_count;
-    std::optional<magix::u32> obj_fork_count;
-    std::optional<magix::u32> obj_shared_count;
+    std::optional<ConfigValue> stack_size;
+    std::optional<ConfigValue> fork_size;
+    std::optional<ConfigValue> shared_size;
+    std::optional<ConfigValue> obj_count;
+    std::optional<ConfigValue> obj_fork_count;
+    std::optional<ConfigValue> obj_shared_count;
 
     std::vector<TrackRemapInstruction> remap_cache;
+    /** Instructions are only encoded once a label binds in front of the next one, so superinstructions can span lines. */
+    std::vector<PendingInstruction> fuse_window;
 
     ErrorStack error_stack;
 
@@ -253,6 +284,45 @@ struct Assembler
     std::vector<std::byte> data_segment;
     std::vector<magix::code_word> code_segment;
 };
+
+/** Every superinstruction, longest first, so greedy matching fuses as much as possible. */
+auto
+superinstruction_specs() -> const std::vector<const magix::compile::InstructionSpec *> &
+{
+    static const std::vector<const magix::compile::InstructionSpec *> specs = [] {
+        std::vector<const magix::compile::InstructionSpec *> out;
+        for (const magix::compile::InstructionSpec &spec : magix::compile::all_instruction_specs())
+        {
+            if (spec.fused_sequence.size() != 0)
+            {
+                out.push_back(&spec);
+            }
+        }
+        std::stable_sort(out.begin(), out.end(), [](const auto *lhs, const auto *rhs) {
+            return lhs->fused_sequence.size() > rhs->fused_sequence.size();
+        });
+        return out;
+    }();
+    return specs;
+}
+
+/** Whether the pending instructions start with the parts of the superinstruction. */
+auto
+matches_superinstruction(const magix::compile::InstructionSpec &super, magix::span<const PendingInstruction> pending) -> bool
+{
+    if (pending.size() < super.fused_sequence.size())
+    {
+        return false;
+    }
+    for (auto part : magix::ranges::num_range(super.fused_sequence.size()))
+    {
+        if (pending[part].spec->opcode != super.fused_sequence[part])
+        {
+            return false;
+        }
+    }
+    return true;
+}
 } // namespace
 
 template <class T>
@@ -510,6 +580,13 @@ Assembler::bind_labels_to_data_segment()
 void
 Assembler::bind_labels_to_code_segment()
 {
+    if (unbound_labels.empty())
+    {
+        return;
+    }
+    // something may jump here, so nothing can be fused across the label
+    flush_fuse_window();
+
     // get current offset
     const magix::u16 code_bytes = static_cast<magix::u16>(code_segment.size() * magix::code_size_v<magix::code_word>);
     for (const auto &label : unbound_labels)
@@ -942,6 +1019,45 @@ Assembler::emit_instruction(const TrackRemapInstruction &inst, const magix::comp
     code_segment.insert(code_segment.end(), encode_buf.begin(), encode_it);
 }
 
+void
+Assembler::flush_fuse_window()
+{
+    size_t index = 0;
+    while (index < fuse_window.size())
+    {
+        magix::span<const PendingInstruction> remaining{&fuse_window[index], fuse_window.size() - index};
+        const magix::compile::InstructionSpec *fused_spec = nullptr;
+        for (const magix::compile::InstructionSpec *super : superinstruction_specs())
+        {
+            if (matches_superinstruction(*super, remaining))
+            {
+                fused_spec = super;
+                break;
+            }
+        }
+
+        if (fused_spec == nullptr)
+        {
+            emit_instruction(remaining.front().instruction, *remaining.front().spec);
+            ++index;
+            continue;
+        }
+
+        // encoded like the parts, so each keeps its address, only the first opcode selects the superinstruction
+        const size_t first_word = code_segment.size();
+        for (const PendingInstruction &part : remaining.first(fused_spec->fused_sequence.size()))
+        {
+            emit_instruction(part.instruction, *part.spec);
+        }
+        if (first_word < code_segment.size())
+        {
+            code_segment[first_word] = fused_spec->opcode;
+        }
+        index += fused_spec->fused_sequence.size();
+    }
+    fuse_window.clear();
+}
+
 auto
 Assembler::validate_instruction_args(const TrackRemapInstruction &inst, const magix::compile::InstructionSpec &spec) -> bool
 {
@@ -1101,7 +1217,7 @@ Assembler::remap_emit_instruction()
 
         if (!spec->is_pseudo)
         {
-            emit_instruction(current, *spec);
+            fuse_window.push_back({current, spec});
             continue;
         }
         // only pseudo instructions are remapped.
@@ -1269,7 +1385,7 @@ Assembler::parse_config_value(std::optional<T> &out, const magix::compile::SrcTo
     }
     else
     {
-        out = config_value;
+        out = T{config_value, dir_tok};
     }
     return true;
 }
@@ -1424,6 +1540,21 @@ Assembler::parse_program()
             discard_remaining_line();
         }
     }
+    flush_fuse_window();
+}
+
+void
+Assembler::parse_line(span_type line)
+{
+    current_token = line.begin();
+    end_token = line.end();
+    while (current_token != end_token)
+    {
+        if (!parse_statement())
+        {
+            discard_remaining_line();
+        }
+    }
 }
 
 void
@@ -1437,6 +1568,7 @@ Assembler::reset_to_src(magix::span<const magix::compile::SrcToken> tokens)
     labels.clear();
 
     remap_cache.clear();
+    fuse_window.clear();
 
     error_stack.clear();
 
@@ -1472,11 +1604,13 @@ Assembler::link(magix::compile::ByteCodeRaw &out)
     };
 
     // copy and get pointers
-    std::byte *out_it_base = out.code;
+    out.code.resize(requested_size);
+    out.data_segment_size = static_cast<magix::u32>(data.size());
+    out.code_segment_size = static_cast<magix::u32>(code.size());
+    std::byte *out_it_base = out.code.data();
     std::byte *out_it_data = out_it_base;
     std::byte *out_it_code = std::copy(data.begin(), data.end(), out_it_data);
     std::byte *out_it_end = std::copy(code.begin(), code.end(), out_it_code);
-    std::fill(out_it_end, std::end(out.code), std::byte{});
 
     // the basic ROM is now set up
     // now we just need to fix all those linker tasks
@@ -1634,28 +1768,285 @@ Assembler::link(magix::compile::ByteCodeRaw &out)
     }
 
     // write configured values
-    out.stack_size = stack_size.value_or(magix::execute::stack_size_default);
-    out.fork_size = fork_size.value_or(0);
-    out.shared_size = shared_size.value_or(0);
-    out.obj_count = obj_count.value_or(0);
-    out.obj_fork_count = obj_fork_count.value_or(0);
-    out.obj_shared_count = obj_shared_count.value_or(0);
+    auto value_or = [](const std::optional<ConfigValue> &config, magix::u32 fallback) {
+        return config.has_value() ? config->value : fallback;
+    };
+    out.stack_size = value_or(stack_size, magix::execute::stack_size_default);
+    out.fork_size = value_or(fork_size, 0);
+    out.shared_size = value_or(shared_size, 0);
+    out.obj_count = value_or(obj_count, magix::execute::objbank_size_default);
+    out.obj_fork_count = value_or(obj_fork_count, 0);
+    out.obj_shared_count = value_or(obj_shared_count, 0);
+}
+
+namespace
+{
+
+/** Largest alignment of data directives, blocks are assembled for where in it their data starts. */
+constexpr size_t max_data_alignment = magix::code_align_v<magix::u64>;
+static_assert(magix::code_align_v<magix::f64> <= max_data_alignment);
+
+using LineSpan = magix::span<const magix::compile::SrcToken>;
+
+/** Whether the line declares a label first, so a block can start at it. */
+auto
+starts_with_label(LineSpan line) -> bool
+{
+    if (line.size() == 0)
+    {
+        return false;
+    }
+    if (line[0].type == magix::compile::TokenType::ENTRY_MARKER)
+    {
+        return true;
+    }
+    return line.size() > 1 && line[0].type == magix::compile::TokenType::IDENTIFIER &&
+           line[1].type == magix::compile::TokenType::LABEL_MARKER;
+}
+
+/** The tokens of every line, each ending in its LINE_END. */
+auto
+split_lines(magix::span<const magix::compile::SrcToken> tokens) -> std::vector<LineSpan>
+{
+    std::vector<LineSpan> lines;
+    size_t line_begin = 0;
+    for (auto index : magix::ranges::num_range(tokens.size()))
+    {
+        if (tokens[index].type == magix::compile::TokenType::LINE_END)
+        {
+            lines.push_back(tokens.subspan(line_begin, index + 1));
+            line_begin = index + 1;
+        }
+    }
+    if (line_begin != tokens.size())
+    {
+        lines.push_back(tokens.subspan(line_begin, tokens.size()));
+    }
+    return lines;
+}
+
+/** Lines from one label up to the next, assembled on their own. Offsets are relative to the block, so it can be reused wherever
+ * in the program it ends up, as long as its data starts at the same phase of max_data_alignment.
+ */
+struct AssembledBlock
+{
+    size_t line_begin;
+    size_t line_end;
+    /** Size of the data in front of the block, modulo max_data_alignment. */
+    size_t data_phase;
+    Assembler assembler;
+};
+
+/** Assemble from the line up to the next one that declares a label with nothing left to bind. Something may jump to that label,
+ * so nothing is fused across it.
+ */
+auto
+assemble_block(magix::span<const LineSpan> lines, size_t line_begin, size_t data_phase) -> AssembledBlock
+{
+    AssembledBlock block{line_begin, line_begin, data_phase, {}};
+    Assembler &assembler = block.assembler;
+    // stands in for the data in front, so data is aligned as it will be
+    assembler.data_segment.resize(data_phase);
+    do
+    {
+        assembler.parse_line(lines[block.line_end++]);
+    } while (block.line_end < lines.size() && !(assembler.unbound_labels.empty() && starts_with_label(lines[block.line_end])));
+    assembler.flush_fuse_window();
+
+    assembler.data_segment.erase(assembler.data_segment.begin(), assembler.data_segment.begin() + data_phase);
+    for (auto &[name, label] : assembler.labels)
+    {
+        if (label.mode == LabelData::LabelMode::DATA)
+        {
+            label.offset -= static_cast<magix::u16>(data_phase);
+        }
+    }
+    for (LinkerTask &task : assembler.linker_tasks)
+    {
+        if (task.segment == LinkerTask::Segment::DATA)
+        {
+            task.offset -= static_cast<magix::u16>(data_phase);
+        }
+    }
+    return block;
+}
+
+/** Assemble the lines block by block. A block of `reusable`, indexed by the line it starts at now, is taken as it is if it ends
+ * where assembling it again would, and its data, if any, starts at the same phase. Returns how many blocks were assembled.
+ */
+auto
+assemble_blocks(
+    magix::span<const LineSpan> lines, std::vector<AssembledBlock> &blocks, std::vector<AssembledBlock> &previous,
+    magix::span<const size_t> reusable
+) -> size_t
+{
+    size_t assembled = 0;
+    size_t data_size = 0;
+    for (size_t line = 0; line < lines.size(); line = blocks.back().line_end)
+    {
+        const size_t data_phase = data_size % max_data_alignment;
+        if (line < reusable.size() && reusable[line] < previous.size())
+        {
+            AssembledBlock &block = previous[reusable[line]];
+            const size_t line_end = line + block.line_end - block.line_begin;
+            const bool ends_here =
+                line_end == lines.size() || (block.assembler.unbound_labels.empty() && starts_with_label(lines[line_end]));
+            if ((block.data_phase == data_phase || block.assembler.data_segment.empty()) && ends_here)
+            {
+                block.line_begin = line;
+                block.data_phase = data_phase;
+                block.line_end = line_end;
+                blocks.push_back(std::move(block));
+                data_size += blocks.back().assembler.data_segment.size();
+                continue;
+            }
+        }
+        blocks.push_back(assemble_block(lines, line, data_phase));
+        data_size += blocks.back().assembler.data_segment.size();
+        ++assembled;
+    }
+    return assembled;
+}
+
+/** One assembler holding the blocks back to back, as if it parsed all their lines, ready to link. Labels and size directives
+ * given again by a later block are reported here.
+ */
+auto
+merge_blocks(magix::span<const AssembledBlock> blocks) -> Assembler
+{
+    Assembler merged;
+    for (const AssembledBlock &block : blocks)
+    {
+        const Assembler &part = block.assembler;
+        const auto data_base = static_cast<magix::u16>(merged.data_segment.size());
+        const auto code_base = static_cast<magix::u16>(merged.code_segment.size() * magix::code_size_v<magix::code_word>);
+
+        merged.error_stack.insert(merged.error_stack.end(), part.error_stack.begin(), part.error_stack.end());
+
+        for (auto [config, part_config] : {
+                 std::pair{&merged.stack_size, &part.stack_size},
+                 std::pair{&merged.fork_size, &part.fork_size},
+                 std::pair{&merged.shared_size, &part.shared_size},
+                 std::pair{&merged.obj_count, &part.obj_count},
+                 std::pair{&merged.obj_fork_count, &part.obj_fork_count},
+                 std::pair{&merged.obj_shared_count, &part.obj_shared_count},
+             })
+        {
+            if (!part_config->has_value())
+            {
+                continue;
+            }
+            if (config->has_value())
+            {
+                merged.error_stack.emplace_back(
+                    magix::compile::assembler_errors::ConfigRedefinition{
+                        (*part_config)->directive,
+                    }
+                );
+                continue;
+            }
+            *config = *part_config;
+        }
+
+        for (const auto &[name, part_label] : part.labels)
+        {
+            LabelData label = part_label;
+            if (label.mode == LabelData::LabelMode::DATA)
+            {
+                label.offset += data_base;
+            }
+            else if (label.mode == LabelData::LabelMode::CODE)
+            {
+                label.offset += code_base;
+            }
+            auto [insert_it, did_insert] = merged.labels.try_emplace(name, label);
+            if (!did_insert)
+            {
+                merged.error_stack.emplace_back(
+                    magix::compile::assembler_errors::DuplicateLabels{
+                        insert_it->second.declaration,
+                        label.declaration,
+                    }
+                );
+            }
+        }
+        for (magix::compile::SrcView name : part.entry_labels)
+        {
+            // unless an earlier block declared it first
+            if (merged.labels.at(name).declaration.content.data() == part.labels.at(name).declaration.content.data())
+            {
+                merged.entry_labels.push_back(name);
+            }
+        }
+        merged.unbound_labels.insert(merged.unbound_labels.end(), part.unbound_labels.begin(), part.unbound_labels.end());
+
+        for (LinkerTask task : part.linker_tasks)
+        {
+            task.offset += task.segment == LinkerTask::Segment::DATA ? data_base : code_base;
+            merged.linker_tasks.push_back(task);
+        }
+        merged.data_segment.insert(merged.data_segment.end(), part.data_segment.begin(), part.data_segment.end());
+        merged.code_segment.insert(merged.code_segment.end(), part.code_segment.begin(), part.code_segment.end());
+    }
+    return merged;
+}
+
+/** Call the function with every token of the error. */
+template <class F>
+void
+for_each_token(magix::compile::AssemblerError &error, F &&function)
+{
+    namespace errors = magix::compile::assembler_errors;
+    std::visit(
+        magix::overload{
+            [&](errors::NumberInvalid &err) { function(err.token); },
+            [&](errors::NumberNotRepresentable &err) { function(err.token); },
+            [&](errors::UnexpectedToken &err) { function(err.got); },
+            [&](errors::UnknownInstruction &err) { function(err.instruction_name); },
+            [&](errors::DuplicateLabels &err) {
+                function(err.first_declaration);
+                function(err.second_declaration);
+            },
+            [&](errors::MissingArgument &err) { function(err.source_instruction); },
+            [&](errors::TooManyArguments &err) {
+                function(err.source_instruction);
+                function(err.additional_reg);
+            },
+            [&](errors::ExpectedLocalGotImmediate &err) {
+                function(err.source_instruction);
+                function(err.mismatched);
+            },
+            [&](errors::ExpectedImmediateGotLocal &err) {
+                function(err.source_instruction);
+                function(err.mismatched);
+            },
+            [&](errors::EntryMustPointToCode &err) { function(err.label_declaration); },
+            [&](errors::UnknownDirective &err) { function(err.directive); },
+            [&](errors::CompilationTooBig &) {},
+            [&](errors::UnboundLabel &err) { function(err.which); },
+            [&](errors::ConfigRedefinition &err) { function(err.redef); },
+            [&](errors::InternalError &) {},
+        },
+        error
+    );
 }
 
+} // namespace
+
 auto
 magix::compile::assemble(magix::span<const magix::compile::SrcToken> tokens, magix::compile::ByteCodeRaw &out)
     -> std::vector<magix::compile::AssemblerError>
 {
-    Assembler assembler;
     // TODO: properly assert this
     // assert(tokens.back().type == magix::compile::TokenType::END_OF_FILE);
 
-    // reset
-    assembler.reset_to_src(tokens);
-
-    // parse, this will call back into every emit function
-    assembler.parse_program();
+    // assembled in blocks, exactly as the incremental assembler does
+    std::vector<LineSpan> lines = split_lines(tokens);
+    std::vector<AssembledBlock> blocks;
+    std::vector<AssembledBlock> no_previous;
+    std::ignore = assemble_blocks(lines, blocks, no_previous, {});
 
+    Assembler assembler = merge_blocks(blocks);
     if (assembler.error_stack.empty())
     {
         assembler.link(out);
@@ -1664,6 +2055,215 @@ magix::compile::assemble(magix::span<const magix::compile::SrcToken> tokens, mag
     return std::move(assembler.error_stack);
 }
 
+struct magix::compile::IncrementalAssembler::State
+{
+    /** One line of the source with its newline, if it has one. Its tokens point into the text and count lines from 0, the line
+     * number is only added to the errors handed out.
+     */
+    struct Line
+    {
+        /** Followed by a 0, which the end of the source points to. */
+        std::vector<SrcChar> text;
+        std::vector<SrcToken> tokens;
+        /** A string runs past the newline, the line lexes differently on its own. */
+        bool open_string = false;
+
+        [[nodiscard]] auto
+        view() const -> SrcView
+        {
+            return {text.data(), text.size() - 1};
+        }
+    };
+
+    [[nodiscard]] static auto
+    lex_line(SrcView text) -> std::unique_ptr<Line>;
+
+    /** The errors with the line numbers of the tokens added. */
+    [[nodiscard]] auto
+    locate_errors(std::vector<AssemblerError> errors) const -> std::vector<AssemblerError>;
+
+    /** Lines own their text, so tokens and errors stay valid as lines around them change. */
+    std::vector<std::unique_ptr<Line>> lines;
+    std::vector<AssembledBlock> blocks;
+    /** The whole source, while it is lexed as a whole. */
+    std::vector<SrcChar> whole_source;
+    size_t lexed_lines = 0;
+    size_t assembled_blocks = 0;
+};
+
+auto
+magix::compile::IncrementalAssembler::State::lex_line(SrcView text) -> std::unique_ptr<Line>
+{
+    auto line = std::make_unique<Line>();
+    line->text.reserve(text.size() + 1);
+    line->text.assign(text.begin(), text.end());
+    line->text.push_back(0);
+    line->tokens = lex(line->view());
+    if (text.size() != 0 && text.back() == SYMBOL_NEWLINE)
+    {
+        // not the end of the source
+        line->tokens.pop_back();
+        line->open_string = line->tokens.empty() || line->tokens.back().type != TokenType::LINE_END;
+    }
+    else
+    {
+        // empty like the one lex hands out, but pointing into the line
+        line->tokens.back().content = {&line->text.back(), 0};
+    }
+    return line;
+}
+
+auto
+magix::compile::IncrementalAssembler::State::locate_errors(std::vector<AssemblerError> errors) const -> std::vector<AssemblerError>
+{
+    if (errors.empty())
+    {
+        return errors;
+    }
+    std::vector<std::pair<const SrcChar *, size_t>> line_starts;
+    line_starts.reserve(lines.size());
+    for (auto index : magix::ranges::num_range(lines.size()))
+    {
+        line_starts.emplace_back(lines[index]->text.data(), index);
+    }
+    std::sort(line_starts.begin(), line_starts.end(), [](const auto &lhs, const auto &rhs) {
+        return std::less<const SrcChar *>{}(lhs.first, rhs.first);
+    });
+
+    auto locate = [&](SrcToken &token) {
+        const SrcChar *content = token.content.data();
+        auto found = std::upper_bound(line_starts.begin(), line_starts.end(), content, [](const SrcChar *ptr, const auto &start) {
+            return std::less<const SrcChar *>{}(ptr, start.first);
+        });
+        if (found == line_starts.begin())
+        {
+            return;
+        }
+        --found;
+        const std::vector<SrcChar> &text = lines[found->second]->text;
+        if (!std::less<const SrcChar *>{}(content, text.data() + text.size()))
+        {
+            // not from the source, like the tokens of pseudo instructions
+            return;
+        }
+        token.begin.line += found->second;
+        token.end.line += found->second;
+    };
+    for (AssemblerError &error : errors)
+    {
+        for_each_token(error, locate);
+    }
+    return errors;
+}
+
+magix::compile::IncrementalAssembler::IncrementalAssembler() : state(std::make_unique<State>()) {}
+
+magix::compile::IncrementalAssembler::~IncrementalAssembler() = default;
+
+magix::compile::IncrementalAssembler::IncrementalAssembler(IncrementalAssembler &&) noexcept = default;
+
+auto
+magix::compile::IncrementalAssembler::operator=(IncrementalAssembler &&) noexcept -> IncrementalAssembler & = default;
+
+auto
+magix::compile::IncrementalAssembler::update(SrcView source, ByteCodeRaw &out) -> std::vector<AssemblerError>
+{
+    // split after every newline
+    std::vector<SrcView> texts;
+    for (size_t begin = 0;;)
+    {
+        const size_t newline = source.find(SYMBOL_NEWLINE, begin);
+        if (newline == SrcView::npos)
+        {
+            texts.push_back(source.substr(begin));
+            break;
+        }
+        texts.push_back(source.substr(begin, newline + 1 - begin));
+        begin = newline + 1;
+    }
+
+    // keep the lines in front of and behind the edit
+    const size_t old_count = state->lines.size();
+    const size_t new_count = texts.size();
+    const size_t common = std::min(old_count, new_count);
+    size_t prefix = 0;
+    while (prefix < common && state->lines[prefix]->view() == texts[prefix])
+    {
+        ++prefix;
+    }
+    size_t suffix = 0;
+    while (suffix < common - prefix && state->lines[old_count - 1 - suffix]->view() == texts[new_count - 1 - suffix])
+    {
+        ++suffix;
+    }
+
+    std::vector<std::unique_ptr<State::Line>> lines;
+    lines.reserve(new_count);
+    std::move(state->lines.begin(), state->lines.begin() + prefix, std::back_inserter(lines));
+    for (size_t index = prefix; index < new_count - suffix; ++index)
+    {
+        lines.push_back(State::lex_line(texts[index]));
+    }
+    std::move(state->lines.end() - suffix, state->lines.end(), std::back_inserter(lines));
+    state->lines = std::move(lines);
+    state->lexed_lines = new_count - prefix - suffix;
+
+    if (std::any_of(state->lines.begin(), state->lines.end(), [](const auto &line) { return line->open_string; }))
+    {
+        // strings over several lines only lex right as a whole
+        state->blocks.clear();
+        state->lexed_lines = new_count;
+        state->whole_source.assign(source.begin(), source.end());
+        std::vector<SrcToken> tokens = lex({state->whole_source.data(), state->whole_source.size()});
+        return assemble(tokens, out);
+    }
+    state->whole_source.clear();
+
+    // the blocks whose lines are all still there, by the line they start at now
+    std::vector<size_t> reusable(new_count, std::numeric_limits<size_t>::max());
+    for (auto index : magix::ranges::num_range(state->blocks.size()))
+    {
+        const AssembledBlock &block = state->blocks[index];
+        if (block.line_end <= prefix)
+        {
+            reusable[block.line_begin] = index;
+        }
+        else if (block.line_begin >= old_count - suffix)
+        {
+            reusable[block.line_begin + new_count - old_count] = index;
+        }
+    }
+
+    std::vector<LineSpan> line_tokens;
+    line_tokens.reserve(new_count);
+    for (const auto &line : state->lines)
+    {
+        line_tokens.emplace_back(line->tokens);
+    }
+    std::vector<AssembledBlock> blocks;
+    state->assembled_blocks = assemble_blocks(line_tokens, blocks, state->blocks, reusable);
+    state->blocks = std::move(blocks);
+
+    Assembler assembler = merge_blocks(state->blocks);
+    if (assembler.error_stack.empty())
+    {
+        assembler.link(out);
+    }
+    return state->locate_errors(std::move(assembler.error_stack));
+}
+
+auto
+magix::compile::IncrementalAssembler::lexed_lines() const noexcept -> size_t
+{
+    return state->lexed_lines;
+}
+
+auto
+magix::compile::IncrementalAssembler::assembled_blocks() const noexcept -> size_t
+{
+    return state->assembled_blocks;
+}
+
 // ----- //
 // TESTS //
 // ----- //
@@ -1676,6 +2276,7 @@ magix::compile::assemble(magix::span<const magix::compile::SrcToken> tokens, mag
 #include "godot_cpp/templates/pair.hpp"
 
 #include <ostream>
+#include <string>
 
 namespace
 {
@@ -2268,10 +2869,12 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::code_word expected_bytecode_u[8] = {spec->opcode, 32, 28, 128};
+        magix::code_word expected_bytecode_u[4] = {spec->opcode, 32, 28, 128};
         auto expected_bc = magix::span(expected_bytecode_u).as_const_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
+        CHECK_EQ(bc.data_segment_size, 0);
+        CHECK_EQ(bc.code_segment_size, sizeof(expected_bytecode_u));
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
         ;
@@ -2451,9 +3054,9 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::code_word expected_bytecode_u[8] = {spec_add_u32_imm->opcode, 32, 28, 8};
+        magix::code_word expected_bytecode_u[4] = {spec_add_u32_imm->opcode, 32, 28, 8};
         auto expected_bc = magix::span(expected_bytecode_u).as_const_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
 
         const godot::KeyValue<godot::String, magix::u16> entry_linked[] = {{"label", 8}};
@@ -2535,9 +3138,9 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::code_word expected_bytecode_u[8] = {0x0f}; // yeah kinda expect little endian
+        magix::code_word expected_bytecode_u[1] = {0x0f}; // yeah kinda expect little endian
         auto expected_bc = magix::span(expected_bytecode_u).as_const_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
@@ -2681,9 +3284,10 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::u8 expected_bytecode_u[16] = {magix::u8(-0x0f)}; // just this once
+        // padded to the alignment of the code segment
+        magix::u8 expected_bytecode_u[2] = {magix::u8(-0x0f)}; // just this once
         auto expected_bc = magix::span(expected_bytecode_u).as_const_bytes();
-        auto is_bytecode = magix::span(bc.code).as_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
@@ -2765,9 +3369,9 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::code_word expected_bytecode_u[8] = {0x1234};
+        magix::code_word expected_bytecode_u[1] = {0x1234};
         auto expected_bc = magix::span(expected_bytecode_u).as_const_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
@@ -2850,9 +3454,9 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::u32 expected_bytecode_u[4] = {0x12345678}; // yeah, I don't care about writing it down word for word
+        magix::u32 expected_bytecode_u[1] = {0x12345678}; // yeah, I don't care about writing it down word for word
         auto expected_bc = magix::span(expected_bytecode_u).as_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
@@ -2934,10 +3538,12 @@ TEST_SUITE("assembler/full")
         magix::ranges::empty_range<const magix::compile::AssemblerError> errs_post_link;
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        magix::u64 expected_bytecode_u[2] = {0x123456789abcdef0}; // yeah, I don't care about writing it down word for word
+        magix::u64 expected_bytecode_u[1] = {0x123456789abcdef0}; // yeah, I don't care about writing it down word for word
         auto expected_bc = magix::span(expected_bytecode_u).as_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
+        CHECK_EQ(bc.data_segment_size, sizeof(expected_bytecode_u));
+        CHECK_EQ(bc.code_segment_size, 0);
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
         ;
@@ -3031,9 +3637,9 @@ TEST_SUITE("assembler/full")
         }};
         CHECK_RANGE_EQ(assembler.error_stack, errs_post_link);
 
-        const magix::u8 expected_bytecode_u[16] = {};
-        auto expected_bc = magix::span(expected_bytecode_u).as_bytes();
-        auto is_bytecode = magix::span(bc.code).as_const_bytes().first<16>();
+        // nothing to link, so nothing at all
+        magix::ranges::empty_range<const std::byte> expected_bc;
+        auto is_bytecode = magix::span(bc.code).as_const_bytes();
         CHECK_BYTESTRING_EQ(is_bytecode, expected_bc);
 
         magix::ranges::empty_range<const godot::KeyValue<godot::String, magix::u16>> entry_linked;
@@ -3042,4 +3648,136 @@ TEST_SUITE("assembler/full")
     }
 }
 
+
+namespace
+{
+
+/** A library of spells, each an entry with code jumping around in it, a local label and some data behind it. */
+auto
+spell_library(size_t spells) -> std::vector<std::u32string>
+{
+    std::vector<std::u32string> lines = {U".stack_size 256"};
+    for (auto spell : magix::ranges::num_range(spells))
+    {
+        const std::string digits = std::to_string(spell);
+        const std::u32string index(digits.begin(), digits.end());
+        lines.push_back(U"@spell_" + index + U":");
+        lines.push_back(U"    if.zero #loop_" + index + U", $0");
+        lines.push_back(U"    goto #spell_" + index + U"");
+        lines.push_back(U"loop_" + index + U":");
+        lines.push_back(U"    nop");
+        lines.push_back(U"    exit");
+        lines.push_back(U"table_" + index + U":");
+        lines.push_back(U".u8 " + index);
+        lines.push_back(U".u32 " + index);
+    }
+    return lines;
+}
+
+auto
+join_lines(const std::vector<std::u32string> &lines) -> std::u32string
+{
+    std::u32string source;
+    for (const std::u32string &line : lines)
+    {
+        source += line;
+        source += U'\n';
+    }
+    return source;
+}
+
+/** The incremental assembler must produce what assembling the whole source does. */
+void
+check_same_as_whole(magix::compile::IncrementalAssembler &incremental, const std::u32string &source)
+{
+    magix::compile::ByteCodeRaw expected_bc;
+    std::vector<magix::compile::SrcToken> tokens = magix::compile::lex(source);
+    const std::vector<magix::compile::AssemblerError> expected_errs = magix::compile::assemble(tokens, expected_bc);
+
+    magix::compile::ByteCodeRaw is_bc;
+    const std::vector<magix::compile::AssemblerError> is_errs = incremental.update(source, is_bc);
+
+    CHECK_RANGE_EQ(is_errs, expected_errs);
+    if (!expected_errs.empty())
+    {
+        // not linked
+        return;
+    }
+    CHECK_BYTESTRING_EQ(magix::span(is_bc.code).as_const_bytes(), magix::span(expected_bc.code).as_const_bytes());
+    CHECK_EQ(is_bc.data_segment_size, expected_bc.data_segment_size);
+    CHECK_EQ(is_bc.code_segment_size, expected_bc.code_segment_size);
+    CHECK_EQ(is_bc.stack_size, expected_bc.stack_size);
+    CHECK_RANGE_EQ(is_bc.entry_points, expected_bc.entry_points);
+}
+
+} // namespace
+
+TEST_SUITE("assembler/incremental")
+{
+    TEST_CASE("edits assemble the same as the whole source")
+    {
+        magix::compile::IncrementalAssembler incremental;
+        std::vector<std::u32string> lines = spell_library(8);
+        check_same_as_whole(incremental, join_lines(lines));
+
+        // data of another size moves everything behind it out of alignment
+        lines[8] = U".u16 0";
+        check_same_as_whole(incremental, join_lines(lines));
+
+        // a line in the middle of a block, and one that starts a block
+        lines.insert(lines.begin() + 14, U"    nop");
+        check_same_as_whole(incremental, join_lines(lines));
+        lines.insert(lines.begin() + 20, U"extra:");
+        check_same_as_whole(incremental, join_lines(lines));
+
+        // errors in one block, and across blocks
+        lines[5] = U"    not_an_instruction";
+        check_same_as_whole(incremental, join_lines(lines));
+        lines[5] = U"    nop";
+        lines[30] = U"loop_0:";
+        check_same_as_whole(incremental, join_lines(lines));
+        lines[30] = U".stack_size 128";
+        check_same_as_whole(incremental, join_lines(lines));
+        lines.erase(lines.begin() + 30);
+        lines.erase(lines.begin() + 4);
+        check_same_as_whole(incremental, join_lines(lines));
+
+        // the last line without a newline, and a string running over lines
+        std::u32string source = join_lines(lines) + U"last:\n.u8 1";
+        check_same_as_whole(incremental, source);
+        source += U"\n.u8 \"two\nlines\"";
+        check_same_as_whole(incremental, source);
+        check_same_as_whole(incremental, join_lines(lines));
+    }
+
+    TEST_CASE("editing a line only lexes it and assembles its block")
+    {
+        magix::compile::IncrementalAssembler incremental;
+        std::vector<std::u32string> lines = spell_library(100);
+        magix::compile::ByteCodeRaw bc;
+        CHECK(incremental.update(join_lines(lines), bc).empty());
+        CHECK_EQ(incremental.lexed_lines(), lines.size() + 1);
+
+        // the nop behind loop_55
+        lines[500] = U"    exit";
+        CHECK(incremental.update(join_lines(lines), bc).empty());
+        CHECK_EQ(incremental.lexed_lines(), 1);
+        CHECK_EQ(incremental.assembled_blocks(), 1);
+
+        // more data in table_55, the tables behind it start at another alignment, code is taken as it is
+        lines.insert(lines.begin() + 505, U".u32 0");
+        CHECK(incremental.update(join_lines(lines), bc).empty());
+        CHECK_EQ(incremental.lexed_lines(), 1);
+        CHECK_EQ(incremental.assembled_blocks(), 1 + 44);
+
+        // errors point at the line in the whole source, the nop behind loop_99
+        lines[897] = U"    not_an_instruction";
+        const std::vector<magix::compile::AssemblerError> errors = incremental.update(join_lines(lines), bc);
+        REQUIRE_EQ(errors.size(), 1);
+        const auto *unknown = std::get_if<magix::compile::assembler_errors::UnknownInstruction>(&errors[0]);
+        REQUIRE(unknown != nullptr);
+        CHECK_EQ(unknown->instruction_name.begin.line, 897);
+    }
+}
+
 #endif
@@ -5,6 +5,7 @@
 #include "magix_vm/compilation/lexer.hpp"
 #include "magix_vm/flagset.hpp"
 #include "magix_vm/span.hpp"
+#include <memory>
 #include <variant>
 
 namespace magix::compile
@@ -311,6 +312,40 @@ class AssemblerError : public assembler_errors::variant_type
 [[nodiscard]] auto
 assemble(magix::span<const SrcToken> tokens, ByteCodeRaw &out) -> std::vector<AssemblerError>;
 
+/** Assembles one source as it is edited. Keeps the tokens of every line and the program assembled in blocks, from one label to
+ * the next, so an update only lexes the lines that changed and only assembles the blocks they are in. The rest is merged and
+ * linked again. Produces the same as lexing and assembling the whole source.
+ */
+class IncrementalAssembler
+{
+  public:
+    IncrementalAssembler();
+    ~IncrementalAssembler();
+
+    IncrementalAssembler(const IncrementalAssembler &) = delete;
+    auto
+    operator=(const IncrementalAssembler &) -> IncrementalAssembler & = delete;
+    IncrementalAssembler(IncrementalAssembler &&) noexcept;
+    auto
+    operator=(IncrementalAssembler &&) noexcept -> IncrementalAssembler &;
+
+    /** Assemble the source as it is now. Errors point into the kept lines and stay valid until the next update. */
+    [[nodiscard]] auto
+    update(SrcView source, ByteCodeRaw &out) -> std::vector<AssemblerError>;
+
+    /** Lines lexed by the last update. */
+    [[nodiscard]] auto
+    lexed_lines() const noexcept -> size_t;
+
+    /** Blocks assembled by the last update, the others were taken from the one before. */
+    [[nodiscard]] auto
+    assembled_blocks() const noexcept -> size_t;
+
+  private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
 } // namespace magix::compile
 
 #endif // MAGIX_COMPILATION_ASSEMBLER_HPP_
@@ -0,0 +1,171 @@
+#include "magix_vm/compilation/bytecode_file.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+
+constexpr std::array<std::byte, 4> bytecode_file_magic = {std::byte{'M'}, std::byte{'X'}, std::byte{'B'}, std::byte{'C'}};
+constexpr size_t entry_header_size = 4;
+
+template <class T>
+void
+put_le(std::vector<std::byte> &out, T value)
+{
+    for (size_t index = 0; index < sizeof(T); ++index)
+    {
+        out.push_back(static_cast<std::byte>((value >> (8 * index)) & 0xff));
+    }
+}
+
+template <class T>
+auto
+get_le(magix::span<const std::byte> in, size_t offset) -> T
+{
+    T value = 0;
+    for (size_t index = 0; index < sizeof(T); ++index)
+    {
+        value |= static_cast<T>(std::to_integer<T>(in[offset + index]) << (8 * index));
+    }
+    return value;
+}
+
+} // namespace
+
+auto
+magix::compile::write_bytecode_file(const ByteCodeRaw &code) -> std::vector<std::byte>
+{
+    std::vector<std::byte> out;
+    size_t entry_table_size = 0;
+    for (auto [name, address] : code.entry_points)
+    {
+        entry_table_size += entry_header_size + sizeof(char32_t) * static_cast<size_t>(name.length());
+    }
+    out.reserve(bytecode_file_header_size + code.code.size() + entry_table_size);
+
+    out.insert(out.end(), bytecode_file_magic.begin(), bytecode_file_magic.end());
+    put_le<magix::u32>(out, bytecode_file_version);
+    put_le<magix::u64>(out, isa_version());
+    put_le<magix::u32>(out, code.data_segment_size);
+    put_le<magix::u32>(out, code.code_segment_size);
+    put_le<magix::u32>(out, static_cast<magix::u32>(code.entry_points.size()));
+    put_le<magix::u32>(out, static_cast<magix::u32>(entry_table_size));
+    for (magix::u32 directive :
+         {code.stack_size, code.fork_size, code.shared_size, code.obj_count, code.obj_fork_count, code.obj_shared_count})
+    {
+        put_le<magix::u32>(out, directive);
+    }
+    out.resize(bytecode_file_header_size);
+
+    out.insert(out.end(), code.code.begin(), code.code.end());
+
+    for (auto [name, address] : code.entry_points)
+    {
+        put_le<magix::u16>(out, address);
+        put_le<magix::u16>(out, static_cast<magix::u16>(name.length()));
+        const char32_t *characters = name.ptr();
+        for (int64_t index = 0; index < name.length(); ++index)
+        {
+            put_le<magix::u32>(out, static_cast<magix::u32>(characters[index]));
+        }
+    }
+    return out;
+}
+
+auto
+magix::compile::read_bytecode_header(
+    magix::span<const std::byte> header, size_t file_size, ByteCodeRaw &code, BytecodeFileLayout &layout
+) -> BytecodeFileError
+{
+    if (header.size() < bytecode_file_header_size || !std::equal(bytecode_file_magic.begin(), bytecode_file_magic.end(), header.begin()))
+    {
+        return BytecodeFileError::NOT_BYTECODE;
+    }
+    if (get_le<magix::u32>(header, 4) != bytecode_file_version)
+    {
+        return BytecodeFileError::OTHER_FORMAT_VERSION;
+    }
+    if (get_le<magix::u64>(header, 8) != isa_version())
+    {
+        return BytecodeFileError::OTHER_ISA;
+    }
+
+    const magix::u32 data_segment_size = get_le<magix::u32>(header, 16);
+    const magix::u32 code_segment_size = get_le<magix::u32>(header, 20);
+    layout.rom_size = size_t{data_segment_size} + code_segment_size;
+    layout.entry_count = get_le<magix::u32>(header, 24);
+    layout.entry_table_size = get_le<magix::u32>(header, 28);
+    if (layout.rom_size > byte_code_size || layout.entry_table_size < layout.entry_count * entry_header_size ||
+        bytecode_file_header_size + layout.rom_size + layout.entry_table_size != file_size)
+    {
+        return BytecodeFileError::CORRUPT;
+    }
+
+    code.data_segment_size = data_segment_size;
+    code.code_segment_size = code_segment_size;
+    code.stack_size = get_le<magix::u32>(header, 32);
+    code.fork_size = get_le<magix::u32>(header, 36);
+    code.shared_size = get_le<magix::u32>(header, 40);
+    code.obj_count = get_le<magix::u32>(header, 44);
+    code.obj_fork_count = get_le<magix::u32>(header, 48);
+    code.obj_shared_count = get_le<magix::u32>(header, 52);
+    code.code.resize(layout.rom_size);
+    code.entry_points.clear();
+    return BytecodeFileError::OK;
+}
+
+auto
+magix::compile::read_bytecode_entries(magix::span<const std::byte> table, const BytecodeFileLayout &layout, ByteCodeRaw &code)
+    -> BytecodeFileError
+{
+    if (table.size() != layout.entry_table_size)
+    {
+        return BytecodeFileError::CORRUPT;
+    }
+    size_t offset = 0;
+    for (size_t entry = 0; entry < layout.entry_count; ++entry)
+    {
+        if (table.size() - offset < entry_header_size)
+        {
+            return BytecodeFileError::CORRUPT;
+        }
+        const magix::u16 address = get_le<magix::u16>(table, offset);
+        const size_t name_length = get_le<magix::u16>(table, offset + 2);
+        offset += entry_header_size;
+        if (address < code.data_segment_size || address >= code.code.size() || table.size() - offset < name_length * sizeof(char32_t))
+        {
+            return BytecodeFileError::CORRUPT;
+        }
+
+        godot::String name;
+        if (name.resize(static_cast<int64_t>(name_length + 1)) != godot::Error::OK)
+        {
+            return BytecodeFileError::CORRUPT;
+        }
+        char32_t *characters = name.ptrw();
+        for (size_t index = 0; index < name_length; ++index)
+        {
+            characters[index] = static_cast<char32_t>(get_le<magix::u32>(table, offset));
+            offset += sizeof(char32_t);
+        }
+        characters[name_length] = 0;
+        code.entry_points[name] = address;
+    }
+    return offset == table.size() ? BytecodeFileError::OK : BytecodeFileError::CORRUPT;
+}
+
+auto
+magix::compile::read_bytecode_file(magix::span<const std::byte> file, ByteCodeRaw &code) -> BytecodeFileError
+{
+    BytecodeFileLayout layout;
+    BytecodeFileError error = read_bytecode_header(file, file.size(), code, layout);
+    if (error != BytecodeFileError::OK)
+    {
+        return error;
+    }
+    const size_t rom_end = bytecode_file_header_size + layout.rom_size;
+    std::copy(file.begin() + bytecode_file_header_size, file.begin() + rom_end, code.code.begin());
+    return read_bytecode_entries(file.subspan(rom_end, file.size()), layout, code);
+}
@@ -0,0 +1,95 @@
+#ifndef MAGIX_COMPILATION_BYTECODE_FILE_HPP_
+#define MAGIX_COMPILATION_BYTECODE_FILE_HPP_
+
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/span.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace magix::compile
+{
+
+/** Layout of a precompiled .mxbc file, all little endian:
+ * - the header, bytecode_file_header_size bytes: "MXBC", u32 format version, u64 ISA version, u32 data segment size, u32 code
+ *   segment size, u32 entry count, u32 entry table size, the six u32 size directives, zero padding
+ * - the ROM, data segment then code segment, exactly as ByteCodeRaw::code. It starts 64 byte aligned, so it can be read, or
+ *   mapped, straight into place.
+ * - the entry table, per entry u16 address, u16 name length and the name as u32 characters
+ */
+constexpr magix::u32 bytecode_file_version = 1;
+constexpr size_t bytecode_file_header_size = 64;
+
+enum class BytecodeFileError
+{
+    OK,
+    /** Not a .mxbc file at all. */
+    NOT_BYTECODE,
+    /** Written by a build with another file format. */
+    OTHER_FORMAT_VERSION,
+    /** Assembled for another instruction set, the code would mean something else. */
+    OTHER_ISA,
+    /** Sizes out of bounds or not matching the file. */
+    CORRUPT,
+};
+
+constexpr inline auto
+enum_name(BytecodeFileError error) -> const char *
+{
+    switch (error)
+    {
+    case BytecodeFileError::OK:
+    {
+        return "OK";
+    }
+    case BytecodeFileError::NOT_BYTECODE:
+    {
+        return "NOT_BYTECODE";
+    }
+    case BytecodeFileError::OTHER_FORMAT_VERSION:
+    {
+        return "OTHER_FORMAT_VERSION";
+    }
+    case BytecodeFileError::OTHER_ISA:
+    {
+        return "OTHER_ISA";
+    }
+    case BytecodeFileError::CORRUPT:
+    {
+        return "CORRUPT";
+    }
+    }
+    return "";
+}
+
+/** What follows the header, as far as it can be known from it. */
+struct BytecodeFileLayout
+{
+    size_t rom_size = 0;
+    size_t entry_count = 0;
+    size_t entry_table_size = 0;
+};
+
+/** The whole file for the program. */
+[[nodiscard]] auto
+write_bytecode_file(const ByteCodeRaw &code) -> std::vector<std::byte>;
+
+/** Check the header of a file of the given size and take over its segment sizes and size directives. code.code is sized to the
+ * ROM, for the caller to read the ROM into.
+ */
+[[nodiscard]] auto
+read_bytecode_header(magix::span<const std::byte> header, size_t file_size, ByteCodeRaw &code, BytecodeFileLayout &layout)
+    -> BytecodeFileError;
+
+/** Fill the entry points from the entry table, checking every address against the ROM. */
+[[nodiscard]] auto
+read_bytecode_entries(magix::span<const std::byte> table, const BytecodeFileLayout &layout, ByteCodeRaw &code) -> BytecodeFileError;
+
+/** The program of a whole file in memory. */
+[[nodiscard]] auto
+read_bytecode_file(magix::span<const std::byte> file, ByteCodeRaw &code) -> BytecodeFileError;
+
+} // namespace magix::compile
+
+#endif // MAGIX_COMPILATION_BYTECODE_FILE_HPP_
@@ -3,17 +3,23 @@
 
 #include "godot_cpp/templates/rb_map.hpp"
 
+#include "magix_vm/allocators.hpp"
 #include "magix_vm/compilation/config.hpp"
 #include "magix_vm/types.hpp"
 
 #include <cstddef>
+#include <vector>
 
 namespace magix::compile
 {
 
 struct ByteCodeRaw
 {
-    alignas(64) std::byte code[byte_code_size] = {};
+    /** The data segment, then the code segment, exactly as long as both. Addresses are offsets into it. */
+    std::vector<std::byte, AlignedAllocator<std::byte, 64>> code;
+    /** Segment lengths, the data segment starts at 0 and the code segment right after it. */
+    magix::u32 data_segment_size = 0;
+    magix::u32 code_segment_size = 0;
     godot::RBMap<godot::String, magix::u16> entry_points;
 
     magix::u32 stack_size;
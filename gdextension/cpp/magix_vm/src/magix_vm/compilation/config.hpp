@@ -10,6 +10,7 @@
 namespace magix::compile
 {
 
+/** Largest a program, data and code segment together, may be. */
 constexpr size_t byte_code_size = 65536;
 // addressable with immediates ...
 // until i do some longjump shenanigans
@@ -44,8 +44,59 @@ struct InstructionRegisterSpec
     Mode mode = Mode::UNUSED;
     Type type = Type::UNDEFINED;
     SrcView name;
+    /** Register holds an address into the code segment, ie. a jump or yield target. */
+    bool is_code_address = false;
+    /** Local is loaded before the action, and bounds checked. */
+    bool is_read = false;
+    /** Local is stored after the action, and bounds checked. */
+    bool is_written = false;
+    /** Local spans as many bytes as the immediate at this register index holds, -1 if its size is its type's. */
+    magix::i8 bytes_register = -1;
+    /** Code word the register is encoded in, the opcode is word 0. Superinstructions keep the opcode word of every part. */
+    magix::u8 word = 0;
 };
 
+/** Size and alignment of a register type, 0 if it has none. */
+[[nodiscard]] constexpr auto
+type_size(InstructionRegisterSpec::Type type) noexcept -> size_t
+{
+    using Type = InstructionRegisterSpec::Type;
+    switch (type)
+    {
+    case Type::U8:
+    case Type::I8:
+    case Type::B8:
+    {
+        return 1;
+    }
+    case Type::U16:
+    case Type::I16:
+    case Type::B16:
+    {
+        return 2;
+    }
+    case Type::U32:
+    case Type::I32:
+    case Type::B32:
+    case Type::F32:
+    {
+        return 4;
+    }
+    case Type::U64:
+    case Type::I64:
+    case Type::B64:
+    case Type::F64:
+    {
+        return 8;
+    }
+    case Type::UNDEFINED:
+    {
+        return 0;
+    }
+    }
+    return 0;
+}
+
 /** Specify how registers are remapped when resolving pseudoinstructions. */
 struct InstructionRegisterRemap
 {
@@ -73,15 +124,36 @@ struct PseudoInstructionTranslation
     InstructionRegisterRemap remaps[MAX_REGISTERS_PER_INSTRUCTION];
 };
 
+/** How an instruction changes the stack pointer. */
+enum class StackPointerEffect
+{
+    NONE,
+    /** Moved by the immediate in the first register. */
+    OFFSET,
+    /** Set to a value only known at runtime. */
+    SET,
+};
+
 /** Full data for every instruction. */
 struct InstructionSpec
 {
     SrcView mnenomic;
     bool is_pseudo;
+    /** Control never falls through to the next instruction. */
+    bool is_terminator;
+    /** Execution resumes at the code address register in a later invocation. */
+    bool is_yield;
+    /** Calls back into Godot, so only the main thread may run it. */
+    bool is_host_call;
+    StackPointerEffect stack_pointer_effect;
     code_word opcode;
     InstructionRegisterSpec registers[MAX_REGISTERS_PER_INSTRUCTION];
     /** Pseudo instructions get replaced by this bad boi list. */
     ranges::subrange<const PseudoInstructionTranslation *> pseudo_translations;
+    /** Superinstructions execute these opcodes in order, with the registers of all of them concatenated. Empty otherwise.
+     * They are encoded like the parts, with the first opcode replaced.
+     */
+    span<const code_word> fused_sequence;
 
     [[nodiscard]] constexpr auto
     arg_count() const -> size_t
@@ -96,16 +168,38 @@ struct InstructionSpec
         }
         return argcount;
     }
+
+    /** Steps the instruction is charged, every part of a superinstruction is one. */
+    [[nodiscard]] constexpr auto
+    step_count() const -> size_t
+    {
+        return fused_sequence.size() != 0 ? fused_sequence.size() : 1;
+    }
+
+    /** Length of the encoded instruction, one opcode per step and the registers. */
+    [[nodiscard]] constexpr auto
+    code_words() const -> size_t
+    {
+        return step_count() + arg_count();
+    }
 };
 
 /** Given instruction name get spec, if it exists, else nullptr */
 [[nodiscard]] auto
 get_instruction_spec(SrcView instruction_name) -> const InstructionSpec *;
 
+/** Given an opcode get the spec of the instruction it encodes, if it exists, else nullptr */
+[[nodiscard]] auto
+get_instruction_spec(code_word opcode) -> const InstructionSpec *;
+
 /** All instructions, in definition order. */
 [[nodiscard]] auto
 all_instruction_specs() noexcept -> span<const InstructionSpec>;
 
+/** Hash of the whole ISA, bytecode assembled for one version means nothing to another. */
+[[nodiscard]] auto
+isa_version() noexcept -> magix::u64;
+
 } // namespace magix::compile
 
 #endif // MAGIX_COMPILATION_INSTRUCTION_DATA_HPP_
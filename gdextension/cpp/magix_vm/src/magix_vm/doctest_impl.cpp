@@ -71,7 +71,7 @@ class Stream2Godot : public std::streambuf
 } // namespace
 
 auto
-magix_run_doctest() -> int
+magix_run_doctest(bool benchmarks) -> int
 {
     // straight up copied from the examples
     doctest::Context context;
@@ -86,6 +86,13 @@ magix_run_doctest() -> int
 
     context.applyCommandLine(0, nullptr);
 
+    if (benchmarks)
+    {
+        // benchmarks are skipped by default, only run them
+        context.setOption("no-skip", true);
+        context.addFilter("test-suite", "benchmark/*");
+    }
+
     int res = context.run(); // run
 
     if (context.shouldExit()) // important - query flags (and --exit) rely on the user doing this
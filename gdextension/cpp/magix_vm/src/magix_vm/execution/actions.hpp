@@ -0,0 +1,116 @@
+#ifndef MAGIX_EXECUTION_ACTIONS_HPP_
+#define MAGIX_EXECUTION_ACTIONS_HPP_
+
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <cstring>
+
+// Everything the instruction actions of magix_isa.toml can use, besides what the generated code puts in scope.
+
+namespace magix::execute
+{
+
+template <class T>
+inline void
+memload(T &out, const std::byte *address) noexcept
+{
+    std::memcpy(&out, address, sizeof(T));
+}
+
+template <class T>
+[[nodiscard]] inline auto
+memload(const std::byte *address) noexcept -> T
+{
+    T out;
+    memload(out, address);
+    return out;
+}
+
+template <class T>
+inline void
+memstore(const T &out, std::byte *address) noexcept
+{
+    std::memcpy(address, &out, sizeof(out));
+}
+
+template <class T>
+[[nodiscard]] inline auto
+is_aligned(size_t in) noexcept -> bool
+{
+    return (in % magix::code_align_v<T>) == 0;
+}
+
+} // namespace magix::execute
+
+// User macros for the instruction actions, shared by the executors and the jit stencils.
+// They expect CODE, INSTRUCTION_POINTER, OBJECT_COUNT, PAGES and TRACK_STACK_WRITES in scope.
+#define CHECKED_ROM_READ(_type, _dst, _addr)                                                                                               \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        if (_addr + magix::code_size_v<magix::_type> > CODE.size())                                                                       \
+        {                                                                                                                                  \
+            return ExecResult{                                                                                                             \
+                static_cast<magix::u16>(INSTRUCTION_POINTER),                                                                              \
+                ExecResult::Type::TRAP_MEM_ACCESS_USER,                                                                                    \
+            };                                                                                                                             \
+        }                                                                                                                                  \
+        if (_addr % magix::code_align_v<magix::_type> != 0)                                                                                \
+        {                                                                                                                                  \
+            return ExecResult{                                                                                                             \
+                static_cast<magix::u16>(INSTRUCTION_POINTER),                                                                              \
+                ExecResult::Type::TRAP_MEM_ACCESS_USER,                                                                                    \
+            };                                                                                                                             \
+        }                                                                                                                                  \
+        memload(_dst, &CODE[_addr]);                                                                                                       \
+    } while (false)
+
+#define CHECK_OBJ_SLOT(_slot)                                                                                                              \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        if (_slot >= OBJECT_COUNT)                                                                                                         \
+        {                                                                                                                                  \
+            return ExecResult{                                                                                                             \
+                static_cast<magix::u16>(INSTRUCTION_POINTER),                                                                              \
+                ExecResult::Type::TRAP_MEM_ACCESS_USER,                                                                                    \
+            };                                                                                                                             \
+        }                                                                                                                                  \
+    } while (false)
+
+#define CLEAR_OBJ_SLOT(_slot)                                                                                                              \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+    } while (false)
+
+#define STORE_OBJ_SLOT(_slot, _value)                                                                                                      \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        PAGES.stack->mark_objbank_dirty(static_cast<size_t>(_slot) + 1);                                                                   \
+        OBJECTS[_slot] = _value;                                                                                                           \
+    } while (false)
+
+// The stack is written up to the byte offset _end. Tracked where stack registers are checked, so clearing the stack costs only
+// what was used, the other executors mark the verified stack size for the whole entry.
+#define STACK_WRITTEN(_end)                                                                                                                \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        if constexpr (TRACK_STACK_WRITES)                                                                                                  \
+        {                                                                                                                                  \
+            PAGES.stack->mark_stack_dirty(_end);                                                                                           \
+        }                                                                                                                                  \
+    } while (false)
+
+#define TRAP_IF(_cond, _trap)                                                                                                              \
+    do                                                                                                                                     \
+    {                                                                                                                                      \
+        if (_cond)                                                                                                                         \
+        {                                                                                                                                  \
+            return ExecResult{                                                                                                             \
+                static_cast<magix::u16>(INSTRUCTION_POINTER),                                                                              \
+                ExecResult::Type::_trap,                                                                                                   \
+            };                                                                                                                             \
+        }                                                                                                                                  \
+    } while (false)
+
+#endif // MAGIX_EXECUTION_ACTIONS_HPP_
@@ -11,6 +11,9 @@ using object_id_type = uint64_t;
 
 constexpr size_t stack_size_default = 65536;
 constexpr size_t objbank_size_default = 4096;
+/** Smallest size classes of pooled stacks, larger ones double up to the defaults. */
+constexpr size_t stack_size_class_min = 1024;
+constexpr size_t objbank_size_class_min = 16;
 
 /** Limit caster-slot memory usage to 256KiB. Slots are independent. This way there is no runaway OOM scenario. */
 constexpr size_t memory_per_caster_max = 1024 * 256;
@@ -21,6 +24,21 @@ constexpr size_t memory_assumed_instance_overhead = 64;
 
 constexpr float maintenance_cost = 1.0 / 60.0;
 
+/** Bytes of fork memory an instance arena allocates at once, or a single block if that is larger. */
+constexpr size_t instance_slab_size = 16384;
+
+/** Instances at the same entry it takes to run them in lockstep, fewer run one after another. */
+constexpr size_t lockstep_min_instances = 4;
+
+/** Instances of one user a worker runs at a time, if they may run on several threads. A multiple of the lockstep lanes. */
+constexpr size_t instance_chunk_size = 64;
+
+/** Bytes of fork memory a host_request reads its arguments from and gets its results written to. */
+constexpr size_t host_request_record_size = 64;
+
+/** Floats render.push appends per item, a 3x4 transform by rows and an rgba color. */
+constexpr size_t render_item_floats = 16;
+
 } // namespace magix::execute
 
 #endif // MAGIX_EXECUTION_CONFIG_HPP_
@@ -0,0 +1,83 @@
+#ifndef MAGIX_EXECUTION_DECODED_HPP_
+#define MAGIX_EXECUTION_DECODED_HPP_
+
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace magix::execute
+{
+
+/** Operand slots per decoded instruction. The generated executor asserts every instruction fits. */
+constexpr size_t decoded_operand_count = 6;
+
+/** One instruction of the code segment, with everything that only depends on the ROM already resolved.
+ * Control falls through to the next record in the stream.
+ */
+struct DecodedInstruction
+{
+    /** Opcode of the instruction, or invalid_opcode if executing this traps. */
+    magix::code_word op_code;
+    /** Byte address in the code segment, as reported by traps and yields. */
+    magix::u16 instruction_pointer;
+    /** Steps from this one up to and including the next one that can jump, yield, exit or traps by decoding, one per instruction
+     * and per part of a superinstruction. Entering the stream here can charge them all at once, nothing in between leaves the block.
+     */
+    magix::u32 block_steps;
+    /** Per register, in spec order:
+     * - locals: stack offset, sign extended
+     * - immediates: value converted to register type
+     * - code addresses: stream index of the target
+     * If this traps, the first operand holds the ExecResult::Type.
+     */
+    magix::i32 operands[decoded_operand_count];
+};
+
+/** Instruction stream of a program, decoded once and shared by all executions. */
+struct DecodedByteCode
+{
+    /** Program the stream was decoded from. Still needed for ROM reads. */
+    const compile::ByteCodeRaw *raw = nullptr;
+    /** Sorted by instruction pointer. Empty if the program could not be laid out linearly. */
+    std::vector<DecodedInstruction> instructions;
+    /** (instruction pointer, stream index) of every decoded instruction, sorted by instruction pointer. */
+    std::vector<std::pair<magix::u16, magix::u32>> lookup;
+    /** Whether the program may call back into Godot, then it only runs on the main thread. Set if it could not be decoded. */
+    bool calls_host = false;
+
+    /** Entries verify() proved safe, sorted. Empty if it could not. */
+    std::vector<magix::u16> verified_entries;
+    /** Stack bytes the verified entries access at most. */
+    size_t verified_stack_size = 0;
+
+    /** Stream index of the instruction at the given byte address, if it was decoded. */
+    [[nodiscard]] auto
+    find(magix::u16 instruction_pointer) const -> std::optional<magix::u32>;
+
+    /** Whether the entry can run without stack checks, on a stack of the given size. */
+    [[nodiscard]] auto
+    is_verified(magix::u16 entry, size_t stack_size) const -> bool;
+};
+
+/** Decode every instruction reachable from the entry points. Code addresses are all immediates, so this finds every reachable
+ * instruction, including those only reached through yields. Also counts the block_steps of every instruction.
+ * Jumps into the middle of another instruction can't be laid out linearly. Such programs decode to nothing and run on the raw
+ * executor.
+ */
+[[nodiscard]] auto
+decode(const compile::ByteCodeRaw &code) -> DecodedByteCode;
+
+/** Prove that every stack register access of the program is in bounds and aligned, by tracking the stack pointer from the entries
+ * and yield targets. On success fills in the verified fields. Programs that set the stack pointer to a runtime value and then
+ * access the stack, or where it differs between paths, are not verified and keep running checked.
+ */
+void
+verify(DecodedByteCode &program);
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_DECODED_HPP_
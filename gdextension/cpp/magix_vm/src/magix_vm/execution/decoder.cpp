@@ -0,0 +1,228 @@
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/types.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+
+namespace
+{
+
+auto
+load_word(const magix::compile::ByteCodeRaw &code, size_t address) -> magix::u16
+{
+    magix::u16 word;
+    std::memcpy(&word, &code.code[address], sizeof(word));
+    return word;
+}
+
+/** Same checks, in the same order, as the executor does when fetching. */
+auto
+fetch(const magix::compile::ByteCodeRaw &code, size_t instruction_pointer)
+    -> std::variant<const magix::compile::InstructionSpec *, magix::execute::ExecResult::Type>
+{
+    if (instruction_pointer + magix::code_size_v<magix::code_word> > code.code.size())
+    {
+        return magix::execute::ExecResult::Type::TRAP_MEM_ACCESS_IP;
+    }
+    if (instruction_pointer % magix::code_align_v<magix::code_word> != 0)
+    {
+        return magix::execute::ExecResult::Type::TRAP_MISALIGNED_IP;
+    }
+
+    const magix::compile::InstructionSpec *spec = magix::compile::get_instruction_spec(load_word(code, instruction_pointer));
+    if (spec == nullptr || spec->is_pseudo)
+    {
+        return magix::execute::ExecResult::Type::TRAP_INVALID_INSTRUCTION;
+    }
+    if (instruction_pointer + spec->code_words() * magix::code_size_v<magix::code_word> > code.code.size())
+    {
+        return magix::execute::ExecResult::Type::TRAP_MEM_ACCESS_IP;
+    }
+    return spec;
+}
+
+auto
+operand_address(size_t instruction_pointer, const magix::compile::InstructionRegisterSpec &reg) -> size_t
+{
+    return instruction_pointer + reg.word * magix::code_size_v<magix::code_word>;
+}
+
+auto
+next_address(size_t instruction_pointer, const magix::compile::InstructionSpec &spec) -> size_t
+{
+    return instruction_pointer + spec.code_words() * magix::code_size_v<magix::code_word>;
+}
+
+/** Every address control can reach from the entry points, byte addresses may be one past the ROM. */
+auto
+find_reachable(const magix::compile::ByteCodeRaw &code) -> std::vector<size_t>
+{
+    std::unordered_set<size_t> seen;
+    std::vector<size_t> worklist;
+    auto visit = [&](size_t instruction_pointer) {
+        if (seen.insert(instruction_pointer).second)
+        {
+            worklist.push_back(instruction_pointer);
+        }
+    };
+
+    for (auto [name, entry] : code.entry_points)
+    {
+        visit(entry);
+    }
+    while (!worklist.empty())
+    {
+        const size_t instruction_pointer = worklist.back();
+        worklist.pop_back();
+
+        auto fetched = fetch(code, instruction_pointer);
+        if (!std::holds_alternative<const magix::compile::InstructionSpec *>(fetched))
+        {
+            continue;
+        }
+        const magix::compile::InstructionSpec &spec = *std::get<const magix::compile::InstructionSpec *>(fetched);
+        for (auto reg_index : magix::ranges::num_range(spec.arg_count()))
+        {
+            if (spec.registers[reg_index].is_code_address)
+            {
+                visit(load_word(code, operand_address(instruction_pointer, spec.registers[reg_index])));
+            }
+        }
+        if (!spec.is_terminator)
+        {
+            visit(next_address(instruction_pointer, spec));
+        }
+    }
+
+    std::vector<size_t> reachable{seen.begin(), seen.end()};
+    std::sort(reachable.begin(), reachable.end());
+    return reachable;
+}
+
+/** Whether control can go anywhere but the next record after the instruction, trap records included. Must match the executor. */
+auto
+ends_block(const magix::compile::InstructionSpec *spec) -> bool
+{
+    if (spec == nullptr || spec->is_terminator)
+    {
+        return true;
+    }
+    for (auto reg_index : magix::ranges::num_range(spec->arg_count()))
+    {
+        if (spec->registers[reg_index].is_code_address)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+auto
+magix::execute::DecodedByteCode::find(magix::u16 instruction_pointer) const -> std::optional<magix::u32>
+{
+    auto it = std::lower_bound(lookup.begin(), lookup.end(), instruction_pointer, [](const auto &entry, magix::u16 search) {
+        return entry.first < search;
+    });
+    if (it == lookup.end() || it->first != instruction_pointer)
+    {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+auto
+magix::execute::decode(const compile::ByteCodeRaw &code) -> DecodedByteCode
+{
+    DecodedByteCode out;
+    out.raw = &code;
+
+    const std::vector<size_t> reachable = find_reachable(code);
+    std::unordered_map<size_t, magix::u32> index_of;
+    for (auto index : magix::ranges::num_range(reachable.size()))
+    {
+        index_of.emplace(reachable[index], static_cast<magix::u32>(index));
+    }
+
+    out.instructions.reserve(reachable.size());
+    for (auto index : magix::ranges::num_range(reachable.size()))
+    {
+        const size_t instruction_pointer = reachable[index];
+        DecodedInstruction decoded{};
+        decoded.instruction_pointer = static_cast<magix::u16>(instruction_pointer);
+
+        auto fetched = fetch(code, instruction_pointer);
+        if (auto *trap = std::get_if<ExecResult::Type>(&fetched))
+        {
+            decoded.op_code = magix::invalid_opcode;
+            decoded.operands[0] = static_cast<magix::i32>(*trap);
+            out.instructions.push_back(decoded);
+            continue;
+        }
+
+        const compile::InstructionSpec &spec = *std::get<const compile::InstructionSpec *>(fetched);
+        const size_t reg_count = spec.arg_count();
+        const size_t next_instruction = next_address(instruction_pointer, spec);
+        if (!spec.is_terminator && (index + 1 == reachable.size() || reachable[index + 1] != next_instruction))
+        {
+            // something jumps into the middle of this instruction, the fallthrough is not the next record
+            out.instructions.clear();
+            // the raw executor runs it instead, which may call anything
+            out.calls_host = true;
+            return out;
+        }
+
+        decoded.op_code = load_word(code, instruction_pointer);
+        out.calls_host = out.calls_host || spec.is_host_call;
+        for (auto reg_index : magix::ranges::num_range(reg_count))
+        {
+            const compile::InstructionRegisterSpec &reg = spec.registers[reg_index];
+            const magix::u16 word = load_word(code, operand_address(instruction_pointer, reg));
+
+            magix::i32 operand = word;
+            if (reg.mode == compile::InstructionRegisterSpec::Mode::LOCAL)
+            {
+                operand = magix::to_signed(word);
+            }
+            else if (reg.is_code_address)
+            {
+                operand = static_cast<magix::i32>(index_of.at(word));
+            }
+            else if (reg.type == compile::InstructionRegisterSpec::Type::I16)
+            {
+                operand = magix::to_signed(word);
+            }
+            decoded.operands[reg_index] = operand;
+        }
+        out.instructions.push_back(decoded);
+    }
+
+    // backwards, so every block knows the length of the rest of it, superinstructions count once per part
+    for (size_t index = out.instructions.size(); index-- > 0;)
+    {
+        DecodedInstruction &decoded = out.instructions[index];
+        const compile::InstructionSpec *spec = compile::get_instruction_spec(decoded.op_code);
+        const auto steps = static_cast<magix::u32>(spec != nullptr ? spec->step_count() : 1);
+        decoded.block_steps = ends_block(spec) ? steps : out.instructions[index + 1].block_steps + steps;
+    }
+
+    for (auto index : magix::ranges::num_range(reachable.size()))
+    {
+        // falling off the end of the ROM is never a valid entry, don't let it alias address 0
+        if (reachable[index] < code.code.size())
+        {
+            out.lookup.emplace_back(static_cast<magix::u16>(reachable[index]), static_cast<magix::u32>(index));
+        }
+    }
+
+    return out;
+}
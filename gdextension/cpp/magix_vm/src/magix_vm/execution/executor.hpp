@@ -1,14 +1,18 @@
 #ifndef MAGIX_EXECUTION_EXECUTOR_HPP_
 #define MAGIX_EXECUTION_EXECUTOR_HPP_
 
+#include "magix_vm/allocators.hpp"
 #include "magix_vm/compilation/compiled.hpp"
 #include "magix_vm/execution/config.hpp"
+#include "magix_vm/execution/decoded.hpp"
 #include "magix_vm/macros.hpp"
 #include "magix_vm/span.hpp"
 #include "magix_vm/types.hpp"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
+#include <optional>
 #include <type_traits>
 #include <vector>
 
@@ -136,17 +140,60 @@ struct ObjectVariant
 static_assert(std::is_trivially_constructible_v<ObjectVariant>);
 static_assert(std::is_trivially_destructible_v<ObjectVariant>);
 
-struct ExecStack
+/** Stack and object bank of an execution, in one cache line aligned allocation of the sizes a program asked for. */
+class ExecStack
 {
-    alignas(64) std::byte stack[stack_size_default];
-    alignas(64) ObjectVariant objbank[objbank_size_default];
+  public:
+    /** Zeroed stack of stack_size bytes and object bank of object_count slots. */
+    explicit ExecStack(size_t stack_size = stack_size_default, size_t object_count = objbank_size_default)
+        : memory(objbank_offset(stack_size) + object_count * sizeof(ObjectVariant), std::byte{})
+    {
+        stack = magix::span<std::byte>(memory.data(), stack_size);
+        objbank = magix::span<std::byte>(memory.data() + objbank_offset(stack_size), object_count * sizeof(ObjectVariant))
+                      .reinterpret_resize<ObjectVariant>();
+        static_assert(std::is_trivially_copyable_v<ObjectVariant>);
+    }
+
+    ExecStack(const ExecStack &) = delete;
+    auto
+    operator=(const ExecStack &) -> ExecStack & = delete;
+
+    magix::span<std::byte> stack;
+    magix::span<ObjectVariant> objbank;
+    /** Stack bytes and objbank slots that may have been written since the last clear(), from the start. */
+    size_t stack_dirty = 0;
+    size_t objbank_dirty = 0;
+
+    void
+    mark_stack_dirty(size_t bytes) noexcept
+    {
+        stack_dirty = std::max(stack_dirty, std::min(bytes, stack.size()));
+    }
+
+    void
+    mark_objbank_dirty(size_t slots) noexcept
+    {
+        objbank_dirty = std::max(objbank_dirty, std::min(slots, objbank.size()));
+    }
+
+    /** Zero what was marked dirty, so the next user sees nothing of the last. Costs only what the last user touched. */
     void
     clear()
     {
-        std::memset(stack, 0, sizeof(stack));
-        std::memset(objbank, 0, sizeof(objbank));
-        static_assert(std::is_trivially_copyable_v<ObjectVariant>);
+        std::memset(stack.data(), 0, stack_dirty);
+        std::memset(objbank.data(), 0, objbank_dirty * sizeof(ObjectVariant));
+        stack_dirty = 0;
+        objbank_dirty = 0;
     }
+
+  private:
+    [[nodiscard]] static constexpr auto
+    objbank_offset(size_t stack_size) noexcept -> size_t
+    {
+        return (stack_size + memory_granularity - 1) / memory_granularity * memory_granularity;
+    }
+
+    std::vector<std::byte, AlignedAllocator<std::byte, memory_granularity>> memory;
 };
 
 struct PageInfo
@@ -161,20 +208,62 @@ struct PageInfo
     // more later
 };
 
+/** Kinds of host_request the virtual machine handles natively, the others go to script. */
+enum class HostRequestKind : magix::u16
+{
+    /** In: from and to as 3 f32 each. Out at 24: u32 hit, position and normal as 3 f32 each, at 56: u64 collider id. */
+    RAYCAST = 0,
+};
+
+/** Made by host_request, handed over to the runner when the instance yields. */
+struct HostRequest
+{
+    magix::u16 kind;
+    /** Offset in the fork page of host_request_record_size bytes, the arguments going in and the results coming back. */
+    magix::u16 record;
+};
+
+/** Mana a caster reserved for one tick, allocate_mana draws from it without calling back into Godot. */
+struct ManaLedger
+{
+    magix::f32 reserved = 0.0f;
+    magix::f32 used = 0.0f;
+
+    /** All of the request or nothing, like MagixCaster::try_consume_mana(), but what is left stays. */
+    [[nodiscard]] constexpr auto
+    draw(magix::f32 requested) -> magix::f32
+    {
+        if (!(requested > 0.0f) || reserved - used < requested)
+        {
+            return 0.0f;
+        }
+        used += requested;
+        return requested;
+    }
+};
+
 struct ExecutionContext
 {
     PageInfo page_info{};
     object_id_type caster_id = 0;
     MagixCaster *caster_node = nullptr;
+    /** Set if the runner keeps a ledger for the caster. */
+    ManaLedger *mana_ledger = nullptr;
     magix::f32 bound_mana{};
+    /** Set by sleep_ticks, how many ticks the next yield waits before it resumes. */
+    magix::u32 sleep_ticks = 0;
+    /** Set by host_request, the last one before the yield counts. */
+    std::optional<HostRequest> host_request;
+    /** Appended to by render.push, the runner takes it after the run. */
+    std::vector<magix::f32> render_output;
 #ifdef MAGIX_BUILD_TESTS
     std::vector<PrimitiveUnion> test_output;
 #endif
 
     // NOLINTNEXTLINE(modernize-pass-by-value)
-    MAGIX_CONSTEXPR_NO_TEST("vector") ExecutionContext(const PageInfo &page_info) : page_info{page_info}
+    ExecutionContext(const PageInfo &page_info) : page_info{page_info}
     {}
-    MAGIX_CONSTEXPR_NO_TEST("vector") ExecutionContext(object_id_type caster_id, MagixCaster *caster_node) : caster_id{caster_id}, caster_node{caster_node} {}
+    ExecutionContext(object_id_type caster_id, MagixCaster *caster_node) : caster_id{caster_id}, caster_node{caster_node} {}
 };
 
 struct ExecResult
@@ -202,6 +291,49 @@ struct ExecResult
 [[nodiscard]] auto
 execute(const compile::ByteCodeRaw &code, magix::u16 entry, size_t steps, ExecutionContext &context) -> ExecResult;
 
+/** Same as above, but runs the pre-decoded instruction stream. Falls back to the raw code for entries that were not decoded. */
+[[nodiscard]] auto
+execute(const DecodedByteCode &program, magix::u16 entry, size_t steps, ExecutionContext &context) -> ExecResult;
+
+/** Run only the decoded instruction at the stream index, with the given stack pointer. For native backends that leave some
+ * instructions to the interpreter. Returns TRAP_TOO_MANY_STEPS if the instruction completed and execution goes on.
+ * Marks what it writes to the stack dirty, what ran natively the caller marks.
+ */
+[[nodiscard]] auto
+execute_instruction(const DecodedByteCode &program, magix::u32 index, size_t stack_pointer, ExecutionContext &context)
+    -> ExecResult;
+
+/** Go on with the decoded stream at the stream index, with the given stack pointer and steps left. For executors that ran the
+ * start of an entry on their own. Stack registers are checked and what they write is marked dirty, as in execute().
+ */
+[[nodiscard]] auto
+execute_from(const DecodedByteCode &program, magix::u32 index, size_t stack_pointer, size_t steps, ExecutionContext &context)
+    -> ExecResult;
+
+/** Name of the dispatch strategy the executor was built with, "threaded" or "switch". */
+[[nodiscard]] auto
+dispatch_mode() noexcept -> const char *;
+
+#ifdef MAGIX_BUILD_TESTS
+/** Dispatch strategies of the executor. Tests build all the compiler supports, so benchmarks can compare them in one build. */
+enum class Dispatch
+{
+    THREADED,
+    SWITCH,
+};
+
+/** If the executor was built with the dispatch strategy. */
+[[nodiscard]] auto
+has_dispatch(Dispatch dispatch) noexcept -> bool;
+
+/** Same as execute(), but with the given dispatch strategy instead of the configured one. It has to be built, see has_dispatch(). */
+[[nodiscard]] auto
+execute(Dispatch dispatch, const compile::ByteCodeRaw &code, magix::u16 entry, size_t steps, ExecutionContext &context) -> ExecResult;
+
+[[nodiscard]] auto
+execute(Dispatch dispatch, const DecodedByteCode &program, magix::u16 entry, size_t steps, ExecutionContext &context) -> ExecResult;
+#endif
+
 } // namespace magix::execute
 
 #ifdef MAGIX_BUILD_TESTS
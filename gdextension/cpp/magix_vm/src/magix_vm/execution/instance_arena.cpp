@@ -0,0 +1,52 @@
+#include "magix_vm/execution/instance_arena.hpp"
+#include "magix_vm/execution/config.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+magix::execute::InstanceArena::InstanceArena(size_t block_size)
+    : _block_size(block_size), blocks_per_slab(block_size == 0 ? 0 : std::max<size_t>(instance_slab_size / block_size, 1))
+{}
+
+auto
+magix::execute::InstanceArena::allocate() -> magix::span<std::byte>
+{
+    if (_block_size == 0)
+    {
+        return {};
+    }
+    if (free_blocks.empty())
+    {
+        Slab &slab = slabs.emplace_back(blocks_per_slab * _block_size);
+        // handed out front to back
+        for (size_t index = blocks_per_slab; index-- > 0;)
+        {
+            free_blocks.push_back(slab.data() + index * _block_size);
+        }
+    }
+    std::byte *block = free_blocks.back();
+    free_blocks.pop_back();
+    std::memset(block, 0, _block_size);
+    return {block, _block_size};
+}
+
+void
+magix::execute::InstanceArena::release(magix::span<std::byte> block)
+{
+    if (_block_size != 0)
+    {
+        free_blocks.push_back(block.data());
+    }
+}
+
+auto
+magix::execute::InstanceArena::block_size() const noexcept -> size_t
+{
+    return _block_size;
+}
+
+auto
+magix::execute::InstanceArena::capacity() const noexcept -> size_t
+{
+    return slabs.size() * blocks_per_slab;
+}
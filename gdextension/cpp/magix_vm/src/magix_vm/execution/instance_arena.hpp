@@ -0,0 +1,58 @@
+#ifndef MAGIX_EXECUTION_INSTANCE_ARENA_HPP_
+#define MAGIX_EXECUTION_INSTANCE_ARENA_HPP_
+
+#include "magix_vm/allocators.hpp"
+#include "magix_vm/execution/config.hpp"
+#include "magix_vm/span.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace magix::execute
+{
+
+/** Blocks of one size for the fork memory of instances, carved out of larger slabs. Released blocks are handed out again,
+ * slabs are only freed with the arena, so a user whose instances fork and die at a steady rate stops allocating.
+ */
+class InstanceArena
+{
+  public:
+    /** Blocks of the given size, a multiple of memory_granularity. 0 hands out empty blocks. */
+    explicit InstanceArena(size_t block_size = 0);
+
+    /** Handed out blocks point into the slabs, a copy would hand out blocks of the original. Moves keep them in place. */
+    InstanceArena(const InstanceArena &) = delete;
+    auto
+    operator=(const InstanceArena &) -> InstanceArena & = delete;
+    InstanceArena(InstanceArena &&) noexcept = default;
+    auto
+    operator=(InstanceArena &&) noexcept -> InstanceArena & = default;
+
+    /** A zeroed block, valid until released or the arena dies. */
+    [[nodiscard]] auto
+    allocate() -> magix::span<std::byte>;
+
+    /** Give back a block of this arena. */
+    void
+    release(magix::span<std::byte> block);
+
+    [[nodiscard]] auto
+    block_size() const noexcept -> size_t;
+
+    /** Blocks the slabs have room for, in use or not. */
+    [[nodiscard]] auto
+    capacity() const noexcept -> size_t;
+
+  private:
+    using Slab = std::vector<std::byte, AlignedAllocator<std::byte, memory_granularity>>;
+
+    size_t _block_size;
+    size_t blocks_per_slab;
+    /** Moving the slabs around keeps their memory in place. */
+    std::vector<Slab> slabs;
+    std::vector<std::byte *> free_blocks;
+};
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_INSTANCE_ARENA_HPP_
@@ -0,0 +1,1115 @@
+#include "magix_vm/execution/jit.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/config.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/stencils.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/types.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <vector>
+
+// Native code is only generated for the System V x86-64 ABI.
+// Everywhere else every program runs on the interpreter.
+#if defined(MAGIX_JIT) && MAGIX_JIT && defined(__x86_64__) && defined(__linux__)
+#define MAGIX_USE_JIT 1
+#include <sys/mman.h>
+#else
+#define MAGIX_USE_JIT 0
+#endif
+
+namespace
+{
+
+using magix::execute::ExecResult;
+using magix::execute::JitFrame;
+using magix::execute::pack_result;
+using magix::execute::Stencil;
+using magix::execute::StencilHole;
+using magix::execute::unpack_result;
+
+/** Signature of the prologue at the start of the code, it jumps to start. */
+using NativeEntry = magix::u32 (*)(JitFrame *frame, const std::byte *start);
+
+#if MAGIX_USE_JIT
+
+/** Called from native code for instructions without a native translation. */
+auto
+call_interpreter(JitFrame *frame, magix::u32 index, size_t stack_pointer) noexcept -> magix::u32
+{
+    const ExecResult result = magix::execute::execute_instruction(*frame->program, index, stack_pointer, *frame->context);
+    if (result.type == ExecResult::Type::TRAP_TOO_MANY_STEPS)
+    {
+        return 0;
+    }
+    return pack_result(result.type, result.instruction_pointer);
+}
+
+/** Called from native code when the steps run out inside a superinstruction, the interpreter runs its parts one at a time. */
+auto
+call_interpreter_out_of_steps(JitFrame *frame, magix::u32 index, size_t stack_pointer, size_t steps) noexcept -> magix::u32
+{
+    // the first part was already charged
+    const ExecResult result = magix::execute::execute_from(*frame->program, index, stack_pointer, steps + 1, *frame->context);
+    return pack_result(result.type, result.instruction_pointer);
+}
+
+enum Register : magix::u8
+{
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RSI = 6,
+    RDI = 7,
+    R12 = 12,
+    R13 = 13,
+    R14 = 14,
+    R15 = 15,
+};
+
+enum Condition : magix::u8
+{
+    BELOW = 0x2,
+    EQUAL = 0x4,
+    NOT_EQUAL = 0x5,
+    ABOVE = 0x7,
+};
+
+using Label = size_t;
+
+/** Appends x86-64 machine code. Jumps go to labels, which are patched in by link().
+ * Register use of the generated code:
+ * - r12: steps left
+ * - r13: stack base
+ * - r14: stack pointer
+ * - r15: JitFrame
+ */
+struct X64Emitter
+{
+    static constexpr size_t unbound = ~size_t{0};
+
+    /** Offset of a rel32, label it is relative to and the addend, which is -4 for jumps. */
+    struct Fixup
+    {
+        size_t offset;
+        Label label;
+        magix::i64 addend;
+    };
+
+    std::vector<magix::u8> code;
+    std::vector<size_t> label_offsets;
+    std::vector<Fixup> fixups;
+
+    auto
+    new_label() -> Label
+    {
+        label_offsets.push_back(unbound);
+        return label_offsets.size() - 1;
+    }
+
+    void
+    bind(Label label)
+    {
+        label_offsets[label] = code.size();
+    }
+
+    void
+    bytes(std::initializer_list<magix::u8> values)
+    {
+        code.insert(code.end(), values.begin(), values.end());
+    }
+
+    template <class T>
+    void
+    immediate(T value)
+    {
+        magix::u8 encoded[sizeof(T)];
+        std::memcpy(encoded, &value, sizeof(T));
+        code.insert(code.end(), std::begin(encoded), std::end(encoded));
+    }
+
+    void
+    rel32(Label label)
+    {
+        fixups.push_back(Fixup{code.size(), label, -4});
+        immediate<magix::i32>(0);
+    }
+
+    /** Patch every jump, fails if a label was never bound. */
+    auto
+    link() -> bool
+    {
+        for (const Fixup &fixup : fixups)
+        {
+            if (label_offsets[fixup.label] == unbound)
+            {
+                return false;
+            }
+            const auto target = static_cast<magix::i64>(label_offsets[fixup.label]);
+            const auto rel32 = static_cast<magix::i32>(target + fixup.addend - static_cast<magix::i64>(fixup.offset));
+            std::memcpy(&code[fixup.offset], &rel32, sizeof(rel32));
+        }
+        return true;
+    }
+
+    /** Pad with int3 up to the alignment. */
+    void
+    align(size_t alignment)
+    {
+        code.resize((code.size() + alignment - 1) / alignment * alignment, 0xCC);
+    }
+
+    /** Append a stencil and patch its holes. Fails if a value does not fit its hole.
+     * The relative holes are calls to the host, they go through veneers from veneer_for.
+     */
+    template <class ValueOf, class VeneerFor>
+    auto
+    stencil(const Stencil &stencil, ValueOf &&value_of, VeneerFor &&veneer_for) -> bool
+    {
+        const size_t base = code.size();
+        code.insert(code.end(), stencil.code.begin(), stencil.code.end());
+        for (const StencilHole &hole : stencil.holes)
+        {
+            const size_t offset = base + hole.offset;
+            if (hole.patch == StencilHole::Patch::RELATIVE_32)
+            {
+                fixups.push_back(Fixup{offset, veneer_for(hole.value), hole.addend});
+                continue;
+            }
+
+            const magix::i64 value = static_cast<magix::i64>(value_of(hole)) + hole.addend;
+            switch (hole.patch)
+            {
+            case StencilHole::Patch::ABSOLUTE_32:
+            {
+                if (value < 0 || value > INT64_C(0xFFFFFFFF))
+                {
+                    return false;
+                }
+                const auto patched = static_cast<magix::u32>(value);
+                std::memcpy(&code[offset], &patched, sizeof(patched));
+                break;
+            }
+            case StencilHole::Patch::ABSOLUTE_32_SIGNED:
+            {
+                if (value < INT32_MIN || value > INT32_MAX)
+                {
+                    return false;
+                }
+                const auto patched = static_cast<magix::i32>(value);
+                std::memcpy(&code[offset], &patched, sizeof(patched));
+                break;
+            }
+            case StencilHole::Patch::ABSOLUTE_64:
+            {
+                std::memcpy(&code[offset], &value, sizeof(value));
+                break;
+            }
+            case StencilHole::Patch::RELATIVE_32:
+            {
+                break;
+            }
+            }
+        }
+        return true;
+    }
+
+    /** jmp [rip], followed by the absolute address, reaches anywhere from the code. */
+    void
+    veneer(magix::u64 target)
+    {
+        bytes({0xFF, 0x25, 0x00, 0x00, 0x00, 0x00});
+        immediate(target);
+    }
+
+    /** opcode with operand [r13 + r14 + disp], ie. a stack register. */
+    void
+    stack_access(std::initializer_list<magix::u8> opcode, magix::u8 reg, magix::i32 disp, bool wide, bool operand16 = false)
+    {
+        if (operand16)
+        {
+            bytes({0x66});
+        }
+        // REX.X and REX.B for r14 and r13
+        bytes({static_cast<magix::u8>(0x43 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0))});
+        bytes(opcode);
+        // mod 10 (disp32), rm 100 (SIB); SIB scale 1, index r14, base r13
+        bytes({static_cast<magix::u8>(0x84 | ((reg & 7) << 3)), 0x35});
+        immediate(disp);
+    }
+
+    /** opcode with operand [r15 + disp], ie. a JitFrame field. */
+    void
+    frame_access(std::initializer_list<magix::u8> opcode, magix::u8 reg, magix::i32 disp)
+    {
+        bytes({static_cast<magix::u8>(0x49 | ((reg & 8) ? 0x04 : 0))});
+        bytes(opcode);
+        bytes({static_cast<magix::u8>(0x87 | ((reg & 7) << 3))});
+        immediate(disp);
+    }
+
+    /** Zero extending load of a stack register into rax. */
+    void
+    load_stack(size_t size, magix::i32 disp)
+    {
+        switch (size)
+        {
+        case 1:
+        {
+            stack_access({0x0F, 0xB6}, RAX, disp, false);
+            break;
+        }
+        case 2:
+        {
+            stack_access({0x0F, 0xB7}, RAX, disp, false);
+            break;
+        }
+        case 4:
+        {
+            stack_access({0x8B}, RAX, disp, false);
+            break;
+        }
+        default:
+        {
+            stack_access({0x8B}, RAX, disp, true);
+            break;
+        }
+        }
+    }
+
+    /** Store the low bytes of rax to a stack register. */
+    void
+    store_stack(size_t size, magix::i32 disp)
+    {
+        switch (size)
+        {
+        case 1:
+        {
+            stack_access({0x88}, RAX, disp, false);
+            break;
+        }
+        case 2:
+        {
+            stack_access({0x89}, RAX, disp, false, true);
+            break;
+        }
+        case 4:
+        {
+            stack_access({0x89}, RAX, disp, false);
+            break;
+        }
+        default:
+        {
+            stack_access({0x89}, RAX, disp, true);
+            break;
+        }
+        }
+    }
+
+    void
+    store_stack_immediate(size_t size, magix::i32 disp, magix::u64 value)
+    {
+        switch (size)
+        {
+        case 1:
+        {
+            stack_access({0xC6}, 0, disp, false);
+            immediate(static_cast<magix::u8>(value));
+            break;
+        }
+        case 2:
+        {
+            stack_access({0xC7}, 0, disp, false, true);
+            immediate(static_cast<magix::u16>(value));
+            break;
+        }
+        case 4:
+        {
+            stack_access({0xC7}, 0, disp, false);
+            immediate(static_cast<magix::u32>(value));
+            break;
+        }
+        default:
+        {
+            const auto low = static_cast<magix::i32>(static_cast<magix::u32>(value));
+            if (static_cast<magix::u64>(static_cast<magix::i64>(low)) == value)
+            {
+                // fits a sign extended imm32
+                stack_access({0xC7}, 0, disp, true);
+                immediate(low);
+                break;
+            }
+            move_immediate64(RAX, value);
+            store_stack(8, disp);
+            break;
+        }
+        }
+    }
+
+    /** 32 bit compare of a stack register with 0. */
+    void
+    compare_stack_zero(magix::i32 disp)
+    {
+        stack_access({0x83}, 7, disp, false);
+        immediate<magix::u8>(0);
+    }
+
+    /** eax = eax op stack register, op is 0x03 for add or 0x2B for sub. */
+    void
+    arithmetic_stack(magix::u8 op, magix::i32 disp)
+    {
+        stack_access({op}, RAX, disp, false);
+    }
+
+    /** eax = eax op imm32, op is 0x05 for add or 0x2D for sub. */
+    void
+    arithmetic_immediate(magix::u8 op, magix::u32 value)
+    {
+        bytes({op});
+        immediate(value);
+    }
+
+    /** reg = r14 + disp */
+    void
+    lea_stack_pointer(magix::u8 reg, magix::i32 disp, bool wide)
+    {
+        bytes({static_cast<magix::u8>(0x41 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0)), 0x8D});
+        bytes({static_cast<magix::u8>(0x86 | ((reg & 7) << 3))});
+        immediate(disp);
+    }
+
+    /** reg = address of a stack register */
+    void
+    lea_stack(magix::u8 reg, magix::i32 disp)
+    {
+        stack_access({0x8D}, reg, disp, true);
+    }
+
+    void
+    add_stack_pointer(magix::i32 value)
+    {
+        bytes({0x49, 0x81, 0xC6});
+        immediate(value);
+    }
+
+    /** r14d = stack register, zero extends */
+    void
+    load_stack_pointer(magix::i32 disp)
+    {
+        stack_access({0x8B}, R14, disp, false);
+    }
+
+    /** stack register = r14d */
+    void
+    store_stack_pointer(magix::i32 disp)
+    {
+        stack_access({0x89}, R14, disp, false);
+    }
+
+    void
+    load_frame(magix::u8 reg, magix::i32 disp)
+    {
+        frame_access({0x8B}, reg, disp);
+    }
+
+    /** 64 bit compare of rax with a frame field */
+    void
+    compare_rax_frame(magix::i32 disp)
+    {
+        frame_access({0x3B}, RAX, disp);
+    }
+
+    /** 64 bit compare of a frame field with a sign extended imm32 */
+    void
+    compare_frame_immediate(magix::i32 disp, magix::i32 value)
+    {
+        frame_access({0x81}, 7, disp);
+        immediate(value);
+    }
+
+    /** 64 bit reg += imm32, for registers below r8 */
+    void
+    add_immediate(magix::u8 reg, magix::i32 value)
+    {
+        bytes({0x48, 0x81, static_cast<magix::u8>(0xC0 | reg)});
+        immediate(value);
+    }
+
+    /** reg = imm32, zero extends, for registers below r8 */
+    void
+    move_immediate32(magix::u8 reg, magix::u32 value)
+    {
+        bytes({static_cast<magix::u8>(0xB8 | reg)});
+        immediate(value);
+    }
+
+    /** reg = imm64, for registers below r8 */
+    void
+    move_immediate64(magix::u8 reg, magix::u64 value)
+    {
+        bytes({0x48, static_cast<magix::u8>(0xB8 | reg)});
+        immediate(value);
+    }
+
+    /** 64 bit dst = src */
+    void
+    move(magix::u8 dst, magix::u8 src)
+    {
+        bytes({static_cast<magix::u8>(0x48 | ((src & 8) ? 0x04 : 0) | ((dst & 8) ? 0x01 : 0)), 0x89});
+        bytes({static_cast<magix::u8>(0xC0 | ((src & 7) << 3) | (dst & 7))});
+    }
+
+    /** memcpy(rdi, rsi, rcx) */
+    void
+    copy_bytes()
+    {
+        bytes({0xF3, 0xA4});
+    }
+
+    /** r12 -= 1, sets the carry flag if it was 0 */
+    void
+    count_step()
+    {
+        bytes({0x49, 0x83, 0xEC, 0x01});
+    }
+
+    /** r12 -= steps */
+    void
+    count_steps(magix::u8 steps)
+    {
+        bytes({0x49, 0x83, 0xEC, steps});
+    }
+
+    /** Sets the carry flag if r12 < steps. */
+    void
+    compare_steps(magix::u8 steps)
+    {
+        bytes({0x49, 0x83, 0xFC, steps});
+    }
+
+    void
+    call_rax()
+    {
+        bytes({0xFF, 0xD0});
+    }
+
+    void
+    call(Label label)
+    {
+        bytes({0xE8});
+        rel32(label);
+    }
+
+    void
+    test_eax()
+    {
+        bytes({0x85, 0xC0});
+    }
+
+    void
+    jump(Label label)
+    {
+        bytes({0xE9});
+        rel32(label);
+    }
+
+    void
+    jump_if(Condition condition, Label label)
+    {
+        bytes({0x0F, static_cast<magix::u8>(0x80 | condition)});
+        rel32(label);
+    }
+
+    /** Enter with (JitFrame *, const std::byte *start), saves the callee saved registers and jumps to start. */
+    void
+    prologue()
+    {
+        // push rbp, mov rbp, rsp, push r12-r15. Keeps the stack 16 byte aligned for calls.
+        bytes({0x55, 0x48, 0x89, 0xE5, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});
+        move(R15, RDI);
+        load_frame(R13, offsetof(JitFrame, stack));
+        load_frame(R12, offsetof(JitFrame, steps));
+        // xor r14d, r14d, jmp rsi
+        bytes({0x45, 0x31, 0xF6, 0xFF, 0xE6});
+    }
+
+    /** Leave with the packed result in eax. */
+    void
+    epilogue()
+    {
+        // mov [r15 + steps], r12
+        frame_access({0x89}, R12, offsetof(JitFrame, steps));
+        // pop r15-r12, pop rbp, ret
+        bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0xC3});
+    }
+};
+
+/** Instructions with a native translation. */
+enum class NativeKind
+{
+    NONE,
+    NOP,
+    YIELD,
+    EXIT,
+    GOTO,
+    IF_ZERO,
+    MOVE,
+    ROM_LOAD,
+    FORK_LOAD,
+    FORK_STORE,
+    SHARED_LOAD,
+    SHARED_STORE,
+    SET,
+    ADDRESS_OF,
+    STACK_RESIZE,
+    SET_STACK,
+    GET_STACK,
+    ADD,
+    ADD_IMMEDIATE,
+    SUB,
+    SUB_IMMEDIATE,
+};
+
+struct NativeForm
+{
+    magix::compile::SrcView mnenomic;
+    NativeKind kind;
+};
+
+constexpr NativeForm native_forms[] = {
+    {U"nop", NativeKind::NOP},
+    {U"yield_to", NativeKind::YIELD},
+    {U"exit", NativeKind::EXIT},
+    {U"goto", NativeKind::GOTO},
+    {U"if.zero", NativeKind::IF_ZERO},
+    {U"mov.b8", NativeKind::MOVE},
+    {U"mov.b16", NativeKind::MOVE},
+    {U"mov.b32", NativeKind::MOVE},
+    {U"mov.b64", NativeKind::MOVE},
+    {U"load.b8", NativeKind::ROM_LOAD},
+    {U"load.b16", NativeKind::ROM_LOAD},
+    {U"load.b32", NativeKind::ROM_LOAD},
+    {U"load.b64", NativeKind::ROM_LOAD},
+    {U"fork.load", NativeKind::FORK_LOAD},
+    {U"fork.store", NativeKind::FORK_STORE},
+    {U"shared.load", NativeKind::SHARED_LOAD},
+    {U"shared.store", NativeKind::SHARED_STORE},
+    {U"set.u16", NativeKind::SET},
+    {U"set.u32", NativeKind::SET},
+    {U"set.i32", NativeKind::SET},
+    {U"set.u64", NativeKind::SET},
+    {U"set.i64", NativeKind::SET},
+    {U"addr_of", NativeKind::ADDRESS_OF},
+    {U"stack_resize", NativeKind::STACK_RESIZE},
+    {U"set_stack", NativeKind::SET_STACK},
+    {U"get_stack", NativeKind::GET_STACK},
+    {U"add.u32", NativeKind::ADD},
+    {U"add.u32.imm", NativeKind::ADD_IMMEDIATE},
+    {U"sub.u32", NativeKind::SUB},
+    {U"sub.u32.imm", NativeKind::SUB_IMMEDIATE},
+};
+
+auto
+native_kind(const magix::compile::InstructionSpec &spec) -> NativeKind
+{
+    for (const NativeForm &form : native_forms)
+    {
+        if (form.mnenomic == spec.mnenomic)
+        {
+            return form.kind;
+        }
+    }
+    return NativeKind::NONE;
+}
+
+/** Translates a whole decoded stream, one native block per instruction, in stream order so fallthrough stays fallthrough. */
+struct Translator
+{
+    const magix::execute::DecodedByteCode &program;
+    /** Use the stencil even if there is a hand written translation, to test the stencils. */
+    bool prefer_stencils;
+    X64Emitter emitter;
+    std::vector<Label> instruction_labels;
+    Label epilogue_label = 0;
+    /** Out of line exits, by packed result. */
+    std::map<magix::u32, Label> exits;
+    /** Stencils are patched in behind the exits, one copy per instruction. */
+    std::vector<std::pair<Label, magix::u32>> stencil_calls;
+    /** Superinstructions that run out of steps inside, by stream index. */
+    std::vector<std::pair<Label, magix::u32>> out_of_steps_calls;
+    /** Veneers to host functions, by the stencil hole that calls them. */
+    std::map<StencilHole::Value, Label> veneers;
+
+    /** Label that leaves the native code with the result. */
+    auto
+    exit_with(ExecResult::Type type, magix::u16 instruction_pointer) -> Label
+    {
+        auto [it, is_new] = exits.try_emplace(pack_result(type, instruction_pointer), 0);
+        if (is_new)
+        {
+            it->second = emitter.new_label();
+        }
+        return it->second;
+    }
+
+    auto
+    veneer_for(StencilHole::Value value) -> Label
+    {
+        auto [it, is_new] = veneers.try_emplace(value, 0);
+        if (is_new)
+        {
+            it->second = emitter.new_label();
+        }
+        return it->second;
+    }
+
+    auto
+    translate() -> bool
+    {
+        emitter.prologue();
+        epilogue_label = emitter.new_label();
+        for ([[maybe_unused]] auto index : magix::ranges::num_range(program.instructions.size()))
+        {
+            instruction_labels.push_back(emitter.new_label());
+        }
+
+        for (auto index : magix::ranges::num_range(program.instructions.size()))
+        {
+            const magix::execute::DecodedInstruction &decoded = program.instructions[index];
+            emitter.bind(instruction_labels[index]);
+            emitter.count_step();
+            emitter.jump_if(BELOW, exit_with(ExecResult::Type::TRAP_TOO_MANY_STEPS, decoded.instruction_pointer));
+
+            const magix::compile::InstructionSpec *spec = magix::compile::get_instruction_spec(decoded.op_code);
+            if (spec == nullptr)
+            {
+                // trap, decided when decoding
+                emitter.jump(exit_with(static_cast<ExecResult::Type>(decoded.operands[0]), decoded.instruction_pointer));
+                continue;
+            }
+            if (!translate_instruction(static_cast<magix::u32>(index), decoded, *spec))
+            {
+                return false;
+            }
+        }
+
+        // everything below is cold
+        for (auto [packed, label] : exits)
+        {
+            emitter.bind(label);
+            emitter.move_immediate32(RAX, packed);
+            emitter.jump(epilogue_label);
+        }
+        for (auto [label, index] : out_of_steps_calls)
+        {
+            emitter.bind(label);
+            emitter.move(RDI, R15);
+            emitter.move_immediate32(RSI, index);
+            emitter.move(RDX, R14);
+            emitter.move(RCX, R12);
+            emitter.move_immediate64(RAX, reinterpret_cast<magix::u64>(&call_interpreter_out_of_steps));
+            emitter.call_rax();
+            emitter.jump(epilogue_label);
+        }
+        emitter.bind(epilogue_label);
+        emitter.epilogue();
+
+        for (auto [label, index] : stencil_calls)
+        {
+            const magix::execute::DecodedInstruction &decoded = program.instructions[index];
+            auto value_of = [&decoded](const StencilHole &hole) -> magix::i64 {
+                if (hole.value == StencilHole::Value::INSTRUCTION_POINTER)
+                {
+                    return decoded.instruction_pointer;
+                }
+                // stencils take the raw operand word, the decoder sign extended some
+                return static_cast<magix::u16>(decoded.operands[hole.operand]);
+            };
+            emitter.align(16);
+            emitter.bind(label);
+            if (!emitter.stencil(*magix::execute::find_stencil(decoded.op_code), value_of, [this](StencilHole::Value value) {
+                    return veneer_for(value);
+                }))
+            {
+                return false;
+            }
+        }
+        for (auto [value, label] : veneers)
+        {
+            emitter.align(8);
+            emitter.bind(label);
+            emitter.veneer(host_function(value));
+        }
+        return emitter.link();
+    }
+
+    static auto
+    host_function(StencilHole::Value value) -> magix::u64
+    {
+        switch (value)
+        {
+        case StencilHole::Value::MEMCPY:
+        {
+            return reinterpret_cast<magix::u64>(&std::memcpy);
+        }
+        case StencilHole::Value::MEMMOVE:
+        {
+            return reinterpret_cast<magix::u64>(&std::memmove);
+        }
+        case StencilHole::Value::MEMSET:
+        {
+            return reinterpret_cast<magix::u64>(&std::memset);
+        }
+        case StencilHole::Value::OPERAND:
+        case StencilHole::Value::INSTRUCTION_POINTER:
+        {
+            break;
+        }
+        }
+        return 0;
+    }
+
+    auto
+    translate_instruction(magix::u32 index, const magix::execute::DecodedInstruction &decoded, const magix::compile::InstructionSpec &spec)
+        -> bool
+    {
+        const size_t reg_count = spec.arg_count();
+        const bool has_stencil = magix::execute::find_stencil(decoded.op_code) != nullptr;
+        if (prefer_stencils && has_stencil)
+        {
+            charge_parts(index, spec);
+            call_stencil(index);
+            return true;
+        }
+        if (spec.fused_sequence.size() != 0)
+        {
+            bool all_native = true;
+            for (magix::code_word part : spec.fused_sequence)
+            {
+                all_native = all_native && native_kind(*magix::compile::get_instruction_spec(part)) != NativeKind::NONE;
+            }
+            if (all_native)
+            {
+                // the parts in order, each with its slice of the operands, its own step and its own address
+                size_t operand_offset = 0;
+                size_t instruction_pointer = decoded.instruction_pointer;
+                for (magix::code_word part : spec.fused_sequence)
+                {
+                    const magix::compile::InstructionSpec &part_spec = *magix::compile::get_instruction_spec(part);
+                    if (instruction_pointer != decoded.instruction_pointer)
+                    {
+                        emitter.count_step();
+                        emitter.jump_if(
+                            BELOW, exit_with(ExecResult::Type::TRAP_TOO_MANY_STEPS, static_cast<magix::u16>(instruction_pointer))
+                        );
+                    }
+                    translate_native(
+                        native_kind(part_spec), part_spec, &decoded.operands[operand_offset], static_cast<magix::u16>(instruction_pointer)
+                    );
+                    operand_offset += part_spec.arg_count();
+                    instruction_pointer += part_spec.code_words() * magix::code_size_v<magix::code_word>;
+                }
+                return true;
+            }
+        }
+        else if (const NativeKind kind = native_kind(spec); kind != NativeKind::NONE)
+        {
+            translate_native(kind, spec, decoded.operands, decoded.instruction_pointer);
+            return true;
+        }
+
+        // the interpreter can only run instructions that neither jump nor move the stack pointer
+        if (spec.is_terminator || spec.stack_pointer_effect != magix::compile::StackPointerEffect::NONE)
+        {
+            return false;
+        }
+        for (auto reg_index : magix::ranges::num_range(reg_count))
+        {
+            if (spec.registers[reg_index].is_code_address)
+            {
+                return false;
+            }
+        }
+        charge_parts(index, spec);
+        if (has_stencil)
+        {
+            call_stencil(index);
+            return true;
+        }
+        emitter.move(RDI, R15);
+        emitter.move_immediate32(RSI, index);
+        emitter.move(RDX, R14);
+        emitter.move_immediate64(RAX, reinterpret_cast<magix::u64>(&call_interpreter));
+        emitter.call_rax();
+        emitter.test_eax();
+        emitter.jump_if(NOT_EQUAL, epilogue_label);
+        return true;
+    }
+
+    /** Stencils and the interpreter run every part of a superinstruction, so charge the parts after the first up front. */
+    void
+    charge_parts(magix::u32 index, const magix::compile::InstructionSpec &spec)
+    {
+        const auto rest = static_cast<magix::u8>(spec.step_count() - 1);
+        if (rest == 0)
+        {
+            return;
+        }
+        const Label out_of_steps = emitter.new_label();
+        out_of_steps_calls.emplace_back(out_of_steps, index);
+        emitter.compare_steps(rest);
+        emitter.jump_if(BELOW, out_of_steps);
+        emitter.count_steps(rest);
+    }
+
+    /** Same calling convention as the interpreter, but with the operands patched into a copy of the stencil. */
+    void
+    call_stencil(magix::u32 index)
+    {
+        const Label stencil = emitter.new_label();
+        stencil_calls.emplace_back(stencil, index);
+        emitter.move(RDI, R15);
+        emitter.move(RSI, R14);
+        emitter.call(stencil);
+        emitter.test_eax();
+        emitter.jump_if(NOT_EQUAL, epilogue_label);
+    }
+
+    void
+    translate_native(
+        NativeKind kind,
+        const magix::compile::InstructionSpec &spec,
+        const magix::i32 *operands,
+        magix::u16 instruction_pointer
+    )
+    {
+        const size_t size = magix::compile::type_size(spec.registers[0].type);
+        switch (kind)
+        {
+        case NativeKind::NONE:
+        case NativeKind::NOP:
+        {
+            break;
+        }
+        case NativeKind::YIELD:
+        {
+            const magix::u16 target = program.instructions[operands[0]].instruction_pointer;
+            emitter.jump(exit_with(ExecResult::Type::OK_YIELD, target));
+            break;
+        }
+        case NativeKind::EXIT:
+        {
+            const size_t next_instruction = instruction_pointer + spec.code_words() * magix::code_size_v<magix::code_word>;
+            emitter.jump(exit_with(ExecResult::Type::OK_EXIT, static_cast<magix::u16>(next_instruction)));
+            break;
+        }
+        case NativeKind::GOTO:
+        {
+            emitter.jump(instruction_labels[operands[0]]);
+            break;
+        }
+        case NativeKind::IF_ZERO:
+        {
+            emitter.compare_stack_zero(operands[1]);
+            emitter.jump_if(EQUAL, instruction_labels[operands[0]]);
+            break;
+        }
+        case NativeKind::MOVE:
+        {
+            emitter.load_stack(size, operands[1]);
+            emitter.store_stack(size, operands[0]);
+            break;
+        }
+        case NativeKind::ROM_LOAD:
+        {
+            // the ROM never changes, so the value and the checks are constant
+            const auto address = static_cast<size_t>(operands[1]);
+            const auto &rom = program.raw->code;
+            if (address + size > rom.size() || address % size != 0)
+            {
+                emitter.jump(exit_with(ExecResult::Type::TRAP_MEM_ACCESS_USER, instruction_pointer));
+                break;
+            }
+            magix::u64 value = 0;
+            std::memcpy(&value, &rom[address], size);
+            emitter.store_stack_immediate(size, operands[0], value);
+            break;
+        }
+        case NativeKind::FORK_LOAD:
+        case NativeKind::FORK_STORE:
+        case NativeKind::SHARED_LOAD:
+        case NativeKind::SHARED_STORE:
+        {
+            const bool is_fork = kind == NativeKind::FORK_LOAD || kind == NativeKind::FORK_STORE;
+            const bool is_load = kind == NativeKind::FORK_LOAD || kind == NativeKind::SHARED_LOAD;
+            const magix::i32 page_data = is_fork ? offsetof(JitFrame, primitive_fork) : offsetof(JitFrame, primitive_shared);
+            const magix::i32 page_size = is_fork ? offsetof(JitFrame, primitive_fork_size) : offsetof(JitFrame, primitive_shared_size);
+            const magix::i32 stack_reg = operands[0];
+            const magix::i32 page_offset = operands[1];
+            const magix::i32 copy_size = operands[2];
+            const Label trap = exit_with(ExecResult::Type::TRAP_MEM_ACCESS_USER, instruction_pointer);
+
+            emitter.lea_stack_pointer(RAX, stack_reg + copy_size, true);
+            emitter.compare_rax_frame(offsetof(JitFrame, stack_size));
+            emitter.jump_if(ABOVE, trap);
+            emitter.compare_frame_immediate(page_size, page_offset + copy_size);
+            emitter.jump_if(BELOW, trap);
+
+            emitter.lea_stack(is_load ? RDI : RSI, stack_reg);
+            emitter.load_frame(is_load ? RSI : RDI, page_data);
+            emitter.add_immediate(is_load ? RSI : RDI, page_offset);
+            emitter.move_immediate32(RCX, static_cast<magix::u32>(copy_size));
+            emitter.copy_bytes();
+            break;
+        }
+        case NativeKind::SET:
+        {
+            // already extended to the immediate type, extend further to the destination type
+            emitter.store_stack_immediate(size, operands[0], static_cast<magix::u64>(static_cast<magix::i64>(operands[1])));
+            break;
+        }
+        case NativeKind::ADDRESS_OF:
+        {
+            emitter.lea_stack_pointer(RAX, operands[1], false);
+            emitter.store_stack(4, operands[0]);
+            break;
+        }
+        case NativeKind::STACK_RESIZE:
+        {
+            emitter.add_stack_pointer(operands[0]);
+            break;
+        }
+        case NativeKind::SET_STACK:
+        {
+            emitter.load_stack_pointer(operands[0]);
+            break;
+        }
+        case NativeKind::GET_STACK:
+        {
+            emitter.store_stack_pointer(operands[0]);
+            break;
+        }
+        case NativeKind::ADD:
+        case NativeKind::SUB:
+        {
+            emitter.load_stack(4, operands[1]);
+            emitter.arithmetic_stack(kind == NativeKind::ADD ? 0x03 : 0x2B, operands[2]);
+            emitter.store_stack(4, operands[0]);
+            break;
+        }
+        case NativeKind::ADD_IMMEDIATE:
+        case NativeKind::SUB_IMMEDIATE:
+        {
+            emitter.load_stack(4, operands[1]);
+            emitter.arithmetic_immediate(kind == NativeKind::ADD_IMMEDIATE ? 0x05 : 0x2D, static_cast<magix::u32>(operands[2]));
+            emitter.store_stack(4, operands[0]);
+            break;
+        }
+        }
+    }
+};
+
+#endif // MAGIX_USE_JIT
+
+} // namespace
+
+void
+magix::execute::UnmapCode::operator()(std::byte *code) const noexcept
+{
+#if MAGIX_USE_JIT
+    munmap(code, size);
+#endif
+}
+
+auto
+magix::execute::JitProgram::find(magix::u16 entry) const -> std::optional<magix::u32>
+{
+    auto it = std::lower_bound(entries.begin(), entries.end(), entry, [](const auto &item, magix::u16 search) {
+        return item.first < search;
+    });
+    if (it == entries.end() || it->first != entry)
+    {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+auto
+magix::execute::jit_available() noexcept -> bool
+{
+    return MAGIX_USE_JIT;
+}
+
+auto
+magix::execute::jit_compile(const DecodedByteCode &program, bool prefer_stencils) -> JitProgram
+{
+    JitProgram out;
+    out.decoded = &program;
+#if MAGIX_USE_JIT
+    if (program.verified_entries.empty())
+    {
+        return out;
+    }
+
+    Translator translator{program, prefer_stencils, {}, {}, 0, {}, {}, {}, {}};
+    if (!translator.translate())
+    {
+        return out;
+    }
+
+    // write, then flip to executable, never both
+    const std::vector<magix::u8> &code = translator.emitter.code;
+    void *mapping = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return out;
+    }
+    std::memcpy(mapping, code.data(), code.size());
+    if (mprotect(mapping, code.size(), PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(mapping, code.size());
+        return out;
+    }
+    out.code = std::unique_ptr<std::byte, UnmapCode>{static_cast<std::byte *>(mapping), UnmapCode{code.size()}};
+
+    for (magix::u16 entry : program.verified_entries)
+    {
+        const magix::u32 index = *program.find(entry);
+        out.entries.emplace_back(entry, static_cast<magix::u32>(translator.emitter.label_offsets[translator.instruction_labels[index]]));
+    }
+#endif
+    return out;
+}
+
+auto
+magix::execute::execute(const JitProgram &program, magix::u16 entry, size_t steps, ExecutionContext &context) -> ExecResult
+{
+    const std::optional<magix::u32> offset = program.find(entry);
+    if (!program.code || !offset.has_value() || !program.decoded->is_verified(entry, context.page_info.stack_size))
+    {
+        return execute(*program.decoded, entry, steps, context);
+    }
+
+    auto &&pages = context.page_info;
+    pages.stack->mark_stack_dirty(program.decoded->verified_stack_size);
+    JitFrame frame{
+        pages.stack->stack.data(),
+        pages.stack_size,
+        steps,
+        pages.primitive_fork.data(),
+        pages.primitive_fork.size(),
+        pages.primitive_shared.data(),
+        pages.primitive_shared.size(),
+        program.decoded,
+        &context,
+    };
+    const auto native = reinterpret_cast<NativeEntry>(program.code.get());
+    return unpack_result(native(&frame, program.code.get() + *offset));
+}
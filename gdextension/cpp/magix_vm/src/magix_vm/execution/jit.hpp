@@ -0,0 +1,60 @@
+#ifndef MAGIX_EXECUTION_JIT_HPP_
+#define MAGIX_EXECUTION_JIT_HPP_
+
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace magix::execute
+{
+
+/** Unmaps native code. */
+struct UnmapCode
+{
+    size_t size = 0;
+
+    void
+    operator()(std::byte *code) const noexcept;
+};
+
+/** Native code for a decoded program, shared by all executions. */
+struct JitProgram
+{
+    /** Program the code was translated from, also runs every entry without native code. */
+    const DecodedByteCode *decoded = nullptr;
+    /** Executable, read only mapping. Empty if the platform or the program is not supported. */
+    std::unique_ptr<std::byte, UnmapCode> code;
+    /** (instruction pointer, code offset) of every verified entry, sorted by instruction pointer. */
+    std::vector<std::pair<magix::u16, magix::u32>> entries;
+
+    /** Code offset of the entry, if it has native code. */
+    [[nodiscard]] auto
+    find(magix::u16 entry) const -> std::optional<magix::u32>;
+};
+
+/** Whether this build can generate native code at all. Linux x86-64 only, and only if built with the jit option. */
+[[nodiscard]] auto
+jit_available() noexcept -> bool;
+
+/** Translate the verified entries of a decoded program into native code.
+ * Stack accesses are not checked, so only verified entries get native code. Every other trap, the step budget and the yield and
+ * exit instruction pointers behave exactly as in the interpreter. Instructions without a hand written translation use the stencil
+ * compiled from their action, or call back into the interpreter if there is none. The program must outlive the result.
+ * prefer_stencils uses the stencils even where there is a hand written translation, only useful to test them.
+ */
+[[nodiscard]] auto
+jit_compile(const DecodedByteCode &program, bool prefer_stencils = false) -> JitProgram;
+
+/** Same as the other executors, but runs native code where there is some. Falls back to the decoded program otherwise. */
+[[nodiscard]] auto
+execute(const JitProgram &program, magix::u16 entry, size_t steps, ExecutionContext &context) -> ExecResult;
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_JIT_HPP_
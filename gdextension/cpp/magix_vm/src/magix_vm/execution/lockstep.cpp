@@ -0,0 +1,619 @@
+#include "magix_vm/execution/lockstep.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/types.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstring>
+
+// AVX2 is picked at runtime, so the build does not need to target it.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define MAGIX_LOCKSTEP_AVX2 1
+#include <immintrin.h>
+#else
+#define MAGIX_LOCKSTEP_AVX2 0
+#endif
+
+namespace
+{
+
+using magix::execute::ExecResult;
+using magix::execute::LaneOp;
+using magix::execute::lockstep_lane_count;
+
+struct LaneForm
+{
+    magix::compile::SrcView mnenomic;
+    LaneOp::Kind kind;
+};
+
+constexpr LaneForm lane_forms[] = {
+    {U"nop", LaneOp::Kind::NOP},
+    {U"yield_to", LaneOp::Kind::YIELD},
+    {U"exit", LaneOp::Kind::EXIT},
+    {U"goto", LaneOp::Kind::GOTO},
+    {U"if.zero", LaneOp::Kind::IF_ZERO},
+    {U"mov.b8", LaneOp::Kind::MOVE},
+    {U"mov.b16", LaneOp::Kind::MOVE},
+    {U"mov.b32", LaneOp::Kind::MOVE},
+    {U"mov.b64", LaneOp::Kind::MOVE},
+    {U"load.b8", LaneOp::Kind::SET},
+    {U"load.b16", LaneOp::Kind::SET},
+    {U"load.b32", LaneOp::Kind::SET},
+    {U"load.b64", LaneOp::Kind::SET},
+    {U"fork.load", LaneOp::Kind::FORK_LOAD},
+    {U"fork.store", LaneOp::Kind::FORK_STORE},
+    {U"set.u16", LaneOp::Kind::SET},
+    {U"set.u32", LaneOp::Kind::SET},
+    {U"set.i32", LaneOp::Kind::SET},
+    {U"set.u64", LaneOp::Kind::SET},
+    {U"set.i64", LaneOp::Kind::SET},
+    {U"addr_of", LaneOp::Kind::ADDRESS_OF},
+    {U"stack_resize", LaneOp::Kind::STACK_RESIZE},
+    {U"get_stack", LaneOp::Kind::GET_STACK},
+    {U"add.u32", LaneOp::Kind::ADD},
+    {U"sub.u32", LaneOp::Kind::SUB},
+    {U"add.u32.imm", LaneOp::Kind::ADD_IMMEDIATE},
+    {U"sub.u32.imm", LaneOp::Kind::ADD_IMMEDIATE},
+};
+
+/** One part of a decoded instruction, at the address of the part. */
+auto
+translate(
+    const magix::execute::DecodedByteCode &program,
+    const magix::compile::InstructionSpec &spec,
+    const magix::i32 *operands,
+    magix::u16 instruction_pointer
+) -> LaneOp
+{
+    LaneOp op{LaneOp::Kind::DIVERGE, 0, {}, 0, instruction_pointer};
+    for (const LaneForm &form : lane_forms)
+    {
+        if (form.mnenomic == spec.mnenomic)
+        {
+            op.kind = form.kind;
+        }
+    }
+    const size_t arg_count = spec.arg_count();
+    for (auto operand : magix::ranges::num_range(std::min(arg_count, magix::array_size(op.operands))))
+    {
+        op.operands[operand] = operands[operand];
+    }
+    if (arg_count != 0)
+    {
+        op.size = static_cast<magix::u8>(magix::compile::type_size(spec.registers[0].type));
+    }
+
+    switch (op.kind)
+    {
+    case LaneOp::Kind::YIELD:
+    {
+        op.value = program.instructions[operands[0]].instruction_pointer;
+        break;
+    }
+    case LaneOp::Kind::EXIT:
+    {
+        op.value = instruction_pointer + spec.code_words() * magix::code_size_v<magix::code_word>;
+        break;
+    }
+    case LaneOp::Kind::SET:
+    {
+        if (spec.mnenomic.substr(0, 5) != U"load.")
+        {
+            // already extended to the immediate type, extend further to the destination type
+            op.value = static_cast<magix::u64>(static_cast<magix::i64>(operands[1]));
+            break;
+        }
+        // the ROM never changes, so loads are sets
+        const auto address = static_cast<size_t>(operands[1]);
+        const auto &rom = program.raw->code;
+        if (address + op.size > rom.size() || address % op.size != 0)
+        {
+            op.kind = LaneOp::Kind::TRAP;
+            op.value = static_cast<magix::u64>(ExecResult::Type::TRAP_MEM_ACCESS_USER);
+            break;
+        }
+        std::memcpy(&op.value, &rom[address], op.size);
+        break;
+    }
+    case LaneOp::Kind::ADD_IMMEDIATE:
+    {
+        const auto immediate = static_cast<magix::u32>(operands[2]);
+        op.value = spec.mnenomic == U"sub.u32.imm" ? 0U - immediate : immediate;
+        break;
+    }
+    default:
+    {
+        break;
+    }
+    }
+    return op;
+}
+
+/** Lane operations on rows of lockstep_lane_count u32, aligned to 32 bytes. */
+struct PlainLanes
+{
+    static void
+    copy(magix::u32 *dst, const magix::u32 *src) noexcept
+    {
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            dst[lane] = src[lane];
+        }
+    }
+
+    static void
+    fill(magix::u32 *dst, magix::u32 value) noexcept
+    {
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            dst[lane] = value;
+        }
+    }
+
+    static void
+    add(magix::u32 *dst, const magix::u32 *lhs, const magix::u32 *rhs) noexcept
+    {
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            dst[lane] = lhs[lane] + rhs[lane];
+        }
+    }
+
+    static void
+    sub(magix::u32 *dst, const magix::u32 *lhs, const magix::u32 *rhs) noexcept
+    {
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            dst[lane] = lhs[lane] - rhs[lane];
+        }
+    }
+
+    static void
+    add_immediate(magix::u32 *dst, const magix::u32 *lhs, magix::u32 rhs) noexcept
+    {
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            dst[lane] = lhs[lane] + rhs;
+        }
+    }
+
+    /** Bit per lane, set if the lane is 0. */
+    [[nodiscard]] static auto
+    zero_mask(const magix::u32 *row) noexcept -> magix::u32
+    {
+        magix::u32 mask = 0;
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            mask |= static_cast<magix::u32>(row[lane] == 0) << lane;
+        }
+        return mask;
+    }
+};
+
+#if MAGIX_LOCKSTEP_AVX2
+/** Same as PlainLanes, one instruction each. */
+struct Avx2Lanes
+{
+    static_assert(lockstep_lane_count * sizeof(magix::u32) == sizeof(__m256i));
+
+    __attribute__((target("avx2"))) static void
+    copy(magix::u32 *dst, const magix::u32 *src) noexcept
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(dst), _mm256_load_si256(reinterpret_cast<const __m256i *>(src)));
+    }
+
+    __attribute__((target("avx2"))) static void
+    fill(magix::u32 *dst, magix::u32 value) noexcept
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i *>(dst), _mm256_set1_epi32(static_cast<int>(value)));
+    }
+
+    __attribute__((target("avx2"))) static void
+    add(magix::u32 *dst, const magix::u32 *lhs, const magix::u32 *rhs) noexcept
+    {
+        const __m256i left = _mm256_load_si256(reinterpret_cast<const __m256i *>(lhs));
+        const __m256i right = _mm256_load_si256(reinterpret_cast<const __m256i *>(rhs));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(dst), _mm256_add_epi32(left, right));
+    }
+
+    __attribute__((target("avx2"))) static void
+    sub(magix::u32 *dst, const magix::u32 *lhs, const magix::u32 *rhs) noexcept
+    {
+        const __m256i left = _mm256_load_si256(reinterpret_cast<const __m256i *>(lhs));
+        const __m256i right = _mm256_load_si256(reinterpret_cast<const __m256i *>(rhs));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(dst), _mm256_sub_epi32(left, right));
+    }
+
+    __attribute__((target("avx2"))) static void
+    add_immediate(magix::u32 *dst, const magix::u32 *lhs, magix::u32 rhs) noexcept
+    {
+        const __m256i left = _mm256_load_si256(reinterpret_cast<const __m256i *>(lhs));
+        _mm256_store_si256(reinterpret_cast<__m256i *>(dst), _mm256_add_epi32(left, _mm256_set1_epi32(static_cast<int>(rhs))));
+    }
+
+    __attribute__((target("avx2"))) [[nodiscard]] static auto
+    zero_mask(const magix::u32 *row) noexcept -> magix::u32
+    {
+        const __m256i zero = _mm256_cmpeq_epi32(_mm256_load_si256(reinterpret_cast<const __m256i *>(row)), _mm256_setzero_si256());
+        return static_cast<magix::u32>(_mm256_movemask_ps(_mm256_castsi256_ps(zero)));
+    }
+};
+#endif
+
+[[nodiscard]] auto
+lane_count_of(magix::u32 mask) -> size_t
+{
+    return std::bitset<lockstep_lane_count>(mask).count();
+}
+
+} // namespace
+
+auto
+magix::execute::lockstep_compile(const DecodedByteCode &program) -> LockstepProgram
+{
+    LockstepProgram out;
+    out.decoded = &program;
+    out.instructions.reserve(program.instructions.size());
+    for (const DecodedInstruction &decoded : program.instructions)
+    {
+        const auto first = static_cast<magix::u32>(out.ops.size());
+        const magix::compile::InstructionSpec *spec = magix::compile::get_instruction_spec(decoded.op_code);
+        if (decoded.op_code == magix::invalid_opcode || spec == nullptr)
+        {
+            // trap, decided when decoding
+            out.ops.push_back(LaneOp{LaneOp::Kind::TRAP, 0, {}, static_cast<magix::u64>(decoded.operands[0]), decoded.instruction_pointer});
+        }
+        else if (spec->fused_sequence.size() != 0)
+        {
+            // the parts in order, each with its slice of the operands and its own address
+            size_t operand_offset = 0;
+            size_t instruction_pointer = decoded.instruction_pointer;
+            for (magix::code_word part : spec->fused_sequence)
+            {
+                const magix::compile::InstructionSpec &part_spec = *magix::compile::get_instruction_spec(part);
+                out.ops.push_back(
+                    translate(program, part_spec, &decoded.operands[operand_offset], static_cast<magix::u16>(instruction_pointer))
+                );
+                operand_offset += part_spec.arg_count();
+                instruction_pointer += part_spec.code_words() * magix::code_size_v<magix::code_word>;
+            }
+        }
+        else
+        {
+            out.ops.push_back(translate(program, *spec, decoded.operands, decoded.instruction_pointer));
+        }
+
+        // lanes can only leave between instructions, so one part that is not lane local is enough
+        // fork copies of verified entries stay within the verified stack size like every other stack register
+        LaneInstruction instruction{first, static_cast<magix::u32>(out.ops.size() - first), false};
+        for (auto op_index : magix::ranges::num_range(static_cast<size_t>(first), out.ops.size()))
+        {
+            instruction.diverges = instruction.diverges || out.ops[op_index].kind == LaneOp::Kind::DIVERGE;
+        }
+        out.instructions.push_back(instruction);
+    }
+    return out;
+}
+
+auto
+magix::execute::LockstepProgram::can_run(magix::u16 entry, size_t stack_size) const -> bool
+{
+    return decoded != nullptr && decoded->is_verified(entry, stack_size) && decoded->find(entry).has_value();
+}
+
+void
+magix::execute::LockstepBatch::run(
+    const LockstepProgram &program, magix::u16 entry, magix::span<const magix::span<std::byte>> forks, size_t steps
+)
+{
+    this->program = &program;
+    stack_bytes = program.decoded->verified_stack_size;
+    rows.assign((stack_bytes + sizeof(magix::u32) - 1) / sizeof(magix::u32), Row{});
+    lane_exits.assign(forks.size(), LaneExit{});
+    diverged_stacks.resize(forks.size() * stack_bytes);
+
+    const magix::u32 index = *program.decoded->find(entry);
+#if MAGIX_LOCKSTEP_AVX2
+    if (uses_avx2())
+    {
+        run_lanes<Avx2Lanes>(index, forks, steps);
+        return;
+    }
+#endif
+    run_lanes<PlainLanes>(index, forks, steps);
+}
+
+template <typename Lanes>
+void
+magix::execute::LockstepBatch::run_lanes(magix::u32 index, magix::span<const magix::span<std::byte>> forks, size_t steps)
+{
+    const DecodedByteCode &decoded = *program->decoded;
+    const size_t fork_size = forks[0].size();
+    magix::u32 active = (1U << forks.size()) - 1;
+    size_t stack_pointer = 0;
+
+    auto exit_active = [&](ExecResult result) {
+        for (auto lane : magix::ranges::num_range(forks.size()))
+        {
+            if (active & (1U << lane))
+            {
+                lane_exits[lane] = LaneExit{result, false, 0, 0, 0};
+            }
+        }
+    };
+    // the verifier proved every typed register aligned and inside the verified stack
+    auto row = [&](magix::i32 reg) -> magix::u32 * { return rows[(stack_pointer + reg) / sizeof(magix::u32)].lanes; };
+    auto store_all = [&](size_t address, size_t size, magix::u64 value) {
+        if (size == sizeof(magix::u32) && address % sizeof(magix::u32) == 0)
+        {
+            Lanes::fill(rows[address / sizeof(magix::u32)].lanes, static_cast<magix::u32>(value));
+            return;
+        }
+        magix::u8 bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+        {
+            for (auto byte : magix::ranges::num_range(size))
+            {
+                lane_byte(lane, address + byte) = bytes[byte];
+            }
+        }
+    };
+
+    while (true)
+    {
+        const DecodedInstruction &instruction = decoded.instructions[index];
+        if (steps == 0)
+        {
+            exit_active(ExecResult{instruction.instruction_pointer, ExecResult::Type::TRAP_TOO_MANY_STEPS});
+            return;
+        }
+
+        const LaneInstruction &lane_instruction = program->instructions[index];
+        if (lane_instruction.diverges)
+        {
+            for (auto lane : magix::ranges::num_range(forks.size()))
+            {
+                if (active & (1U << lane))
+                {
+                    leave(lane, index, stack_pointer, steps);
+                }
+            }
+            return;
+        }
+
+        magix::u32 next_index = index + 1;
+        for (const LaneOp &op : magix::span<const LaneOp>(&program->ops[lane_instruction.first_op], lane_instruction.op_count))
+        {
+            // every part is a step, the first one is known to be there
+            if (steps-- == 0)
+            {
+                exit_active(ExecResult{op.instruction_pointer, ExecResult::Type::TRAP_TOO_MANY_STEPS});
+                return;
+            }
+            switch (op.kind)
+            {
+            case LaneOp::Kind::DIVERGE:
+            case LaneOp::Kind::NOP:
+            {
+                break;
+            }
+            case LaneOp::Kind::TRAP:
+            {
+                exit_active(ExecResult{op.instruction_pointer, static_cast<ExecResult::Type>(op.value)});
+                return;
+            }
+            case LaneOp::Kind::YIELD:
+            {
+                exit_active(ExecResult{static_cast<magix::u16>(op.value), ExecResult::Type::OK_YIELD});
+                return;
+            }
+            case LaneOp::Kind::EXIT:
+            {
+                exit_active(ExecResult{static_cast<magix::u16>(op.value), ExecResult::Type::OK_EXIT});
+                return;
+            }
+            case LaneOp::Kind::GOTO:
+            {
+                next_index = static_cast<magix::u32>(op.operands[0]);
+                break;
+            }
+            case LaneOp::Kind::IF_ZERO:
+            {
+                const magix::u32 taken = Lanes::zero_mask(row(op.operands[1])) & active;
+                const magix::u32 not_taken = active & ~taken;
+                const auto target = static_cast<magix::u32>(op.operands[0]);
+                if (taken == 0 || not_taken == 0)
+                {
+                    next_index = taken != 0 ? target : next_index;
+                    break;
+                }
+                // most lanes stay
+                const bool keep_taken = lane_count_of(taken) >= lane_count_of(not_taken);
+                const magix::u32 leaving = keep_taken ? not_taken : taken;
+                for (auto lane : magix::ranges::num_range(forks.size()))
+                {
+                    if (leaving & (1U << lane))
+                    {
+                        leave(lane, keep_taken ? next_index : target, stack_pointer, steps);
+                    }
+                }
+                active &= ~leaving;
+                next_index = keep_taken ? target : next_index;
+                break;
+            }
+            case LaneOp::Kind::MOVE:
+            {
+                const size_t dst = stack_pointer + op.operands[0];
+                const size_t src = stack_pointer + op.operands[1];
+                if (op.size % sizeof(magix::u32) == 0 && dst % sizeof(magix::u32) == 0 && src % sizeof(magix::u32) == 0)
+                {
+                    for (auto word : magix::ranges::num_range(op.size / sizeof(magix::u32)))
+                    {
+                        Lanes::copy(rows[dst / sizeof(magix::u32) + word].lanes, rows[src / sizeof(magix::u32) + word].lanes);
+                    }
+                    break;
+                }
+                for (auto lane : magix::ranges::num_range(lockstep_lane_count))
+                {
+                    for (auto byte : magix::ranges::num_range(static_cast<size_t>(op.size)))
+                    {
+                        lane_byte(lane, dst + byte) = lane_byte(lane, src + byte);
+                    }
+                }
+                break;
+            }
+            case LaneOp::Kind::SET:
+            {
+                const size_t dst = stack_pointer + op.operands[0];
+                if (op.size == sizeof(magix::u64) && dst % sizeof(magix::u32) == 0)
+                {
+                    magix::u32 words[2];
+                    std::memcpy(words, &op.value, sizeof(words));
+                    store_all(dst, sizeof(magix::u32), words[0]);
+                    store_all(dst + sizeof(magix::u32), sizeof(magix::u32), words[1]);
+                    break;
+                }
+                store_all(dst, op.size, op.value);
+                break;
+            }
+            case LaneOp::Kind::FORK_LOAD:
+            case LaneOp::Kind::FORK_STORE:
+            {
+                // only the page bounds are left to check, the stack range is inside the lanes
+                const size_t stack_address = stack_pointer + op.operands[0];
+                const auto page_offset = static_cast<size_t>(op.operands[1]);
+                const auto size = static_cast<size_t>(op.operands[2]);
+                if (page_offset + size > fork_size)
+                {
+                    exit_active(ExecResult{op.instruction_pointer, ExecResult::Type::TRAP_MEM_ACCESS_USER});
+                    return;
+                }
+                const bool by_word = stack_address % sizeof(magix::u32) == 0 && size % sizeof(magix::u32) == 0;
+                for (auto lane : magix::ranges::num_range(forks.size()))
+                {
+                    if ((active & (1U << lane)) == 0)
+                    {
+                        continue;
+                    }
+                    std::byte *page = forks[lane].data() + page_offset;
+                    if (by_word)
+                    {
+                        for (auto word : magix::ranges::num_range(size / sizeof(magix::u32)))
+                        {
+                            magix::u32 &stack_word = rows[stack_address / sizeof(magix::u32) + word].lanes[lane];
+                            std::byte *page_word = page + word * sizeof(magix::u32);
+                            if (op.kind == LaneOp::Kind::FORK_LOAD)
+                            {
+                                std::memcpy(&stack_word, page_word, sizeof(magix::u32));
+                            }
+                            else
+                            {
+                                std::memcpy(page_word, &stack_word, sizeof(magix::u32));
+                            }
+                        }
+                        continue;
+                    }
+                    for (auto byte : magix::ranges::num_range(size))
+                    {
+                        magix::u8 &stack_byte = lane_byte(lane, stack_address + byte);
+                        if (op.kind == LaneOp::Kind::FORK_LOAD)
+                        {
+                            stack_byte = static_cast<magix::u8>(page[byte]);
+                        }
+                        else
+                        {
+                            page[byte] = static_cast<std::byte>(stack_byte);
+                        }
+                    }
+                }
+                break;
+            }
+            case LaneOp::Kind::ADDRESS_OF:
+            {
+                store_all(stack_pointer + op.operands[0], sizeof(magix::u32), static_cast<magix::u32>(stack_pointer + op.operands[1]));
+                break;
+            }
+            case LaneOp::Kind::STACK_RESIZE:
+            {
+                stack_pointer = stack_pointer + op.operands[0];
+                break;
+            }
+            case LaneOp::Kind::GET_STACK:
+            {
+                store_all(stack_pointer + op.operands[0], sizeof(magix::u32), static_cast<magix::u32>(stack_pointer));
+                break;
+            }
+            case LaneOp::Kind::ADD:
+            {
+                Lanes::add(row(op.operands[0]), row(op.operands[1]), row(op.operands[2]));
+                break;
+            }
+            case LaneOp::Kind::SUB:
+            {
+                Lanes::sub(row(op.operands[0]), row(op.operands[1]), row(op.operands[2]));
+                break;
+            }
+            case LaneOp::Kind::ADD_IMMEDIATE:
+            {
+                Lanes::add_immediate(row(op.operands[0]), row(op.operands[1]), static_cast<magix::u32>(op.value));
+                break;
+            }
+            }
+        }
+        index = next_index;
+    }
+}
+
+auto
+magix::execute::LockstepBatch::exits() const -> magix::span<const LaneExit>
+{
+    return magix::span<const LaneExit>(lane_exits.data(), lane_exits.size());
+}
+
+auto
+magix::execute::LockstepBatch::finish(size_t lane, ExecutionContext &context) const -> ExecResult
+{
+    const LaneExit &exit = lane_exits[lane];
+    if (!exit.diverged)
+    {
+        return exit.result;
+    }
+    context.page_info.stack->mark_stack_dirty(stack_bytes);
+    std::memcpy(context.page_info.stack->stack.data(), &diverged_stacks[lane * stack_bytes], stack_bytes);
+    return execute_from(*program->decoded, exit.index, exit.stack_pointer, exit.steps, context);
+}
+
+auto
+magix::execute::LockstepBatch::uses_avx2() noexcept -> bool
+{
+#if MAGIX_LOCKSTEP_AVX2
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+auto
+magix::execute::LockstepBatch::lane_byte(size_t lane, size_t address) -> magix::u8 &
+{
+    // byte order inside the words is the byte order of the stack
+    return reinterpret_cast<magix::u8 *>(&rows[address / sizeof(magix::u32)].lanes[lane])[address % sizeof(magix::u32)];
+}
+
+void
+magix::execute::LockstepBatch::leave(size_t lane, magix::u32 index, size_t stack_pointer, size_t steps)
+{
+    for (auto address : magix::ranges::num_range(stack_bytes))
+    {
+        diverged_stacks[lane * stack_bytes + address] = static_cast<std::byte>(lane_byte(lane, address));
+    }
+    lane_exits[lane] = LaneExit{ExecResult{}, true, index, stack_pointer, steps};
+}
@@ -0,0 +1,149 @@
+#ifndef MAGIX_EXECUTION_LOCKSTEP_HPP_
+#define MAGIX_EXECUTION_LOCKSTEP_HPP_
+
+#include "magix_vm/allocators.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/span.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace magix::execute
+{
+
+/** Instances a batch runs side by side, one 32 bit lane of a 256 bit vector each. */
+constexpr size_t lockstep_lane_count = 8;
+
+/** What every lane does for one part of a decoded instruction. */
+struct LaneOp
+{
+    enum class Kind : magix::u8
+    {
+        /** Not lane local, all lanes go on alone from here. */
+        DIVERGE,
+        TRAP,
+        NOP,
+        YIELD,
+        EXIT,
+        GOTO,
+        IF_ZERO,
+        MOVE,
+        SET,
+        FORK_LOAD,
+        FORK_STORE,
+        ADDRESS_OF,
+        STACK_RESIZE,
+        GET_STACK,
+        ADD,
+        SUB,
+        ADD_IMMEDIATE,
+    };
+
+    Kind kind;
+    /** Bytes written to the first register, for moves and sets. */
+    magix::u8 size;
+    /** Decoded operands of the part. */
+    magix::i32 operands[3];
+    /** Set value, ROM loads included, the next instruction pointer of exits and yields, or the ExecResult::Type of traps. */
+    magix::u64 value;
+    /** Address of the part, where it traps or runs out of steps. */
+    magix::u16 instruction_pointer;
+};
+
+/** Ops of one decoded instruction, fused instructions have one per part. */
+struct LaneInstruction
+{
+    magix::u32 first_op;
+    magix::u32 op_count;
+    /** Not lane local, all lanes go on alone from here. */
+    bool diverges;
+};
+
+/** Decoded program translated for lockstep execution, shared by all batches. */
+struct LockstepProgram
+{
+    /** Program the ops were translated from, also runs every lane that went on alone. */
+    const DecodedByteCode *decoded = nullptr;
+    /** Per stream index. */
+    std::vector<LaneInstruction> instructions;
+    std::vector<LaneOp> ops;
+
+    /** Whether instances can start at the entry in lockstep, on a stack of the given size. Only verified entries can. */
+    [[nodiscard]] auto
+    can_run(magix::u16 entry, size_t stack_size) const -> bool;
+};
+
+/** Translate every instruction of the decoded program. The program must outlive the result. */
+[[nodiscard]] auto
+lockstep_compile(const DecodedByteCode &program) -> LockstepProgram;
+
+/** Where a lane of a batch stopped. */
+struct LaneExit
+{
+    /** Final result of the lane, unless it diverged. */
+    ExecResult result;
+    /** The lane left the batch, finish() goes on with the state below. */
+    bool diverged;
+    magix::u32 index;
+    size_t stack_pointer;
+    size_t steps;
+};
+
+/** Runs instances of one program that sit at the same entry in lockstep, each lane with its own fork page and stack.
+ * The stacks are kept as structure of arrays, one row of 32 bit words per 4 stack bytes, so u32 arithmetic, moves and
+ * branches are a single AVX2 instruction for all lanes when the CPU has it.
+ * Only effects that stay in the lane happen here. At a branch the lanes that go the other way than most leave the batch, at
+ * any other instruction all do. finish() runs them on alone, calling it for every lane in instance order behaves as if the
+ * instances ran one after another, except that every lane starts on a zeroed stack.
+ */
+class LockstepBatch
+{
+  public:
+    /** Run one lane per fork page, at most lockstep_lane_count, from the entry until each exits, yields, traps or diverges.
+     * The forks must all have the same size and the entry must pass can_run for the stack the lanes finish on.
+     */
+    void
+    run(const LockstepProgram &program, magix::u16 entry, magix::span<const magix::span<std::byte>> forks, size_t steps);
+
+    [[nodiscard]] auto
+    exits() const -> magix::span<const LaneExit>;
+
+    /** Result of the lane, running it on alone on the context's stack if it diverged. The context needs the pages of the lane,
+     * as for execute().
+     */
+    [[nodiscard]] auto
+    finish(size_t lane, ExecutionContext &context) const -> ExecResult;
+
+    /** Whether the lanes run on AVX2, otherwise on plain loops. */
+    [[nodiscard]] static auto
+    uses_avx2() noexcept -> bool;
+
+  private:
+    struct alignas(32) Row
+    {
+        magix::u32 lanes[lockstep_lane_count];
+    };
+
+    template <typename Lanes>
+    void
+    run_lanes(magix::u32 index, magix::span<const magix::span<std::byte>> forks, size_t steps);
+
+    [[nodiscard]] auto
+    lane_byte(size_t lane, size_t address) -> magix::u8 &;
+
+    void
+    leave(size_t lane, magix::u32 index, size_t stack_pointer, size_t steps);
+
+    const LockstepProgram *program = nullptr;
+    size_t stack_bytes = 0;
+    std::vector<Row, AlignedAllocator<Row, alignof(Row)>> rows;
+    std::vector<LaneExit> lane_exits;
+    /** stack_bytes per lane, the stacks of lanes that left. */
+    std::vector<std::byte> diverged_stacks;
+};
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_LOCKSTEP_HPP_
@@ -1,20 +1,30 @@
 #include "magix_vm/execution/runner.hpp"
-#include "godot_cpp/classes/object.hpp"
-#include "godot_cpp/core/object.hpp"
 #include "magix_vm/MagixCaster.hpp"
 #include "magix_vm/compilation/compiled.hpp"
 #include "magix_vm/execution/config.hpp"
 #include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/instance_arena.hpp"
+#include "magix_vm/execution/jit.hpp"
+#include "magix_vm/execution/lockstep.hpp"
+#include "magix_vm/execution/stack_pool.hpp"
+#include "magix_vm/execution/worker_pool.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <utility>
 
 namespace
 {
 
 /** Split the given, raw memory into typed spans. */
 [[nodiscard]] auto
-get_spans(magix::execute::spellmemvec &vec, magix::execute::ExecLayout layout)
+get_spans(magix::span<std::byte> data, magix::execute::ExecLayout layout)
     -> std::pair<magix::span<std::byte>, magix::span<magix::execute::ObjectVariant>>
 {
-    magix::span<std::byte> data(vec);
     auto prim = data.subspan(0, layout.primitive_end);
     auto obj = data.subspan(layout.primitive_end, layout.obj_end).reinterpret_resize<magix::execute::ObjectVariant>();
     return {prim, obj};
@@ -24,87 +34,525 @@ get_spans(magix::execute::spellmemvec &vec, magix::execute::ExecLayout layout)
 auto
 magix::execute::ExecRunner::run_all() -> RunResult
 {
+    drop_gone_casters();
+    wake_sleepers();
 
+    user_slice.clear();
+    for (auto index : magix::ranges::num_range(active_users.size()))
+    {
+        user_slice.push_back(active_users.handle_at(index));
+    }
     RunResult run_result;
+    run_users(user_slice, run_result);
+    settle_ledgers();
+    present_render_buffers();
+    return run_result;
+}
 
-    const auto it_beg = active_users.begin();
-    const auto it_end = active_users.end();
-    for (auto it = it_beg; it != it_end;)
-    {
-        // need to keep next_it around, because we might delete and invalidate it
-        auto next_it = it;
-        ++next_it;
+auto
+magix::execute::ExecRunner::run_budgeted(std::chrono::microseconds budget) -> RunResult
+{
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    drop_gone_casters();
 
-        auto [id, bc] = it->first;
+    // a round ends the call that finishes it, so no user runs twice in one call
+    if (round_cursor == round.size())
+    {
+        wake_sleepers();
+        round.clear();
+        round_cursor = 0;
+        for (auto index : magix::ranges::num_range(active_users.size()))
+        {
+            round.push_back(active_users.handle_at(index));
+        }
+    }
 
-        // if owner somehow died, all spells die
-        MagixCaster *caster = godot::Object::cast_to<MagixCaster>(godot::ObjectDB::get_instance(id));
-        if (caster == nullptr)
+    RunResult run_result;
+    metrics.users_run = 0;
+    do
+    {
+        // as many instances as the rest of the budget likely fits, at least one user
+        const double seconds_left = std::chrono::duration<double>(budget - (clock::now() - start)).count();
+        const double instances_left = std::max(seconds_left / seconds_per_instance, 1.0);
+        size_t slice_instances = 0;
+        user_slice.clear();
+        for (; round_cursor < round.size() && static_cast<double>(slice_instances) < instances_left; ++round_cursor)
         {
-            active_users.erase(it);
-            it = next_it;
-            continue;
+            const PerIDData *per_id = active_users.find(round[round_cursor]);
+            if (per_id == nullptr)
+            {
+                continue;
+            }
+            user_slice.push_back(round[round_cursor]);
+            slice_instances += std::max<size_t>(per_id->instances.size(), 1);
+        }
+        if (user_slice.empty())
+        {
+            break;
         }
 
-        ExecutionContext context{
-            id,
-            caster,
-        };
+        const auto slice_start = clock::now();
+        run_users(user_slice, run_result);
+        const double slice_seconds = std::chrono::duration<double>(clock::now() - slice_start).count();
+        seconds_per_instance += (slice_seconds / static_cast<double>(slice_instances) - seconds_per_instance) * 0.25;
+        metrics.users_run += user_slice.size();
+    } while (round_cursor < round.size() && clock::now() - start < budget);
 
-        PerIDData &per_id = it->second;
+    // casters get back what they did not use by the end of the frame, not of the round
+    settle_ledgers();
+    if (round_cursor == round.size())
+    {
+        present_render_buffers();
+        ++metrics.rounds_completed;
+    }
+    metrics.users_waiting = round.size() - round_cursor;
+    metrics.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start);
+    metrics.overrun = std::max(metrics.elapsed - budget, std::chrono::microseconds{0});
+    if (metrics.overrun.count() > 0)
+    {
+        ++metrics.frames_over_budget;
+        metrics.max_overrun = std::max(metrics.max_overrun, metrics.overrun);
+    }
+    return run_result;
+}
 
-        // no crosstalk between users!
-        reusable_stack->clear();
+auto
+magix::execute::ExecRunner::budget_metrics() const -> const BudgetMetrics &
+{
+    return metrics;
+}
 
-        auto result = per_id.execute(reusable_stack.get(), context);
-        if (result.should_delete)
+void
+magix::execute::ExecRunner::run_users(magix::span<const UserHandle> handles, RunResult &run_result)
+{
+    std::vector<UserRun> &users = user_runs;
+    std::vector<Chunk> &chunks = run_chunks;
+    std::vector<size_t> &parallel = run_parallel;
+    std::vector<size_t> &on_main_thread = run_on_main_thread;
+    users.clear();
+    parallel.clear();
+    on_main_thread.clear();
+    size_t chunk_count = 0;
+    for (const UserHandle &handle : handles)
+    {
+        PerIDData &per_id = *active_users.find(handle);
+        const size_t instance_count = per_id.instances.size();
+        const size_t chunk_size = per_id.can_split() ? instance_chunk_size : std::max<size_t>(instance_count, 1);
+        const bool calls_host = per_id._bytecode->get_decoded().calls_host;
+        ExecutionContext context{per_id.object_id, per_id.caster};
+        if (calls_host && mana_ledger && per_id.caster != nullptr)
         {
-            active_users.erase(it);
+            context.mana_ledger = ledger_for(per_id.caster);
         }
+        const size_t first_chunk = chunk_count;
+        for (size_t first = 0; first < instance_count; first += chunk_size)
+        {
+            (calls_host ? on_main_thread : parallel).push_back(chunk_count);
+            if (chunk_count == chunks.size())
+            {
+                chunks.push_back(Chunk{nullptr, 0, 0, context});
+            }
+            Chunk &chunk = chunks[chunk_count++];
+            // keeps what the chunk drew last time as room for this one
+            std::vector<magix::f32> render_output = std::move(chunk.context.render_output);
+            render_output.clear();
+            chunk = Chunk{&per_id, first, std::min(first + chunk_size, instance_count), context};
+            chunk.context.render_output = std::move(render_output);
+        }
+        users.push_back(UserRun{handle, first_chunk, chunk_count});
+    }
 
+    // chunks only touch the instances they run, their user's memory if it is not split and the stacks and scratch of their
+    // worker
+    std::vector<PerIDRangeResult> &results = run_results;
+    results.assign(chunk_count, PerIDRangeResult{});
+    auto run_chunk = [&](size_t worker, size_t index) {
+        Chunk &chunk = chunks[index];
+        const compile::ByteCodeRaw &code = chunk.per_id->_bytecode->get_code();
+        ExecStack &stack = stack_pools[worker].acquire(code.stack_size, code.obj_count);
+        results[index] = chunk.per_id->execute_range(chunk.first, chunk.last, &stack, chunk.context, range_scratch[worker]);
+    };
+    workers->run(parallel.size(), [&](size_t worker, size_t index) { run_chunk(worker, parallel[index]); });
+    for (size_t index : on_main_thread)
+    {
+        run_chunk(0, index);
+    }
+
+    for (const UserRun &user : users)
+    {
 #ifdef MAGIX_BUILD_TESTS
-        run_result.test_records.emplace_back(std::move(context.test_output));
+        // a trap ends the user, what later chunks did is as if it never ran
+        std::vector<PrimitiveUnion> &output = run_result.test_records.emplace_back();
+        for (auto index : magix::ranges::num_range(user.first_chunk, user.last_chunk))
+        {
+            output.insert(output.end(), chunks[index].context.test_output.begin(), chunks[index].context.test_output.end());
+            if (results[index].trapped)
+            {
+                break;
+            }
+        }
 #endif
+        PerIDData &per_id = *active_users.find(user.handle);
+        const auto user_results = magix::span<PerIDRangeResult>(results).subspan(user.first_chunk, user.last_chunk);
+        auto result = per_id.finish(user_results);
+        if (result.should_delete)
+        {
+            erase_user(user.handle);
+            continue;
+        }
+        for (auto index : magix::ranges::num_range(user.first_chunk, user.last_chunk))
+        {
+            const std::vector<magix::f32> &drawn = chunks[index].context.render_output;
+            if (!drawn.empty())
+            {
+                std::vector<magix::f32> &buffer = render_drawing[per_id._bytecode.ptr()];
+                buffer.insert(buffer.end(), drawn.begin(), drawn.end());
+            }
+        }
+        if (std::any_of(user_results.begin(), user_results.end(), [](const PerIDRangeResult &range) { return range.requests != 0; }))
+        {
+            queue_host_calls(per_id);
+        }
+        for (PerInstanceData &instance : per_id.falling_asleep)
+        {
+            sleepers.schedule(instance.sleep_ticks, Sleeper{user.handle, instance});
+        }
+        per_id.sleeping += per_id.falling_asleep.size();
+        per_id.falling_asleep.clear();
+    }
+    dispatch_host_calls();
+}
 
-        // next_it is valid, even if it invalidated
-        it = next_it;
+void
+magix::execute::ExecRunner::queue_host_calls(PerIDData &per_id)
+{
+    for (std::vector<PerInstanceData> *list : {&per_id.instances, &per_id.falling_asleep})
+    {
+        for (PerInstanceData &instance : *list)
+        {
+            if (instance.host_request)
+            {
+                magix::span<std::byte> fork = get_spans(instance.memory, per_id.local_layout).first;
+                const size_t record = instance.host_request->record;
+                host_calls.push_back(HostCall{instance.host_request->kind, fork.subspan(record, record + host_request_record_size), per_id.caster});
+                instance.host_request.reset();
+            }
+        }
     }
+}
 
-    return run_result;
+void
+magix::execute::ExecRunner::dispatch_host_calls()
+{
+    std::stable_sort(host_calls.begin(), host_calls.end(), [](const HostCall &lhs, const HostCall &rhs) { return lhs.kind < rhs.kind; });
+    for (size_t begin = 0; begin < host_calls.size();)
+    {
+        size_t end = begin;
+        while (end < host_calls.size() && host_calls[end].kind == host_calls[begin].kind)
+        {
+            ++end;
+        }
+        if (host_call_handler)
+        {
+            host_call_handler(host_calls[begin].kind, magix::span<HostCall>(host_calls).subspan(begin, end));
+        }
+        begin = end;
+    }
+    host_calls.clear();
+}
+
+void
+magix::execute::ExecRunner::present_render_buffers()
+{
+    std::swap(render_drawing, render_presented);
+    // programs that drew nothing for two ticks are forgotten, the others keep their capacity
+    for (auto it = render_drawing.begin(); it != render_drawing.end();)
+    {
+        if (it->second.empty())
+        {
+            it = render_drawing.erase(it);
+            continue;
+        }
+        it->second.clear();
+        ++it;
+    }
+}
+
+auto
+magix::execute::ExecRunner::render_buffer(const MagixByteCode *bytecode) const -> magix::span<const magix::f32>
+{
+    auto find = render_presented.find(bytecode);
+    if (find == render_presented.end())
+    {
+        return {};
+    }
+    return magix::span<const magix::f32>(find->second);
 }
 
 void
+magix::execute::ExecRunner::wake_sleepers()
+{
+    sleepers.advance([this](Sleeper &&sleeper) {
+        PerIDData *per_id = active_users.find(sleeper.user);
+        if (per_id == nullptr)
+        {
+            return;
+        }
+        --per_id->sleeping;
+        per_id->instances.push_back(sleeper.instance);
+        per_id->keep.push_back(PerIDData::Keep::NO);
+    });
+}
+
+auto
 magix::execute::ExecRunner::enqueue_cast_spell(magix::MagixCaster *caster, godot::Ref<MagixByteCode> bytecode, magix::u16 entry)
+    -> UserHandle
 {
     const compile::ByteCodeRaw *bc = &bytecode->get_code();
     const auto id = caster ? caster->get_instance_id() : 0;
-    auto [it, is_new] = active_users.try_emplace({id, bc}, id, std::move(bytecode));
-    PerIDData &data = it->second;
+    auto [it, is_new] = user_handles.try_emplace({id, bc});
+    if (is_new)
+    {
+        it->second = active_users.emplace(id, std::move(bytecode));
+        active_users.find(it->second)->caster = caster;
+        if (caster == nullptr)
+        {
+            // as good as gone
+            gone_casters.push_back(id);
+        }
+        else if (registered_casters.insert(caster).second)
+        {
+            caster->register_runner(this);
+        }
+    }
+    const UserHandle handle = it->second;
+    PerIDData &data = *active_users.find(handle);
 
     if (data.free_invocation_count() == 0)
     {
         // OOM kill
         // TODO: proper notification!
-        active_users.erase(it);
-        return;
+        erase_user(handle);
+        return UserHandle{};
     }
 
     data.enqueue(entry);
+    return handle;
+}
+
+auto
+magix::execute::ExecRunner::find_user(UserHandle handle) const -> const PerIDData *
+{
+    return active_users.find(handle);
+}
+
+void
+magix::execute::ExecRunner::caster_gone(MagixCaster *caster)
+{
+    gone_casters.push_back(caster->get_instance_id());
+    registered_casters.erase(caster);
+    if (auto found = ledgers.find(caster); found != ledgers.end())
+    {
+        if (found->second)
+        {
+            caster->settle_mana(found->second->reserved, found->second->used);
+        }
+        ledgers.erase(found);
+    }
+}
+
+auto
+magix::execute::ExecRunner::ledger_for(MagixCaster *caster) -> ManaLedger *
+{
+    std::optional<ManaLedger> &ledger = ledgers[caster];
+    if (!ledger)
+    {
+        ledger.emplace();
+        ledger->reserved = caster->reserve_mana();
+    }
+    return &*ledger;
+}
+
+void
+magix::execute::ExecRunner::settle_ledgers()
+{
+    for (auto &[caster, ledger] : ledgers)
+    {
+        if (ledger)
+        {
+            caster->settle_mana(ledger->reserved, ledger->used);
+            ledger.reset();
+        }
+    }
+}
+
+void
+magix::execute::ExecRunner::drop_gone_casters()
+{
+    if (gone_casters.empty())
+    {
+        return;
+    }
+    std::sort(gone_casters.begin(), gone_casters.end());
+    for (size_t index = 0; index < active_users.size();)
+    {
+        if (std::binary_search(gone_casters.begin(), gone_casters.end(), active_users.values()[index].object_id))
+        {
+            // the last user moves to this index
+            erase_user(active_users.handle_at(index));
+        }
+        else
+        {
+            ++index;
+        }
+    }
+    gone_casters.clear();
+}
+
+void
+magix::execute::ExecRunner::unregister_casters()
+{
+    for (MagixCaster *caster : registered_casters)
+    {
+        caster->unregister_runner(this);
+    }
+    registered_casters.clear();
 }
+
+void
+magix::execute::ExecRunner::erase_user(UserHandle handle)
+{
+    if (const PerIDData *user = active_users.find(handle))
+    {
+        user_handles.erase({user->object_id, &user->_bytecode->get_code()});
+        active_users.erase(handle);
+    }
+}
+
+auto
+magix::execute::PerIDData::can_split() const -> bool
+{
+    const compile::ByteCodeRaw &code = _bytecode->get_code();
+    return code.shared_size == 0 && code.obj_shared_count == 0 && !_bytecode->get_decoded().calls_host;
+}
+
 auto
 magix::execute::PerIDData::execute(ExecStack *stack, ExecutionContext &context) -> PerIDExecResult
 {
-    const auto max_invoc = max_invoc_count();
-    std::vector<PerInstanceData> new_invocations;
+    RangeScratch scratch;
+    PerIDRangeResult range = execute_range(0, instances.size(), stack, context, scratch);
+    return finish(magix::span_of(range));
+}
+
+auto
+magix::execute::PerIDData::finish(magix::span<PerIDRangeResult> ranges) -> PerIDExecResult
+{
+    size_t kept_count = 0;
+    for (const PerIDRangeResult &range : ranges)
+    {
+        if (range.trapped)
+        {
+            return PerIDExecResult{true};
+        }
+        kept_count += range.kept;
+    }
+    if (kept_count + sleeping > max_invoc_count())
+    {
+        // OOM kill
+        return PerIDExecResult{true};
+    }
+
+    next_instances.clear();
+    for (auto index : magix::ranges::num_range(instances.size()))
+    {
+        switch (keep[index])
+        {
+        case Keep::NO:
+            instance_memory.release(instances[index].memory);
+            break;
+        case Keep::NEXT_TICK:
+            next_instances.push_back(instances[index]);
+            break;
+        case Keep::ASLEEP:
+            falling_asleep.push_back(instances[index]);
+            break;
+        }
+    }
+    std::swap(instances, next_instances);
+    keep.assign(instances.size(), Keep::NO);
+    return PerIDExecResult{false};
+}
+
+auto
+magix::execute::PerIDData::execute_range(
+    size_t first, size_t last, ExecStack *stack, ExecutionContext &context, RangeScratch &scratch
+) -> PerIDRangeResult
+{
+    PerIDRangeResult out;
 
     auto [prim_shared, obj_shared] = get_spans(global_memory, global_layout);
-    for (auto &instance : instances)
+    // the stack may be of a larger size class, the program still only gets what it asked for
+    const compile::ByteCodeRaw &code = _bytecode->get_code();
+    const size_t stack_size = std::min<size_t>(code.stack_size, stack->stack.size());
+    const size_t object_count = std::min<size_t>(code.obj_count, stack->objbank.size());
+
+    // instances at the same entry start in lockstep, the lanes only touch their own stack and fork, so finishing them in
+    // order below is the same as running them one after another
+    const LockstepProgram &lockstep = _bytecode->get_lockstep();
+    std::vector<LockstepBatch> &batches = scratch.batches;
+    size_t batch_count = 0;
+    std::vector<std::pair<size_t, size_t>> &batch_lanes = scratch.batch_lanes;
+    batch_lanes.assign(last - first, {SIZE_MAX, 0});
+    std::vector<size_t> &by_entry = scratch.by_entry;
+    by_entry.resize(last - first);
+    std::iota(by_entry.begin(), by_entry.end(), first);
+    // ties by index, as stable as stable_sort without its buffer
+    std::sort(by_entry.begin(), by_entry.end(), [&](size_t lhs, size_t rhs) {
+        return std::pair{instances[lhs].entry, lhs} < std::pair{instances[rhs].entry, rhs};
+    });
+    for (size_t group_begin = 0; group_begin < by_entry.size();)
     {
+        const magix::u16 entry = instances[by_entry[group_begin]].entry;
+        size_t group_end = group_begin;
+        while (group_end < by_entry.size() && instances[by_entry[group_end]].entry == entry)
+        {
+            ++group_end;
+        }
+        if (group_end - group_begin >= lockstep_min_instances && lockstep.can_run(entry, stack_size))
+        {
+            for (size_t lane_start = group_begin; lane_start < group_end; lane_start += lockstep_lane_count)
+            {
+                const size_t lane_end = std::min(group_end, lane_start + lockstep_lane_count);
+                magix::span<std::byte> forks[lockstep_lane_count];
+                for (auto index : magix::ranges::num_range(lane_start, lane_end))
+                {
+                    forks[index - lane_start] = get_spans(instances[by_entry[index]].memory, local_layout).first;
+                    batch_lanes[by_entry[index] - first] = {batch_count, index - lane_start};
+                }
+                if (batch_count == batches.size())
+                {
+                    batches.emplace_back();
+                }
+                LockstepBatch &batch = batches[batch_count++];
+                batch.run(lockstep, entry, magix::span<const magix::span<std::byte>>(forks, lane_end - lane_start), 100);
+            }
+        }
+        group_begin = group_end;
+    }
+
+    for (auto instance_index : magix::ranges::num_range(first, last))
+    {
+        auto &instance = instances[instance_index];
         auto [prim_fork, obj_fork] = get_spans(instance.memory, local_layout);
-        context.page_info = {stack, array_size(stack->stack), array_size(stack->objbank), prim_shared, prim_fork, obj_fork, obj_shared};
+        context.page_info = {stack, stack_size, object_count, prim_shared, prim_fork, obj_fork, obj_shared};
         context.bound_mana = instance.bound_mana;
+        context.sleep_ticks = 0;
+        context.host_request.reset();
 
-        auto result = magix::execute::execute(_bytecode->get_code(), instance.entry, 100, context);
+        const auto [batch, lane] = batch_lanes[instance_index - first];
+        auto result = batch != SIZE_MAX ? batches[batch].finish(lane, context)
+                                        : magix::execute::execute(_bytecode->get_jit(), instance.entry, 100, context);
         switch (result.type)
         {
         case ExecResult::Type::OK_EXIT:
@@ -114,40 +562,42 @@ magix::execute::PerIDData::execute(ExecStack *stack, ExecutionContext &context)
         }
         case ExecResult::Type::OK_YIELD:
         {
-            if (new_invocations.size() >= max_invoc)
-            {
-                // OOM kill
-                return PerIDExecResult{true};
-            }
-            magix::f32 left_mana = context.bound_mana - maintenance_cost;
+            // the upkeep of every tick slept is paid up front
+            const magix::u32 ticks = std::max<magix::u32>(context.sleep_ticks, 1);
+            magix::f32 left_mana = context.bound_mana - maintenance_cost * static_cast<magix::f32>(ticks);
             if (left_mana >= 0.0)
             {
                 instance.bound_mana = left_mana;
                 instance.entry = result.instruction_pointer;
-                new_invocations.emplace_back(std::move(instance));
+                instance.sleep_ticks = ticks;
+                instance.host_request = context.host_request;
+                keep[instance_index] = ticks > 1 ? Keep::ASLEEP : Keep::NEXT_TICK;
+                ++out.kept;
+                out.requests += context.host_request.has_value() ? 1 : 0;
             }
             break;
         }
         default:
             // traps
-            return PerIDExecResult{true};
+            out.trapped = true;
+            return out;
         }
     }
-    instances = std::move(new_invocations);
-    return PerIDExecResult{false};
+    return out;
 }
 
 auto
 magix::execute::PerIDData::enqueue(magix::u16 entry) -> void
 {
-    instances.emplace_back(local_layout, entry);
+    instances.emplace_back(instance_memory.allocate(), entry);
+    keep.push_back(Keep::NO);
 }
 
 auto
 magix::execute::PerIDData::free_invocation_count() const -> size_t
 {
     size_t max_instances = max_invoc_count();
-    size_t instance_count = instances.size();
+    size_t instance_count = instances.size() + sleeping;
     if (max_instances < instance_count)
     {
         return 0;
@@ -179,6 +629,7 @@ magix::execute::PerIDData::PerIDData(object_id_type id, godot::Ref<MagixByteCode
     auto &code = _bytecode->get_code();
     global_layout = ExecLayout(code.shared_size, code.obj_shared_count);
     local_layout = ExecLayout(code.fork_size, code.obj_fork_count);
+    instance_memory = InstanceArena(local_layout.total_size());
     if (max_invoc_count() > 0)
     {
         global_memory.resize(global_layout.total_size());
@@ -188,4 +639,63 @@ void
 magix::execute::ExecRunner::clear()
 {
     active_users.clear();
+    user_handles.clear();
+    gone_casters.clear();
+    round.clear();
+    round_cursor = 0;
+    sleepers.clear();
+    render_drawing.clear();
+    render_presented.clear();
+    settle_ledgers();
+    unregister_casters();
+}
+
+magix::execute::ExecRunner::~ExecRunner()
+{
+    settle_ledgers();
+    unregister_casters();
+}
+
+void
+magix::execute::ExecRunner::set_worker_count(size_t count)
+{
+    if (count == 0)
+    {
+        count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    if (count == workers->worker_count())
+    {
+        return;
+    }
+    workers = std::make_unique<WorkerPool>(count);
+    stack_pools.resize(count);
+    range_scratch.resize(count);
+}
+
+auto
+magix::execute::ExecRunner::get_worker_count() const -> size_t
+{
+    return workers->worker_count();
+}
+
+void
+magix::execute::ExecRunner::set_mana_ledger(bool enabled)
+{
+    if (!enabled)
+    {
+        settle_ledgers();
+    }
+    mana_ledger = enabled;
+}
+
+auto
+magix::execute::ExecRunner::get_mana_ledger() const -> bool
+{
+    return mana_ledger;
+}
+
+void
+magix::execute::ExecRunner::set_host_call_handler(HostCallHandler handler)
+{
+    host_call_handler = std::move(handler);
 }
@@ -8,11 +8,23 @@
 #include "magix_vm/compilation/compiled.hpp"
 #include "magix_vm/execution/config.hpp"
 #include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/instance_arena.hpp"
+#include "magix_vm/execution/lockstep.hpp"
+#include "magix_vm/execution/stack_pool.hpp"
+#include "magix_vm/execution/worker_pool.hpp"
+#include "magix_vm/slot_map.hpp"
+#include "magix_vm/span.hpp"
+#include "magix_vm/timer_wheel.hpp"
 #include "magix_vm/types.hpp"
 #include "magix_vm/utility.hpp"
 
+#include <chrono>
 #include <cstddef>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace magix::execute
@@ -55,11 +67,16 @@ using spellmemvec = std::vector<std::byte, AlignedAllocator<std::byte, 64>>;
 
 struct PerInstanceData
 {
-    PerInstanceData(ExecLayout layout, magix::u16 entry) : entry(entry), memory(layout.total_size(), std::byte{}) {}
+    PerInstanceData(magix::span<std::byte> memory, magix::u16 entry) : entry(entry), memory(memory) {}
 
     magix::u16 entry;
     magix::f32 bound_mana = 0.0;
-    spellmemvec memory;
+    /** Ticks until it runs again, set when it goes to sleep. */
+    magix::u32 sleep_ticks = 0;
+    /** Made before the last yield, not yet handed to the runner. */
+    std::optional<HostRequest> host_request;
+    /** Block of the instance arena of the user, local_layout sized. */
+    magix::span<std::byte> memory;
 };
 
 struct PerIDExecResult
@@ -67,13 +84,46 @@ struct PerIDExecResult
     bool should_delete;
 };
 
+/** What running a range of the instances of one user left behind. */
+struct PerIDRangeResult
+{
+    /** Instances that yielded and could pay the upkeep, asleep or not, they are marked in PerIDData::keep. */
+    size_t kept = 0;
+    /** An instance trapped, the rest of the range did not run. */
+    bool trapped = false;
+    /** Kept instances with a host_request. */
+    size_t requests = 0;
+};
+
+/** Buffers execute_range() works in, one per worker, so running a range does not allocate once they are large enough. */
+struct RangeScratch
+{
+    /** Batches of the last range and spares, each keeps its buffers for the next batch run in it. */
+    std::vector<LockstepBatch> batches;
+    /** Per instance of the range, its batch and lane, SIZE_MAX if it runs alone. */
+    std::vector<std::pair<size_t, size_t>> batch_lanes;
+    /** Instances of the range, by entry. */
+    std::vector<size_t> by_entry;
+};
+
 struct PerIDData
 {
+    /** What becomes of an instance after a run. */
+    enum class Keep : magix::u8
+    {
+        NO,
+        NEXT_TICK,
+        /** Until its sleep_ticks are over, the runner holds it meanwhile. */
+        ASLEEP,
+    };
+
     object_id_type object_id;
     ExecLayout global_layout;
     ExecLayout local_layout;
 
     godot::Ref<MagixByteCode> _bytecode;
+    /** Valid until the runner is told the caster is gone, null if it never had one. */
+    MagixCaster *caster = nullptr;
 
     PerIDData(object_id_type id, godot::Ref<MagixByteCode> bytecode);
 
@@ -86,20 +136,78 @@ struct PerIDData
     auto
     enqueue(magix::u16 entry) -> void;
 
+    /** Whether ranges of the instances may run on several threads at once. Not if the program has a shared page, then every
+     * instance sees the writes of those before it, or calls back into Godot.
+     */
+    [[nodiscard]] auto
+    can_split() const -> bool;
+
+    /** Run every instance, in order. */
     auto
     execute(ExecStack *stack, ExecutionContext &context) -> PerIDExecResult;
 
+    /** Run the instances from first to last, in order, marking those that go on in keep. Ranges may run at the same time if
+     * can_split(), they only touch their own instances.
+     */
+    [[nodiscard]] auto
+    execute_range(size_t first, size_t last, ExecStack *stack, ExecutionContext &context, RangeScratch &scratch) -> PerIDRangeResult;
+
+    /** Drop the instances the ranges did not keep and move those that fell asleep to falling_asleep, the ranges must cover all
+     * instances.
+     */
+    auto
+    finish(magix::span<PerIDRangeResult> ranges) -> PerIDExecResult;
+
     spellmemvec global_memory;
+    InstanceArena instance_memory;
     std::vector<PerInstanceData> instances;
+    /** Per instance, whether it goes on after this run. A byte each, so ranges on several threads write apart. */
+    std::vector<Keep> keep;
+    /** Left by finish() for the runner to put to sleep. */
+    std::vector<PerInstanceData> falling_asleep;
+    /** Instances the runner holds until they wake, they count against the memory limit. */
+    size_t sleeping = 0;
+    /** Spare instance list finish() fills and swaps in, so neither list allocates once they are large enough. */
+    std::vector<PerInstanceData> next_instances;
+};
+
+/** Names the user of one program by one caster. */
+using UserHandle = magix::SlotHandle;
+
+/** A host_request of one instance as its handler sees it. */
+struct HostCall
+{
+    magix::u16 kind;
+    /** host_request_record_size bytes of the fork page of the instance, valid until the handler returns. */
+    magix::span<std::byte> record;
+    /** Null if the spell has no caster. */
+    MagixCaster *caster;
 };
 
 class ExecRunner
 {
   public:
-    ExecRunner() : reusable_stack(std::make_unique<ExecStack>()) {}
+    ExecRunner() = default;
+    ~ExecRunner();
 
+    /** Casters point back at the runner. */
+    ExecRunner(const ExecRunner &) = delete;
+    auto
+    operator=(const ExecRunner &) -> ExecRunner & = delete;
+
+    /** Start an instance of the program at the entry, for the caster. Casts of the same program by the same caster share a
+     * user. Returns an invalid handle if the user ran out of memory and was killed.
+     */
+    auto
+    enqueue_cast_spell(magix::MagixCaster *caster, godot::Ref<MagixByteCode> bytecode, magix::u16 entry) -> UserHandle;
+
+    /** The user, until it is killed or its caster is gone. */
+    [[nodiscard]] auto
+    find_user(UserHandle handle) const -> const PerIDData *;
+
+    /** Called by a caster that is about to be deleted, its users are dropped by the next run. */
     void
-    enqueue_cast_spell(magix::MagixCaster *caster, godot::Ref<MagixByteCode> bytecode, magix::u16 entry);
+    caster_gone(MagixCaster *caster);
 
     struct RunResult
     {
@@ -108,15 +216,182 @@ class ExecRunner
 #endif
     };
 
+    /** Run every user once, after waking the instances whose sleep is over. Users, or chunks of the instances of one if it can_split(), are spread over the workers. The
+     * records come in the same order for any worker count.
+     */
     [[nodiscard]] auto
     run_all() -> RunResult;
 
+    /** How run_budgeted() keeps up. The first four are about the last call, the rest add up over the life of the runner. */
+    struct BudgetMetrics
+    {
+        size_t users_run = 0;
+        /** Users of the current round that did not run yet, they go first in the next call. */
+        size_t users_waiting = 0;
+        std::chrono::microseconds elapsed{0};
+        /** How far the call went past its budget. */
+        std::chrono::microseconds overrun{0};
+        size_t frames_over_budget = 0;
+        std::chrono::microseconds max_overrun{0};
+        /** Rounds in which every user ran once. */
+        size_t rounds_completed = 0;
+    };
+
+    /** Run users for about the given time, going on where the last call stopped. Users run in rounds: each user there is when a
+     * round starts runs once before any runs again, new users wait for the next round. A round is one tick for sleeping
+     * instances. A call runs at least one user and never one twice, it goes past the budget by at most the slice of users it
+     * started last.
+     */
+    [[nodiscard]] auto
+    run_budgeted(std::chrono::microseconds budget) -> RunResult;
+
+    [[nodiscard]] auto
+    budget_metrics() const -> const BudgetMetrics &;
+
     void
     clear();
 
+    /** Threads run_all() runs users on, the calling thread included, 0 for one per hardware thread. Programs that call back into
+     * Godot always run on the calling thread.
+     */
+    void
+    set_worker_count(size_t count);
+
+    [[nodiscard]] auto
+    get_worker_count() const -> size_t;
+
+    /** Whether allocate_mana draws from mana each caster reserves once per tick, instead of asking the caster every time. What
+     * is left goes back to the casters in one call each at the end of the tick, every call for run_budgeted(), so a round that
+     * spans frames does not hold on to it.
+     */
+    void
+    set_mana_ledger(bool enabled);
+
+    [[nodiscard]] auto
+    get_mana_ledger() const -> bool;
+
+    using HostCallHandler = std::function<void(magix::u16 kind, magix::span<HostCall> calls)>;
+
+    /** Answers the host_requests, called on the calling thread after the users ran, once for each kind with every request of
+     * it. Records of requests without a handler are left as they are.
+     */
+    void
+    set_host_call_handler(HostCallHandler handler);
+
+    /** What the instances of every user of the program drew with render.push in the last tick, a round for run_budgeted(),
+     * in the order they ran. render_item_floats per item, valid until the next tick ends.
+     */
+    [[nodiscard]] auto
+    render_buffer(const MagixByteCode *bytecode) const -> magix::span<const magix::f32>;
+
   private:
-    std::unique_ptr<ExecStack> reusable_stack;
-    std::unordered_map<std::pair<object_id_type, const compile::ByteCodeRaw *>, PerIDData, magix::pair_hash> active_users;
+    std::unique_ptr<WorkerPool> workers = std::make_unique<WorkerPool>();
+    /** One per worker, so no two threads share a stack. */
+    std::vector<ExecStackPool> stack_pools = std::vector<ExecStackPool>(1);
+    /** One per worker, like the stacks. */
+    std::vector<RangeScratch> range_scratch = std::vector<RangeScratch>(1);
+    /** Run the given users once, they must be alive and distinct. */
+    void
+    run_users(magix::span<const UserHandle> handles, RunResult &run_result);
+
+    void
+    erase_user(UserHandle handle);
+
+    /** Take the requests of the instances of the user that yielded with one. */
+    void
+    queue_host_calls(PerIDData &per_id);
+
+    /** Call the handler once per kind, requests of a kind in the order their instances ran. */
+    void
+    dispatch_host_calls();
+
+    /** The ledger of the caster for this tick, reserved on first use. */
+    [[nodiscard]] auto
+    ledger_for(MagixCaster *caster) -> ManaLedger *;
+
+    /** End the tick for every ledger. */
+    void
+    settle_ledgers();
+
+    /** End the tick for the render buffers, what was drawn in it can be read until the next one ends. */
+    void
+    present_render_buffers();
+
+    /** Move time on by one tick and give the instances that wake back to their users. */
+    void
+    wake_sleepers();
+
+    /** Erase the users of gone casters, in one pass over all users. */
+    void
+    drop_gone_casters();
+
+    void
+    unregister_casters();
+
+    /** Scanned in order every tick. */
+    magix::SlotMap<PerIDData> active_users;
+    /** Only needed to find the user a cast joins. */
+    std::unordered_map<std::pair<object_id_type, const compile::ByteCodeRaw *>, UserHandle, magix::pair_hash> user_handles;
+    /** Casters that will tell this runner when they are gone. */
+    std::unordered_set<MagixCaster *> registered_casters;
+    /** Object ids of gone casters whose users are not dropped yet. */
+    std::vector<object_id_type> gone_casters;
+
+    /** Users of the current round of run_budgeted(), those from round_cursor on did not run yet. */
+    std::vector<UserHandle> round;
+    size_t round_cursor = 0;
+    /** Moving average, sizes the slices of run_budgeted(). */
+    double seconds_per_instance = 1e-6;
+    BudgetMetrics metrics;
+
+    struct Sleeper
+    {
+        UserHandle user;
+        /** Its memory is in the arena of the user, so it is dropped unseen if the user is gone. */
+        PerInstanceData instance;
+    };
+    /** Instances waiting for their sleep_ticks, untouched until then. */
+    magix::TimerWheel<Sleeper> sleepers;
+
+    HostCallHandler host_call_handler;
+    /** Requests of this run, handed over after every user ran. */
+    std::vector<HostCall> host_calls;
+
+    /** Drawn in the current tick and the last one, by program. Entries are kept while drawn to, so their lists do not allocate
+     * every tick.
+     */
+    std::unordered_map<const MagixByteCode *, std::vector<magix::f32>> render_drawing;
+    std::unordered_map<const MagixByteCode *, std::vector<magix::f32>> render_presented;
+
+    bool mana_ledger = false;
+    /** Elements keep their address, the contexts of a tick point at them. Empty for casters that reserved nothing this tick, kept
+     * until the caster is gone so a tick does not allocate.
+     */
+    std::unordered_map<MagixCaster *, std::optional<ManaLedger>> ledgers;
+
+    /** A range of the instances of one user, as run_users() hands it to a worker. */
+    struct Chunk
+    {
+        PerIDData *per_id;
+        size_t first;
+        size_t last;
+        ExecutionContext context;
+    };
+    /** The chunks of one user in run_users(). */
+    struct UserRun
+    {
+        UserHandle handle;
+        size_t first_chunk;
+        size_t last_chunk;
+    };
+    /** What run_users() works in, kept between runs so a tick does not allocate. Chunks past those of the run are spare. */
+    std::vector<UserRun> user_runs;
+    std::vector<Chunk> run_chunks;
+    std::vector<size_t> run_parallel;
+    std::vector<size_t> run_on_main_thread;
+    std::vector<PerIDRangeResult> run_results;
+    /** The users run_all() or a slice of run_budgeted() hands to run_users(). */
+    std::vector<UserHandle> user_slice;
 };
 
 } // namespace magix::execute
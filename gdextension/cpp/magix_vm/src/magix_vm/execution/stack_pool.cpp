@@ -0,0 +1,70 @@
+#include "magix_vm/execution/stack_pool.hpp"
+#include "magix_vm/execution/config.hpp"
+#include "magix_vm/execution/executor.hpp"
+
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+
+/** Smallest power of two multiple of min that holds size, at most max. */
+[[nodiscard]] auto
+size_class(size_t size, size_t min, size_t max) noexcept -> size_t
+{
+    size_t out = min;
+    while (out < size && out < max)
+    {
+        out *= 2;
+    }
+    return std::min(out, max);
+}
+
+/** Index of a size class among those of size_class(). */
+[[nodiscard]] auto
+class_index(size_t size_class, size_t min) noexcept -> size_t
+{
+    size_t out = 0;
+    for (size_t size = min; size < size_class; size *= 2)
+    {
+        ++out;
+    }
+    return out;
+}
+
+} // namespace
+
+auto
+magix::execute::ExecStackPool::stack_size_class(size_t stack_size) noexcept -> size_t
+{
+    return size_class(stack_size, stack_size_class_min, stack_size_default);
+}
+
+auto
+magix::execute::ExecStackPool::objbank_size_class(size_t object_count) noexcept -> size_t
+{
+    return size_class(object_count, objbank_size_class_min, objbank_size_default);
+}
+
+auto
+magix::execute::ExecStackPool::acquire(size_t stack_size, size_t object_count) -> ExecStack &
+{
+    const size_t stack_class = stack_size_class(stack_size);
+    const size_t objbank_class = objbank_size_class(object_count);
+    const size_t objbank_classes = class_index(objbank_size_default, objbank_size_class_min) + 1;
+    const size_t stack_index = class_index(stack_class, stack_size_class_min);
+    const size_t index = stack_index * objbank_classes + class_index(objbank_class, objbank_size_class_min);
+    if (stacks.size() <= index)
+    {
+        stacks.resize(index + 1);
+    }
+
+    std::unique_ptr<ExecStack> &stack = stacks[index];
+    if (!stack)
+    {
+        stack = std::make_unique<ExecStack>(stack_class, objbank_class);
+    }
+    // no crosstalk between users! only zeroes what the last one may have written
+    stack->clear();
+    return *stack;
+}
@@ -0,0 +1,39 @@
+#ifndef MAGIX_EXECUTION_STACK_POOL_HPP_
+#define MAGIX_EXECUTION_STACK_POOL_HPP_
+
+#include "magix_vm/execution/executor.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace magix::execute
+{
+
+/** Stacks of power of two size classes, reused from one user to the next, so small programs run on small, cache resident stacks.
+ */
+class ExecStackPool
+{
+  public:
+    /** A cleared stack at least as large as asked for, up to the defaults. Owned by the pool and handed out again by the next
+     * acquire of the same size class.
+     */
+    [[nodiscard]] auto
+    acquire(size_t stack_size, size_t object_count) -> ExecStack &;
+
+    /** Stack bytes of the size class of a program asking for stack_size. */
+    [[nodiscard]] static auto
+    stack_size_class(size_t stack_size) noexcept -> size_t;
+
+    /** Objbank slots of the size class of a program asking for object_count. */
+    [[nodiscard]] static auto
+    objbank_size_class(size_t object_count) noexcept -> size_t;
+
+  private:
+    /** By stack size class, then objbank size class, created on first use. */
+    std::vector<std::unique_ptr<ExecStack>> stacks;
+};
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_STACK_POOL_HPP_
@@ -0,0 +1,89 @@
+#ifndef MAGIX_EXECUTION_STENCILS_HPP_
+#define MAGIX_EXECUTION_STENCILS_HPP_
+
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/span.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+
+namespace magix::execute
+{
+
+/** Everything native code needs from the host. The jit keeps a pointer to this in r15 and passes it to every stencil. */
+struct JitFrame
+{
+    std::byte *stack;
+    size_t stack_size;
+    size_t steps;
+    std::byte *primitive_fork;
+    size_t primitive_fork_size;
+    std::byte *primitive_shared;
+    size_t primitive_shared_size;
+    const DecodedByteCode *program;
+    ExecutionContext *context;
+};
+
+/** Native code returns ExecResults packed as (type + 1) << 16 | instruction pointer, so that 0 can mean "go on". */
+constexpr auto
+pack_result(ExecResult::Type type, magix::u16 instruction_pointer) -> magix::u32
+{
+    return ((static_cast<magix::u32>(type) + 1) << 16) | instruction_pointer;
+}
+
+constexpr auto
+unpack_result(magix::u32 packed) -> ExecResult
+{
+    return ExecResult{
+        static_cast<magix::u16>(packed & 0xFFFF),
+        static_cast<ExecResult::Type>((packed >> 16) - 1),
+    };
+}
+
+/** A place in a stencil that is patched when translating, with a value only known then. */
+struct StencilHole
+{
+    enum class Value : magix::u8
+    {
+        /** Operand word of the instruction, as it is in the raw bytecode. */
+        OPERAND,
+        INSTRUCTION_POINTER,
+        MEMCPY,
+        MEMMOVE,
+        MEMSET,
+    };
+
+    /** How the relocation is written, named after the x86-64 ELF relocations. */
+    enum class Patch : magix::u8
+    {
+        ABSOLUTE_32,
+        ABSOLUTE_32_SIGNED,
+        ABSOLUTE_64,
+        RELATIVE_32,
+    };
+
+    magix::u32 offset;
+    Value value;
+    Patch patch;
+    magix::u8 operand;
+    magix::i32 addend;
+};
+
+/** Machine code of one instruction, cut out of its action compiled ahead of time.
+ * Called as magix::u32 (JitFrame *, size_t stack_pointer) with the System V ABI, returns a packed result.
+ * Like the unchecked executor it does not check stack registers, so it may only run in verified code.
+ */
+struct Stencil
+{
+    magix::span<const magix::u8> code;
+    magix::span<const StencilHole> holes;
+};
+
+/** Stencil of the instruction, nullptr if its action could not be made into one or the build has none. */
+[[nodiscard]] auto
+find_stencil(magix::code_word opcode) noexcept -> const Stencil *;
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_STENCILS_HPP_
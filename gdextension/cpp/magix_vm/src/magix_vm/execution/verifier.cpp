@@ -0,0 +1,167 @@
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/types.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+/** Abstract stack pointer at the start of an instruction. */
+struct StackPointerState
+{
+    enum class Kind
+    {
+        UNREACHED,
+        /** Same value on every path. */
+        KNOWN,
+        /** Differs between paths or was set at runtime. */
+        UNKNOWN,
+    };
+    Kind kind = Kind::UNREACHED;
+    magix::i64 value = 0;
+
+    /** Merge in the state of another incoming edge, returns whether this changed. */
+    auto
+    join(const StackPointerState &incoming) -> bool
+    {
+        if (incoming.kind == Kind::UNREACHED || kind == Kind::UNKNOWN)
+        {
+            return false;
+        }
+        if (kind == Kind::UNREACHED)
+        {
+            *this = incoming;
+            return true;
+        }
+        if (incoming.kind == Kind::KNOWN && incoming.value == value)
+        {
+            return false;
+        }
+        kind = Kind::UNKNOWN;
+        return true;
+    }
+};
+
+} // namespace
+
+auto
+magix::execute::DecodedByteCode::is_verified(magix::u16 entry, size_t stack_size) const -> bool
+{
+    return stack_size >= verified_stack_size && std::binary_search(verified_entries.begin(), verified_entries.end(), entry);
+}
+
+void
+magix::execute::verify(DecodedByteCode &program)
+{
+    program.verified_entries.clear();
+    program.verified_stack_size = 0;
+
+    const StackPointerState entry_state{StackPointerState::Kind::KNOWN, 0};
+    std::vector<StackPointerState> states(program.instructions.size());
+    std::vector<magix::u32> worklist;
+    std::vector<magix::u16> entries;
+    auto flow = [&](magix::u32 index, const StackPointerState &state) {
+        if (states[index].join(state))
+        {
+            worklist.push_back(index);
+        }
+    };
+
+    for (auto [name, entry] : program.raw->entry_points)
+    {
+        if (auto index = program.find(entry))
+        {
+            entries.push_back(entry);
+            flow(*index, entry_state);
+        }
+    }
+
+    magix::i64 stack_extent = 0;
+    while (!worklist.empty())
+    {
+        const magix::u32 index = worklist.back();
+        worklist.pop_back();
+        const DecodedInstruction &decoded = program.instructions[index];
+        const StackPointerState state = states[index];
+
+        const compile::InstructionSpec *spec = compile::get_instruction_spec(decoded.op_code);
+        if (spec == nullptr)
+        {
+            // trap record, traps the same on every executor
+            continue;
+        }
+
+        for (auto reg_index : magix::ranges::num_range(spec->arg_count()))
+        {
+            const compile::InstructionRegisterSpec &reg = spec->registers[reg_index];
+            const bool copies = reg.bytes_register >= 0;
+            if (reg.mode != compile::InstructionRegisterSpec::Mode::LOCAL || !(reg.is_read || reg.is_written || copies))
+            {
+                continue;
+            }
+            if (state.kind != StackPointerState::Kind::KNOWN)
+            {
+                return;
+            }
+            const magix::i64 offset = state.value + decoded.operands[reg_index];
+            if (copies)
+            {
+                // copies check their own bounds and need no alignment, but still count towards the stack that is touched
+                if (offset < 0)
+                {
+                    return;
+                }
+                stack_extent = std::max(stack_extent, offset + decoded.operands[reg.bytes_register]);
+                continue;
+            }
+            const auto size = static_cast<magix::i64>(compile::type_size(reg.type));
+            if (size == 0 || offset < 0 || offset % size != 0)
+            {
+                return;
+            }
+            stack_extent = std::max(stack_extent, offset + size);
+        }
+
+        StackPointerState next = state;
+        if (spec->stack_pointer_effect == compile::StackPointerEffect::OFFSET && next.kind == StackPointerState::Kind::KNOWN)
+        {
+            next.value += decoded.operands[0];
+        }
+        else if (spec->stack_pointer_effect != compile::StackPointerEffect::NONE)
+        {
+            next.kind = StackPointerState::Kind::UNKNOWN;
+        }
+
+        if (!spec->is_terminator)
+        {
+            flow(index + 1, next);
+        }
+        for (auto reg_index : magix::ranges::num_range(spec->arg_count()))
+        {
+            if (!spec->registers[reg_index].is_code_address)
+            {
+                continue;
+            }
+            const auto target = static_cast<magix::u32>(decoded.operands[reg_index]);
+            if (spec->is_yield)
+            {
+                // resumed by a new invocation, which starts with a fresh stack pointer
+                entries.push_back(program.instructions[target].instruction_pointer);
+                flow(target, entry_state);
+            }
+            else
+            {
+                flow(target, next);
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    program.verified_entries = std::move(entries);
+    program.verified_stack_size = static_cast<size_t>(stack_extent);
+}
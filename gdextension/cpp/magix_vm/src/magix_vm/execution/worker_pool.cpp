@@ -0,0 +1,148 @@
+#include "magix_vm/execution/worker_pool.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+magix::execute::WorkerPool::WorkerPool(size_t worker_count)
+{
+    const size_t thread_count = std::max<size_t>(worker_count, 1) - 1;
+    shares = std::make_unique<Share[]>(thread_count + 1);
+    threads.reserve(thread_count);
+    for (auto worker : magix::ranges::num_range(size_t{1}, thread_count + 1))
+    {
+        threads.emplace_back([this, worker] { worker_main(worker); });
+    }
+}
+
+magix::execute::WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+auto
+magix::execute::WorkerPool::worker_count() const noexcept -> size_t
+{
+    return threads.size() + 1;
+}
+
+void
+magix::execute::WorkerPool::run(size_t count, const Task &task)
+{
+    if (threads.empty() || count <= 1)
+    {
+        for (auto index : magix::ranges::num_range(count))
+        {
+            task(0, index);
+        }
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        const size_t workers = worker_count();
+        for (auto worker : magix::ranges::num_range(workers))
+        {
+            std::lock_guard share_lock(shares[worker].mutex);
+            shares[worker].begin = count * worker / workers;
+            shares[worker].end = count * (worker + 1) / workers;
+        }
+        this->task = &task;
+        busy = threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+    run_shares(0, task);
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    this->task = nullptr;
+}
+
+void
+magix::execute::WorkerPool::worker_main(size_t worker)
+{
+    size_t seen = 0;
+    std::unique_lock lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+        {
+            return;
+        }
+        seen = generation;
+        const Task &current = *task;
+
+        lock.unlock();
+        run_shares(worker, current);
+        lock.lock();
+
+        if (--busy == 0)
+        {
+            done.notify_one();
+        }
+    }
+}
+
+void
+magix::execute::WorkerPool::run_shares(size_t worker, const Task &task)
+{
+    size_t index = 0;
+    while (pop(worker, index) || steal(worker, index))
+    {
+        task(worker, index);
+    }
+}
+
+auto
+magix::execute::WorkerPool::pop(size_t worker, size_t &index) -> bool
+{
+    Share &share = shares[worker];
+    std::lock_guard lock(share.mutex);
+    if (share.begin == share.end)
+    {
+        return false;
+    }
+    index = share.begin++;
+    return true;
+}
+
+auto
+magix::execute::WorkerPool::steal(size_t worker, size_t &index) -> bool
+{
+    const size_t workers = worker_count();
+    for (auto offset : magix::ranges::num_range(size_t{1}, workers))
+    {
+        Share &victim = shares[(worker + offset) % workers];
+        size_t begin = 0;
+        size_t end = 0;
+        {
+            std::lock_guard lock(victim.mutex);
+            if (victim.begin == victim.end)
+            {
+                continue;
+            }
+            // the back half, rounded up, so the last index of a worker stuck on a slow one still moves
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        // nobody steals from an empty share, but thieves still look at it
+        Share &own = shares[worker];
+        std::lock_guard lock(own.mutex);
+        index = begin;
+        own.begin = begin + 1;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
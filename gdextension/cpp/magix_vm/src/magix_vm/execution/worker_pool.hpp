@@ -0,0 +1,79 @@
+#ifndef MAGIX_EXECUTION_WORKER_POOL_HPP_
+#define MAGIX_EXECUTION_WORKER_POOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace magix::execute
+{
+
+/** Threads that run the indices of a task side by side. The thread calling run() is worker 0 and takes a share as well, so a
+ * pool of one worker starts no threads at all.
+ */
+class WorkerPool
+{
+  public:
+    using Task = std::function<void(size_t worker, size_t index)>;
+
+    explicit WorkerPool(size_t worker_count = 1);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    auto
+    operator=(const WorkerPool &) -> WorkerPool & = delete;
+
+    [[nodiscard]] auto
+    worker_count() const noexcept -> size_t;
+
+    /** Call task for every index below count and return once all calls returned. Every worker starts on its own contiguous
+     * share of the indices and runs it in order, once done it steals the back half of what is left of another share. Which
+     * worker runs an index can differ from run to run. The task must not throw.
+     */
+    void
+    run(size_t count, const Task &task);
+
+  private:
+    /** Indices a worker did not start yet, it takes them from the front and thieves from the back. */
+    struct alignas(64) Share
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void
+    worker_main(size_t worker);
+
+    /** Run the share of worker and whatever it can steal from the others. */
+    void
+    run_shares(size_t worker, const Task &task);
+
+    /** Next index of the share of worker, if any is left. */
+    [[nodiscard]] auto
+    pop(size_t worker, size_t &index) -> bool;
+
+    /** Move the back half of the share of another worker to that of worker and return its first index, if any was left. */
+    [[nodiscard]] auto
+    steal(size_t worker, size_t &index) -> bool;
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Share[]> shares;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    /** Current task, only valid while generation is ahead of what a worker saw. */
+    const Task *task = nullptr;
+    size_t generation = 0;
+    /** Threads that did not finish their share of the current task yet. */
+    size_t busy = 0;
+    bool stopping = false;
+};
+
+} // namespace magix::execute
+
+#endif // MAGIX_EXECUTION_WORKER_POOL_HPP_
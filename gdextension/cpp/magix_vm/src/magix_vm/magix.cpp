@@ -1,9 +1,21 @@
+#include "godot_cpp/classes/resource_loader.hpp"
+#include "godot_cpp/classes/resource_saver.hpp"
 #include "godot_cpp/core/class_db.hpp"
 #include "magix_vm/MagixAsmProgram.hpp"
+#include "magix_vm/MagixByteCodeLoader.hpp"
+#include "magix_vm/MagixByteCodeSaver.hpp"
 #include "magix_vm/MagixCastSlot.hpp"
 #include "magix_vm/MagixCaster.hpp"
 #include "magix_vm/MagixVirtualMachine.hpp"
 
+namespace
+{
+
+godot::Ref<magix::MagixByteCodeLoader> bytecode_loader;
+godot::Ref<magix::MagixByteCodeSaver> bytecode_saver;
+
+} // namespace
+
 void
 magix_vm_init_lib(godot::ModuleInitializationLevel p_level)
 {
@@ -17,6 +29,13 @@ magix_vm_init_lib(godot::ModuleInitializationLevel p_level)
     GDREGISTER_CLASS(magix::MagixCastSlot);
     GDREGISTER_CLASS(magix::MagixCaster);
     GDREGISTER_RUNTIME_CLASS(magix::MagixVirtualMachine);
+    GDREGISTER_CLASS(magix::MagixByteCodeLoader);
+    GDREGISTER_CLASS(magix::MagixByteCodeSaver);
+
+    bytecode_loader.instantiate();
+    godot::ResourceLoader::get_singleton()->add_resource_format_loader(bytecode_loader);
+    bytecode_saver.instantiate();
+    godot::ResourceSaver::get_singleton()->add_resource_format_saver(bytecode_saver);
 }
 
 void
@@ -26,6 +45,11 @@ magix_vm_deinit_lib(godot::ModuleInitializationLevel p_level)
     {
         return;
     }
+
+    godot::ResourceLoader::get_singleton()->remove_resource_format_loader(bytecode_loader);
+    bytecode_loader.unref();
+    godot::ResourceSaver::get_singleton()->remove_resource_format_saver(bytecode_saver);
+    bytecode_saver.unref();
 }
 
 extern "C"
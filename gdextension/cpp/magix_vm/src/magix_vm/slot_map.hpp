@@ -0,0 +1,162 @@
+#ifndef MAGIX_SLOT_MAP_HPP_
+#define MAGIX_SLOT_MAP_HPP_
+
+#include "magix_vm/span.hpp"
+#include "magix_vm/types.hpp"
+
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace magix
+{
+
+/** Names a value of a SlotMap. Stays valid until that value is erased, then never matches a value again. */
+struct SlotHandle
+{
+    static constexpr magix::u32 invalid_slot = std::numeric_limits<magix::u32>::max();
+
+    magix::u32 slot = invalid_slot;
+    magix::u32 generation = 0;
+
+    [[nodiscard]] constexpr auto
+    is_valid() const noexcept -> bool
+    {
+        return slot != invalid_slot;
+    }
+
+    constexpr auto
+    operator==(const SlotHandle &rhs) const noexcept -> bool
+    {
+        return slot == rhs.slot && generation == rhs.generation;
+    }
+    constexpr auto
+    operator!=(const SlotHandle &rhs) const noexcept -> bool
+    {
+        return !(*this == rhs);
+    }
+};
+
+/** Values kept densely packed in one vector, found through handles in O(1).
+ * Erasing moves the last value into the gap, so the order of values() is arbitrary, but only changes on erase.
+ */
+template <class T>
+class SlotMap
+{
+  public:
+    template <class... Args>
+    auto
+    emplace(Args &&...args) -> SlotHandle
+    {
+        magix::u32 slot_index;
+        if (free_head != SlotHandle::invalid_slot)
+        {
+            slot_index = free_head;
+            free_head = slots[slot_index].index;
+        }
+        else
+        {
+            slot_index = static_cast<magix::u32>(slots.size());
+            slots.push_back(Slot{});
+        }
+        _values.emplace_back(std::forward<Args>(args)...);
+        value_slots.push_back(slot_index);
+        slots[slot_index].index = static_cast<magix::u32>(_values.size() - 1);
+        return SlotHandle{slot_index, slots[slot_index].generation};
+    }
+
+    /** Erase the value, returns whether the handle named one. */
+    auto
+    erase(SlotHandle handle) -> bool
+    {
+        if (find(handle) == nullptr)
+        {
+            return false;
+        }
+        Slot &slot = slots[handle.slot];
+        const magix::u32 index = slot.index;
+        if (index + 1 != _values.size())
+        {
+            _values[index] = std::move(_values.back());
+            value_slots[index] = value_slots.back();
+            slots[value_slots[index]].index = index;
+        }
+        _values.pop_back();
+        value_slots.pop_back();
+
+        ++slot.generation;
+        slot.index = free_head;
+        free_head = handle.slot;
+        return true;
+    }
+
+    [[nodiscard]] auto
+    find(SlotHandle handle) -> T *
+    {
+        if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+        {
+            return nullptr;
+        }
+        return &_values[slots[handle.slot].index];
+    }
+    [[nodiscard]] auto
+    find(SlotHandle handle) const -> const T *
+    {
+        return const_cast<SlotMap *>(this)->find(handle);
+    }
+
+    /** Handle of the value at the given index of values(). */
+    [[nodiscard]] auto
+    handle_at(size_t index) const -> SlotHandle
+    {
+        const magix::u32 slot = value_slots[index];
+        return SlotHandle{slot, slots[slot].generation};
+    }
+
+    [[nodiscard]] auto
+    values() noexcept -> magix::span<T>
+    {
+        return magix::span<T>(_values);
+    }
+    [[nodiscard]] auto
+    values() const noexcept -> magix::span<const T>
+    {
+        return magix::span<const T>(_values);
+    }
+
+    [[nodiscard]] auto
+    size() const noexcept -> size_t
+    {
+        return _values.size();
+    }
+
+    /** Erase every value, all handles stop matching. */
+    void
+    clear()
+    {
+        while (!_values.empty())
+        {
+            erase(handle_at(_values.size() - 1));
+        }
+    }
+
+  private:
+    struct Slot
+    {
+        /** Index into _values while in use, else the next free slot. */
+        magix::u32 index = SlotHandle::invalid_slot;
+        /** Bumped on erase, so old handles no longer match. */
+        magix::u32 generation = 0;
+    };
+
+    std::vector<T> _values;
+    /** Per value, the slot naming it. */
+    std::vector<magix::u32> value_slots;
+    std::vector<Slot> slots;
+    magix::u32 free_head = SlotHandle::invalid_slot;
+};
+
+} // namespace magix
+
+#endif // MAGIX_SLOT_MAP_HPP_
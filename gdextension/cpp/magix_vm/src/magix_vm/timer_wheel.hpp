@@ -0,0 +1,115 @@
+#ifndef MAGIX_TIMER_WHEEL_HPP_
+#define MAGIX_TIMER_WHEEL_HPP_
+
+#include "magix_vm/types.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace magix
+{
+
+/** Values that wait a number of ticks, in levels of buckets that each cover slot_count times the ticks of the level below.
+ * Scheduling and waking are O(1) per value, a value moves down at most once per level and is not touched otherwise.
+ */
+template <class T>
+class TimerWheel
+{
+  public:
+    static constexpr size_t slot_bits = 6;
+    static constexpr size_t slot_count = size_t{1} << slot_bits;
+    static constexpr size_t level_count = 4;
+    /** Longer delays are cut to this, it keeps the top level from wrapping onto its current slot. */
+    static constexpr magix::u64 max_delay = (slot_count - 1) << (slot_bits * (level_count - 1));
+
+    /** The value is woken by the delay-th advance() from now, at least the next one. */
+    void
+    schedule(magix::u64 delay, T value)
+    {
+        delay = std::clamp<magix::u64>(delay, 1, max_delay);
+        place(Entry{now + delay, std::move(value)});
+        ++count;
+    }
+
+    /** Move time on by one tick and hand every value due to wake, which may schedule more. */
+    template <class Wake>
+    void
+    advance(Wake &&wake)
+    {
+        ++now;
+        // higher levels first, they can move values into the current slot of a lower one
+        for (size_t level = level_count - 1; level > 0; --level)
+        {
+            if ((now & ((magix::u64{1} << (slot_bits * level)) - 1)) != 0)
+            {
+                continue;
+            }
+            std::vector<Entry> &bucket = buckets[bucket_index(level, now)];
+            std::vector<Entry> moving;
+            moving.swap(bucket);
+            for (Entry &entry : moving)
+            {
+                place(std::move(entry));
+            }
+        }
+        std::vector<Entry> &due = buckets[bucket_index(0, now)];
+        count -= due.size();
+        for (Entry &entry : due)
+        {
+            wake(std::move(entry.value));
+        }
+        due.clear();
+    }
+
+    [[nodiscard]] auto
+    size() const noexcept -> size_t
+    {
+        return count;
+    }
+
+    void
+    clear()
+    {
+        for (std::vector<Entry> &bucket : buckets)
+        {
+            bucket.clear();
+        }
+        count = 0;
+    }
+
+  private:
+    struct Entry
+    {
+        magix::u64 due;
+        T value;
+    };
+
+    [[nodiscard]] static constexpr auto
+    bucket_index(size_t level, magix::u64 tick) -> size_t
+    {
+        return level * slot_count + ((tick >> (slot_bits * level)) & (slot_count - 1));
+    }
+
+    /** Into the lowest level whose slot for the due tick is not passed before it, by the highest bits that differ from now. */
+    void
+    place(Entry entry)
+    {
+        size_t level = 0;
+        while (level + 1 < level_count && (entry.due >> (slot_bits * (level + 1))) != (now >> (slot_bits * (level + 1))))
+        {
+            ++level;
+        }
+        buckets[bucket_index(level, entry.due)].push_back(std::move(entry));
+    }
+
+    std::array<std::vector<Entry>, slot_count * level_count> buckets;
+    magix::u64 now = 0;
+    size_t count = 0;
+};
+
+} // namespace magix
+
+#endif // MAGIX_TIMER_WHEEL_HPP_
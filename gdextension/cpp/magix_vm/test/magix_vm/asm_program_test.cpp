@@ -0,0 +1,51 @@
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE INCLUDED IN NON TEST BUILD!
+#endif
+
+#include "magix_vm/MagixAsmProgram.hpp"
+
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/doctest_helper.hpp"
+
+TEST_SUITE("asm_program")
+{
+    TEST_CASE("compile waits for a background compilation")
+    {
+        godot::Ref<magix::MagixAsmProgram> program;
+        program.instantiate();
+        program->set_asm_source(U"@compile_async_waited:\n    nop\n    nop\n    nop\n    exit\n");
+        program->compile_async();
+        // finished compilations are only taken over on the main thread
+        CHECK(program->try_get_bytecode().is_null());
+
+        CHECK(program->compile());
+        godot::Ref<magix::MagixByteCode> bytecode = program->try_get_bytecode();
+        REQUIRE(bytecode.is_valid());
+        CHECK(bytecode->list_entry_points().has("compile_async_waited"));
+    }
+
+    TEST_CASE("background compilations of an old source are dropped")
+    {
+        godot::Ref<magix::MagixAsmProgram> program;
+        program.instantiate();
+        program->set_asm_source(U"@compile_async_old:\n    nop\n    nop\n    exit\n");
+        program->compile_async();
+        program->set_asm_source(U"@compile_async_new:\n    nop\n    nop\n    nop\n    nop\n    exit\n");
+
+        godot::Ref<magix::MagixByteCode> bytecode = program->get_bytecode();
+        REQUIRE(bytecode.is_valid());
+        CHECK(bytecode->list_entry_points().has("compile_async_new"));
+        CHECK_FALSE(bytecode->list_entry_points().has("compile_async_old"));
+    }
+
+    TEST_CASE("failing sources report their errors after a background compilation")
+    {
+        godot::Ref<magix::MagixAsmProgram> program;
+        program.instantiate();
+        program->set_asm_source(U"@compile_async_failing:\n    not_an_instruction\n    exit\n");
+        program->compile_async();
+        CHECK_FALSE(program->compile());
+        CHECK(program->try_get_bytecode().is_null());
+        CHECK_NE(program->get_error_count(), 0);
+    }
+}
@@ -0,0 +1,206 @@
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/jit.hpp"
+#include "magix_vm/execution/lockstep.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <doctest.h>
+#include <memory>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+/** Run the entry of the given program until the step budget runs out and report instructions per second. */
+void
+bench_instructions_per_second(const char *name, magix::compile::SrcView source, size_t steps)
+{
+    auto tokens = magix::compile::lex(source);
+    auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+    auto errors = magix::compile::assemble(tokens, *raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    if (!CHECK_RANGE_EQ(errors, expect_error))
+    {
+        return;
+    }
+    auto *entry = raw->entry_points.find("entry");
+    if (!CHECK_NE(entry, nullptr))
+    {
+        return;
+    }
+
+    magix::execute::DecodedByteCode decoded = magix::execute::decode(*raw);
+    magix::execute::verify(decoded);
+
+    auto stack = std::make_unique<magix::execute::ExecStack>();
+    // seconds a run of the entry took, execute is called with the arguments after the context
+    auto time_run = [&](auto &&...execute_args) -> double {
+        stack->clear();
+        magix::execute::PageInfo pages{
+            stack.get(), stack->stack.size(), stack->objbank.size(), {}, {}, {}, {},
+        };
+        magix::execute::ExecutionContext context{pages};
+
+        const auto start = std::chrono::steady_clock::now();
+        auto result = magix::execute::execute(execute_args..., entry->value(), steps, context);
+        const auto stop = std::chrono::steady_clock::now();
+
+        CHECK_EQ(result.type, magix::execute::ExecResult::Type::TRAP_TOO_MANY_STEPS);
+        return std::chrono::duration<double>(stop - start).count();
+    };
+    auto minst_per_second = [&](double seconds) { return static_cast<double>(steps) / seconds / 1e6; };
+
+    // both dispatch loops of the same build side by side, the configured one is what execute() uses
+    auto compare_dispatch = [&](const char *source_kind, auto &&program) {
+        const double switched = minst_per_second(time_run(magix::execute::Dispatch::SWITCH, program));
+        if (!magix::execute::has_dispatch(magix::execute::Dispatch::THREADED))
+        {
+            MESSAGE(name, " [", source_kind, "]: switch ", switched, " Minst/s, threaded not built");
+            return;
+        }
+        const double threaded = minst_per_second(time_run(magix::execute::Dispatch::THREADED, program));
+        MESSAGE(
+            name, " [", source_kind, "]: threaded ", threaded, " Minst/s, switch ", switched, " Minst/s, ", threaded / switched,
+            "x, configured ", magix::execute::dispatch_mode()
+        );
+    };
+    compare_dispatch("raw", *raw);
+    compare_dispatch("decoded", decoded);
+    if (magix::execute::jit_available())
+    {
+        MESSAGE(name, " [jit]: ", minst_per_second(time_run(magix::execute::jit_compile(decoded))), " Minst/s");
+    }
+}
+
+/** Run many instances of the entry, each until the step budget runs out, one after another and in lockstep batches. */
+void
+bench_instances(const char *name, magix::compile::SrcView source, size_t instance_count, size_t steps)
+{
+    auto tokens = magix::compile::lex(source);
+    auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+    auto errors = magix::compile::assemble(tokens, *raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    if (!CHECK_RANGE_EQ(errors, expect_error))
+    {
+        return;
+    }
+    auto *entry = raw->entry_points.find("entry");
+    if (!CHECK_NE(entry, nullptr))
+    {
+        return;
+    }
+
+    magix::execute::DecodedByteCode decoded = magix::execute::decode(*raw);
+    magix::execute::verify(decoded);
+    const magix::execute::JitProgram jit = magix::execute::jit_compile(decoded);
+    const magix::execute::LockstepProgram lockstep = magix::execute::lockstep_compile(decoded);
+    if (!CHECK(lockstep.can_run(entry->value(), magix::execute::stack_size_default)))
+    {
+        return;
+    }
+
+    auto stack = std::make_unique<magix::execute::ExecStack>();
+    std::vector<std::vector<std::byte>> forks(instance_count, std::vector<std::byte>(raw->fork_size));
+    std::vector<magix::span<std::byte>> fork_spans(forks.begin(), forks.end());
+    auto report = [&](const char *kind, auto start, auto stop) {
+        const double seconds = std::chrono::duration<double>(stop - start).count();
+        MESSAGE(name, " [", kind, "]: ", static_cast<double>(steps * instance_count) / seconds / 1e6, " Minst/s");
+    };
+    auto run_one_after_another = [&](const char *kind, auto &&program) {
+        stack->clear();
+        const auto start = std::chrono::steady_clock::now();
+        for (auto &fork : fork_spans)
+        {
+            magix::execute::ExecutionContext context{magix::execute::PageInfo{
+                stack.get(), stack->stack.size(), stack->objbank.size(), {}, fork, {}, {},
+            }};
+            auto result = magix::execute::execute(program, entry->value(), steps, context);
+            CHECK_EQ(result.type, magix::execute::ExecResult::Type::TRAP_TOO_MANY_STEPS);
+        }
+        report(kind, start, std::chrono::steady_clock::now());
+    };
+    run_one_after_another("decoded", decoded);
+    run_one_after_another("jit", jit);
+
+    const auto start = std::chrono::steady_clock::now();
+    magix::execute::LockstepBatch batch;
+    for (size_t first = 0; first < instance_count; first += magix::execute::lockstep_lane_count)
+    {
+        const size_t count = std::min(magix::execute::lockstep_lane_count, instance_count - first);
+        batch.run(lockstep, entry->value(), magix::span<const magix::span<std::byte>>(&fork_spans[first], count), steps);
+    }
+    report(magix::execute::LockstepBatch::uses_avx2() ? "lockstep, avx2" : "lockstep", start, std::chrono::steady_clock::now());
+}
+
+constexpr size_t bench_steps = 50'000'000;
+
+} // namespace
+
+TEST_SUITE("benchmark/dispatch" * doctest::skip())
+{
+    TEST_CASE("arithmetic loop")
+    {
+        bench_instructions_per_second(
+            "arithmetic loop", UR"(
+@entry:
+    set.u32 $0, #0
+    set.u32 $4, #0
+loop:
+    add.u32.imm $0, $0, #1
+    add.u32 $4, $4, $0
+    sub.u32.imm $8, $4, #3
+    goto #loop
+)",
+            bench_steps
+        );
+    }
+
+    TEST_CASE("branchy loop")
+    {
+        bench_instructions_per_second(
+            "branchy loop", UR"(
+@entry:
+    set.u32 $0, #0
+loop:
+    add.u32.imm $0, $0, #1
+    sub.u32.imm $4, $0, #7
+    if.zero #reset, $4
+    mov.u32 $8, $0
+    goto #loop
+reset:
+    set.u32 $0, #0
+    goto #loop
+)",
+            bench_steps
+        );
+    }
+
+    TEST_CASE("instances of one program")
+    {
+        bench_instances(
+            "instances of one program", UR"(
+.fork_size 8
+@entry:
+    fork.load $0, #0, #8
+loop:
+    add.u32.imm $0, $0, #3
+    add.u32 $4, $4, $0
+    sub.u32.imm $8, $4, #1
+    fork.store $0, #0, #8
+    goto #loop
+)",
+            4096, 100'000
+        );
+    }
+}
@@ -0,0 +1,114 @@
+#include "godot_cpp/classes/ref.hpp"
+#include "magix_vm/MagixAsmProgram.hpp"
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/MagixCaster.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/runner.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/unique_node.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <doctest.h>
+#include <thread>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+/** Each instance runs 80 steps and exits, so every round casts again. */
+constexpr magix::compile::SrcView bench_source = UR"(
+.fork_size 8
+@entry:
+    set.u32 $0, #20
+    fork.load $4, #0, #4
+loop:
+    add.u32.imm $4, $4, #3
+    sub.u32.imm $0, $0, #1
+    if.zero #done, $0
+    goto #loop
+done:
+    fork.store $4, #0, #4
+    exit
+)";
+
+/** Cast the given number of instances per caster and report instances per second of run_all() for a few worker counts. */
+void
+bench_casters(const char *name, const std::vector<size_t> &instances_per_caster, size_t rounds)
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(bench_source);
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+    const magix::u16 entry = bc->get_code().entry_points.find("entry")->value();
+
+    std::vector<magix::UniqueNode<magix::MagixCaster>> casters;
+    size_t instance_count = 0;
+    for (size_t count : instances_per_caster)
+    {
+        casters.emplace_back(magix::make_unique_node<magix::MagixCaster>());
+        instance_count += count;
+    }
+
+    const size_t hardware_workers = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    for (size_t worker_count : {size_t{1}, size_t{2}, size_t{4}, hardware_workers})
+    {
+        magix::execute::ExecRunner runner;
+        runner.set_worker_count(worker_count);
+        double seconds = 0.0;
+        for (auto round : magix::ranges::num_range(rounds))
+        {
+            (void)round;
+            for (auto caster : magix::ranges::num_range(casters.size()))
+            {
+                for (auto instance : magix::ranges::num_range(instances_per_caster[caster]))
+                {
+                    (void)instance;
+                    runner.enqueue_cast_spell(casters[caster].get(), bc, entry);
+                }
+            }
+            const auto start = std::chrono::steady_clock::now();
+            (void)runner.run_all();
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        MESSAGE(name, " [", worker_count, " workers]: ", static_cast<double>(instance_count * rounds) / seconds / 1e6, " Minstances/s");
+    }
+}
+
+constexpr size_t bench_rounds = 200;
+
+} // namespace
+
+TEST_SUITE("benchmark/scheduler" * doctest::skip())
+{
+    TEST_CASE("one boss among ordinary casters")
+    {
+        std::vector<size_t> instances(64, 1);
+        instances[17] = 2000;
+        bench_casters("one boss", instances, bench_rounds);
+    }
+
+    TEST_CASE("a few bosses")
+    {
+        std::vector<size_t> instances(256, 2);
+        for (size_t boss : {3, 100, 200})
+        {
+            instances[boss] = 1000;
+        }
+        bench_casters("a few bosses", instances, bench_rounds);
+    }
+
+    TEST_CASE("even load")
+    {
+        bench_casters("even", std::vector<size_t>(512, 8), bench_rounds);
+    }
+}
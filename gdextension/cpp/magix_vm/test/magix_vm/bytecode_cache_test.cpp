@@ -0,0 +1,73 @@
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE INCLUDED IN NON TEST BUILD!
+#endif
+
+#include "magix_vm/bytecode_cache.hpp"
+
+#include "magix_vm/MagixAsmProgram.hpp"
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <vector>
+
+TEST_SUITE("bytecode_cache")
+{
+    TEST_CASE("programs are found by their source")
+    {
+        magix::ByteCodeCache cache;
+        const godot::String source = U"@entry:\n    exit\n";
+        CHECK(cache.find(source).is_null());
+
+        godot::Ref<magix::MagixByteCode> first;
+        first.instantiate();
+        CHECK_EQ(cache.insert(source, first), first);
+        CHECK_EQ(cache.find(source), first);
+        CHECK(cache.find(U"@entry:\n    nop\n    exit\n").is_null());
+
+        // the first one for a source stays
+        godot::Ref<magix::MagixByteCode> second;
+        second.instantiate();
+        CHECK_EQ(cache.insert(source, second), first);
+        CHECK_EQ(cache.size(), 1);
+
+        CHECK_NE(magix::ByteCodeCache::key_of(source), magix::ByteCodeCache::key_of(U"@entry:\n    nop\n    exit\n"));
+        cache.clear();
+        CHECK(cache.find(source).is_null());
+    }
+
+    TEST_CASE("programs only the cache holds are dropped as it grows")
+    {
+        magix::ByteCodeCache cache;
+        godot::Ref<magix::MagixByteCode> held;
+        held.instantiate();
+        cache.insert(U"held", held);
+        for (auto index : magix::ranges::num_range(64))
+        {
+            godot::Ref<magix::MagixByteCode> dropped;
+            dropped.instantiate();
+            cache.insert(godot::String::num_int64(index), dropped);
+        }
+        CHECK_EQ(cache.size(), 2);
+        CHECK_EQ(cache.find(U"held"), held);
+    }
+
+    TEST_CASE("programs of the same source share their bytecode")
+    {
+        const godot::String source = U"@entry:\n    nop\n    nop\n    exit\n";
+        std::vector<godot::Ref<magix::MagixAsmProgram>> programs(2);
+        for (godot::Ref<magix::MagixAsmProgram> &program : programs)
+        {
+            program.instantiate();
+            program->set_asm_source(source);
+        }
+        godot::Ref<magix::MagixByteCode> bytecode = programs[0]->get_bytecode();
+        REQUIRE(bytecode.is_valid());
+        CHECK_EQ(programs[1]->get_bytecode(), bytecode);
+
+        godot::Ref<magix::MagixAsmProgram> other;
+        other.instantiate();
+        other->set_asm_source(U"@entry:\n    exit\n");
+        CHECK_NE(other->get_bytecode(), bytecode);
+    }
+}
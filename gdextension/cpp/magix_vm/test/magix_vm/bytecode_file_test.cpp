@@ -0,0 +1,92 @@
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE INCLUDED IN NON TEST BUILD!
+#endif
+
+#include "magix_vm/compilation/bytecode_file.hpp"
+
+#include "magix_vm/MagixAsmProgram.hpp"
+#include "magix_vm/MagixByteCode.hpp"
+#include "magix_vm/doctest_helper.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+auto
+assemble(const godot::String &source) -> godot::Ref<magix::MagixByteCode>
+{
+    godot::Ref<magix::MagixAsmProgram> program;
+    program.instantiate();
+    program->set_asm_source(source);
+    return program->get_bytecode();
+}
+
+} // namespace
+
+TEST_SUITE("bytecode_file")
+{
+    TEST_CASE("programs come back from their file as they were written")
+    {
+        godot::Ref<magix::MagixByteCode> bytecode = assemble(
+            U".stack_size 128\n.fork_size 64\nvalue:\n.u32 7\n@first:\n    nop\n    exit\n@second:\n    exit\n"
+        );
+        REQUIRE(bytecode.is_valid());
+        const magix::compile::ByteCodeRaw &original = bytecode->get_code();
+
+        std::vector<std::byte> file = magix::compile::write_bytecode_file(original);
+        CHECK_GE(file.size(), magix::compile::bytecode_file_header_size + original.code.size());
+
+        magix::compile::ByteCodeRaw loaded;
+        REQUIRE_EQ(magix::compile::read_bytecode_file(file, loaded), magix::compile::BytecodeFileError::OK);
+        CHECK(std::equal(loaded.code.begin(), loaded.code.end(), original.code.begin(), original.code.end()));
+        CHECK_EQ(loaded.data_segment_size, original.data_segment_size);
+        CHECK_EQ(loaded.code_segment_size, original.code_segment_size);
+        CHECK_EQ(loaded.stack_size, original.stack_size);
+        CHECK_EQ(loaded.fork_size, original.fork_size);
+        CHECK_EQ(loaded.shared_size, original.shared_size);
+        CHECK_EQ(loaded.obj_count, original.obj_count);
+        CHECK_EQ(loaded.obj_fork_count, original.obj_fork_count);
+        CHECK_EQ(loaded.obj_shared_count, original.obj_shared_count);
+        REQUIRE_EQ(loaded.entry_points.size(), 2);
+        for (auto [name, address] : original.entry_points)
+        {
+            CHECK_EQ(loaded.entry_points[name], address);
+        }
+    }
+
+    TEST_CASE("files of other formats, instruction sets or sizes are rejected")
+    {
+        godot::Ref<magix::MagixByteCode> bytecode = assemble(U"@entry:\n    exit\n");
+        REQUIRE(bytecode.is_valid());
+        const std::vector<std::byte> file = magix::compile::write_bytecode_file(bytecode->get_code());
+        magix::compile::ByteCodeRaw loaded;
+
+        std::vector<std::byte> other = file;
+        other[0] = std::byte{'X'};
+        CHECK_EQ(magix::compile::read_bytecode_file(other, loaded), magix::compile::BytecodeFileError::NOT_BYTECODE);
+
+        other = file;
+        other[4] = std::byte{0xff};
+        CHECK_EQ(magix::compile::read_bytecode_file(other, loaded), magix::compile::BytecodeFileError::OTHER_FORMAT_VERSION);
+
+        other = file;
+        other[8] ^= std::byte{1};
+        CHECK_EQ(magix::compile::read_bytecode_file(other, loaded), magix::compile::BytecodeFileError::OTHER_ISA);
+
+        other = file;
+        other.pop_back();
+        CHECK_EQ(magix::compile::read_bytecode_file(other, loaded), magix::compile::BytecodeFileError::CORRUPT);
+
+        other = std::vector<std::byte>(file.begin(), file.begin() + 16);
+        CHECK_EQ(magix::compile::read_bytecode_file(other, loaded), magix::compile::BytecodeFileError::NOT_BYTECODE);
+
+        // entry pointing past the ROM, the entry table starts right after it
+        other = file;
+        const size_t entry = magix::compile::bytecode_file_header_size + bytecode->get_code().code.size();
+        other[entry] = std::byte{0xff};
+        other[entry + 1] = std::byte{0xff};
+        CHECK_EQ(magix::compile::read_bytecode_file(other, loaded), magix::compile::BytecodeFileError::CORRUPT);
+    }
+}
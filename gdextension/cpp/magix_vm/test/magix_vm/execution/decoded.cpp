@@ -0,0 +1,145 @@
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <cstring>
+#include <doctest.h>
+#include <memory>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+auto
+assemble_source(magix::compile::SrcView source) -> std::unique_ptr<magix::compile::ByteCodeRaw>
+{
+    auto tokens = magix::compile::lex(source);
+    auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+    auto errors = magix::compile::assemble(tokens, *raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    CHECK_RANGE_EQ(errors, expect_error);
+    return raw;
+}
+
+/** Run an entry on both executors with every step budget up to max_steps, the results and stacks have to match. */
+void
+check_same_as_raw(const magix::compile::ByteCodeRaw &raw, magix::u16 entry, size_t max_steps)
+{
+    const magix::execute::DecodedByteCode decoded = magix::execute::decode(raw);
+    auto raw_stack = std::make_unique<magix::execute::ExecStack>();
+    auto decoded_stack = std::make_unique<magix::execute::ExecStack>();
+
+    for (auto steps : magix::ranges::num_range(max_steps))
+    {
+        CAPTURE(steps);
+        raw_stack->clear();
+        decoded_stack->clear();
+        magix::execute::ExecutionContext raw_context{magix::execute::PageInfo{
+            raw_stack.get(), raw_stack->stack.size(), raw_stack->objbank.size(), {}, {}, {}, {},
+        }};
+        magix::execute::ExecutionContext decoded_context{magix::execute::PageInfo{
+            decoded_stack.get(), decoded_stack->stack.size(), decoded_stack->objbank.size(), {}, {}, {}, {},
+        }};
+
+        auto raw_result = magix::execute::execute(raw, entry, steps, raw_context);
+        auto decoded_result = magix::execute::execute(decoded, entry, steps, decoded_context);
+        CHECK_EQ(raw_result.type, decoded_result.type);
+        CHECK_EQ(raw_result.instruction_pointer, decoded_result.instruction_pointer);
+        CHECK_RANGE_EQ(raw_context.test_output, decoded_context.test_output);
+        CHECK_EQ(std::memcmp(raw_stack->stack.data(), decoded_stack->stack.data(), raw_stack->stack.size()), 0);
+    }
+}
+
+} // namespace
+
+TEST_SUITE("execution/decoded")
+{
+    TEST_CASE("loop, yield and exit")
+    {
+        auto raw = assemble_source(UR"(
+@entry:
+    set.u32 $0, #5
+loop:
+    sub.u32.imm $0, $0, #1
+    __unittest.put.u32 $0
+    if.zero #done, $0
+    goto #loop
+done:
+    yield_to #after
+after:
+    set.i16 $4, #-2
+    __unittest.put.i16 $4
+    exit
+)");
+        check_same_as_raw(*raw, raw->entry_points.find("entry")->value(), 40);
+
+        const magix::execute::DecodedByteCode decoded = magix::execute::decode(*raw);
+        CHECK(decoded.find(raw->entry_points.find("entry")->value()).has_value());
+    }
+
+    TEST_CASE("blocks run up to the next jump")
+    {
+        auto raw = assemble_source(UR"(
+@entry:
+    set.u32 $0, #3
+    set.u32 $4, #0
+loop:
+    add.u32.imm $4, $4, #2
+    sub.u32.imm $0, $0, #1
+    __unittest.put.u32 $4
+    if.zero #done, $0
+    goto #loop
+done:
+    __unittest.put.u32 $0
+    exit
+)");
+        const magix::execute::DecodedByteCode decoded = magix::execute::decode(*raw);
+        std::vector<magix::u32> block_steps;
+        for (const magix::execute::DecodedInstruction &instruction : decoded.instructions)
+        {
+            block_steps.push_back(instruction.block_steps);
+        }
+        // the jump target in the middle of the first block is charged the rest of it
+        const magix::u32 expected[] = {6, 5, 4, 3, 2, 1, 1, 2, 1};
+        CHECK_RANGE_EQ(block_steps, expected);
+
+        // every budget that runs out inside a block traps at the same instruction as counting each one
+        check_same_as_raw(*raw, raw->entry_points.find("entry")->value(), 30);
+    }
+
+    TEST_CASE("traps")
+    {
+        auto raw = assemble_source(UR"(
+@entry:
+    set.u32 $0, #3
+    set.u32 $3, #1
+@fall_off:
+    set.u32 $0, #3
+)");
+        check_same_as_raw(*raw, raw->entry_points.find("entry")->value(), 4);
+        check_same_as_raw(*raw, raw->entry_points.find("fall_off")->value(), 4);
+    }
+
+    TEST_CASE("entries that were not decoded")
+    {
+        auto raw = assemble_source(UR"(
+@entry:
+    set.u32 $0, #3
+    exit
+)");
+        // misaligned, inside an operand and past the program
+        check_same_as_raw(*raw, 1, 4);
+        check_same_as_raw(*raw, 2, 4);
+        check_same_as_raw(*raw, 40, 4);
+    }
+}
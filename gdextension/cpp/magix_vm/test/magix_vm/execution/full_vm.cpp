@@ -55,3 +55,74 @@ __unittest.put.u64 $8
         CHECK_RANGE_EQ(res.test_records[0], expected_put);
     }
 }
+
+TEST_CASE("casts right after set_program run once the program compiled")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+@cast_before_compiled:
+set.u32 $0, #11
+__unittest.put.u32 $0
+)");
+
+    magix::UniqueNode<magix::MagixVirtualMachine> vm{memnew(magix::MagixVirtualMachine)};
+    magix::MagixCaster *caster = memnew(magix::MagixCaster);
+    magix::MagixCastSlot *slot = memnew(magix::MagixCastSlot);
+    vm->add_child(caster);
+    caster->add_child(slot);
+    slot->set_program(prog);
+
+    // compiles in the background, the cast waits for it
+    slot->cast_spell(vm.get(), "cast_before_compiled");
+    // stands in for the frame the background compilation finishes in
+    REQUIRE(prog->compile());
+
+    auto res = vm->run_with_result(0.016);
+    if (CHECK_EQ(res.test_records.size(), 1))
+    {
+        const magix::execute::PrimitiveUnion expected_put[]{
+            magix::u32{11},
+        };
+        CHECK_RANGE_EQ(res.test_records[0], expected_put);
+    }
+}
+
+TEST_CASE("casts wait for the new source if it changes while compiling")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+@cast_while_source_changes:
+set.u32 $0, #12
+__unittest.put.u32 $0
+)");
+
+    magix::UniqueNode<magix::MagixVirtualMachine> vm{memnew(magix::MagixVirtualMachine)};
+    magix::MagixCaster *caster = memnew(magix::MagixCaster);
+    magix::MagixCastSlot *slot = memnew(magix::MagixCastSlot);
+    vm->add_child(caster);
+    caster->add_child(slot);
+    slot->set_program(prog);
+    slot->cast_spell(vm.get(), "cast_while_source_changes");
+
+    prog->set_asm_source(UR"(
+@cast_while_source_changes:
+set.u32 $0, #13
+__unittest.put.u32 $0
+)");
+    // the compilation of the old source finishes, it starts one of the new source instead
+    prog->finish_background_compile_now();
+    CHECK_FALSE(prog->is_compiled());
+    prog->finish_background_compile_now();
+    REQUIRE(prog->is_compiled());
+
+    auto res = vm->run_with_result(0.016);
+    if (CHECK_EQ(res.test_records.size(), 1))
+    {
+        const magix::execute::PrimitiveUnion expected_put[]{
+            magix::u32{13},
+        };
+        CHECK_RANGE_EQ(res.test_records[0], expected_put);
+    }
+}
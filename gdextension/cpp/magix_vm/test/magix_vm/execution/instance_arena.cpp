@@ -0,0 +1,83 @@
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/config.hpp"
+#include "magix_vm/execution/instance_arena.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/span.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <doctest.h>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+TEST_SUITE("execution/instance_arena")
+{
+    TEST_CASE("blocks are zeroed, aligned and apart")
+    {
+        magix::execute::InstanceArena arena{128};
+        std::vector<magix::span<std::byte>> blocks;
+        for (auto index : magix::ranges::num_range(3 * magix::execute::instance_slab_size / 128 + 1))
+        {
+            CAPTURE(index);
+            auto block = arena.allocate();
+            REQUIRE_EQ(block.size(), 128);
+            CHECK_EQ(reinterpret_cast<uintptr_t>(block.data()) % magix::execute::memory_granularity, 0);
+            CHECK(std::all_of(block.begin(), block.end(), [](std::byte value) { return value == std::byte{}; }));
+            std::fill(block.begin(), block.end(), std::byte{0xAB});
+            blocks.push_back(block);
+        }
+        std::sort(blocks.begin(), blocks.end(), [](auto lhs, auto rhs) { return lhs.data() < rhs.data(); });
+        for (auto index : magix::ranges::num_range(size_t{1}, blocks.size()))
+        {
+            CHECK_GE(blocks[index].data(), blocks[index - 1].data() + 128);
+        }
+    }
+
+    TEST_CASE("released blocks are reused before the arena grows")
+    {
+        magix::execute::InstanceArena arena{64};
+        std::vector<magix::span<std::byte>> blocks;
+        for (auto index : magix::ranges::num_range(100))
+        {
+            (void)index;
+            blocks.push_back(arena.allocate());
+        }
+        const size_t capacity = arena.capacity();
+        for (auto round : magix::ranges::num_range(10))
+        {
+            CAPTURE(round);
+            for (auto &block : blocks)
+            {
+                block[0] = std::byte{1};
+                arena.release(block);
+            }
+            for (auto &block : blocks)
+            {
+                block = arena.allocate();
+                CHECK_EQ(block[0], std::byte{});
+            }
+            CHECK_EQ(arena.capacity(), capacity);
+        }
+    }
+
+    TEST_CASE("blocks larger than a slab get a slab each")
+    {
+        magix::execute::InstanceArena arena{2 * magix::execute::instance_slab_size};
+        auto first = arena.allocate();
+        auto second = arena.allocate();
+        CHECK_EQ(first.size(), 2 * magix::execute::instance_slab_size);
+        CHECK_NE(first.data(), second.data());
+        CHECK_EQ(arena.capacity(), 2);
+    }
+
+    TEST_CASE("empty blocks need no memory")
+    {
+        magix::execute::InstanceArena arena;
+        CHECK_EQ(arena.allocate().size(), 0);
+        CHECK_EQ(arena.capacity(), 0);
+    }
+}
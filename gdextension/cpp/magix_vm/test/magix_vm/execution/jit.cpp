@@ -0,0 +1,252 @@
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/jit.hpp"
+#include "magix_vm/execution/stencils.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <array>
+#include <cstring>
+#include <doctest.h>
+#include <memory>
+#include <string>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+struct Compiled
+{
+    std::unique_ptr<magix::compile::ByteCodeRaw> raw;
+    std::unique_ptr<magix::execute::DecodedByteCode> decoded;
+    magix::execute::JitProgram jit;
+    magix::execute::JitProgram stencil_jit;
+};
+
+auto
+compile_source(magix::compile::SrcView source) -> Compiled
+{
+    CAPTURE(source);
+    auto tokens = magix::compile::lex(source);
+    Compiled out{std::make_unique<magix::compile::ByteCodeRaw>(), std::make_unique<magix::execute::DecodedByteCode>(), {}, {}};
+    auto errors = magix::compile::assemble(tokens, *out.raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    CHECK_RANGE_EQ(errors, expect_error);
+    *out.decoded = magix::execute::decode(*out.raw);
+    magix::execute::verify(*out.decoded);
+    out.jit = magix::execute::jit_compile(*out.decoded);
+    out.stencil_jit = magix::execute::jit_compile(*out.decoded, true);
+    return out;
+}
+
+/** Memory a single execution can touch, filled with the same pattern for every executor. */
+struct Memory
+{
+    std::unique_ptr<magix::execute::ExecStack> stack = std::make_unique<magix::execute::ExecStack>();
+    std::array<std::byte, 16> fork{};
+    std::array<std::byte, 16> shared{};
+
+    explicit Memory(bool pattern)
+    {
+        stack->clear();
+        if (pattern)
+        {
+            for (auto index : magix::ranges::num_range(stack->stack.size()))
+            {
+                stack->stack[index] = static_cast<std::byte>(index * 7 + 3);
+            }
+            for (auto index : magix::ranges::num_range(fork.size()))
+            {
+                fork[index] = static_cast<std::byte>(index * 5 + 1);
+                shared[index] = static_cast<std::byte>(index * 3 + 2);
+            }
+        }
+    }
+
+    auto
+    context() -> magix::execute::ExecutionContext
+    {
+        return magix::execute::ExecutionContext{magix::execute::PageInfo{
+            stack.get(), stack->stack.size(), stack->objbank.size(), shared, fork, {}, {},
+        }};
+    }
+};
+
+/** Run the entry on the raw executor and both jits with every step budget up to steps, everything observable must match. */
+void
+check_same_as_raw(const Compiled &program, magix::u16 entry, size_t steps)
+{
+    for (const magix::execute::JitProgram *jit : {&program.jit, &program.stencil_jit})
+    {
+        for (bool pattern : {false, true})
+        {
+            for (auto step_budget : magix::ranges::num_range(steps + 1))
+            {
+                CAPTURE(jit == &program.stencil_jit);
+                CAPTURE(pattern);
+                CAPTURE(step_budget);
+                Memory raw_memory{pattern};
+                Memory jit_memory{pattern};
+                auto raw_context = raw_memory.context();
+                auto jit_context = jit_memory.context();
+
+                auto raw_result = magix::execute::execute(*program.raw, entry, step_budget, raw_context);
+                auto jit_result = magix::execute::execute(*jit, entry, step_budget, jit_context);
+                CHECK_EQ(raw_result.type, jit_result.type);
+                CHECK_EQ(raw_result.instruction_pointer, jit_result.instruction_pointer);
+                CHECK_RANGE_EQ(raw_context.test_output, jit_context.test_output);
+                CHECK_EQ(raw_context.bound_mana, jit_context.bound_mana);
+                CHECK_EQ(std::memcmp(raw_memory.stack->stack.data(), jit_memory.stack->stack.data(), raw_memory.stack->stack.size()), 0);
+                const auto raw_objects = raw_memory.stack->objbank.as_const_bytes();
+                CHECK_EQ(std::memcmp(raw_objects.data(), jit_memory.stack->objbank.data(), raw_objects.size()), 0);
+                CHECK_EQ(std::memcmp(raw_memory.fork.data(), jit_memory.fork.data(), raw_memory.fork.size()), 0);
+                CHECK_EQ(std::memcmp(raw_memory.shared.data(), jit_memory.shared.data(), raw_memory.shared.size()), 0);
+            }
+        }
+    }
+}
+
+/** Every verified entry is expected to get native code on platforms that have a jit. */
+void
+check_native(const Compiled &program, magix::u16 entry)
+{
+    if (magix::execute::jit_available() && program.decoded->is_verified(entry, magix::execute::stack_size_default))
+    {
+        CHECK(program.jit.find(entry).has_value());
+        CHECK(program.stencil_jit.find(entry).has_value());
+    }
+}
+
+/** One instruction followed by its outputs, same operands as the autotest but with a few locals to vary the values. */
+auto
+single_instruction_source(const magix::compile::InstructionSpec &spec) -> std::u32string
+{
+    std::u32string source = U".fork_size 16\n.shared_size 16\n@entry:\n    ";
+    source.append(spec.mnenomic.begin(), spec.mnenomic.end());
+    constexpr magix::compile::SrcView locals[] = {U"$0", U"$8", U"$16", U"$24"};
+    size_t local_index = 0;
+    bool first = true;
+    for (auto &&reg : spec.registers)
+    {
+        if (reg.mode == magix::compile::InstructionRegisterSpec::Mode::UNUSED)
+        {
+            break;
+        }
+        source += first ? U" " : U", ";
+        first = false;
+        if (reg.mode == magix::compile::InstructionRegisterSpec::Mode::LOCAL)
+        {
+            source += locals[local_index++ % magix::array_size(locals)];
+        }
+        else if (reg.is_code_address)
+        {
+            source += U"#after";
+        }
+        else
+        {
+            source += U"#4";
+        }
+    }
+    source += U"\nafter:\n";
+    for (auto local : locals)
+    {
+        source += U"    __unittest.put.u64 ";
+        source += local;
+        source += U"\n";
+    }
+    source += U"    exit\n";
+    return source;
+}
+
+} // namespace
+
+TEST_SUITE("execution/jit")
+{
+    TEST_CASE("every instruction matches the interpreter")
+    {
+        for (auto &&spec : magix::compile::all_instruction_specs())
+        {
+            // needs a caster node in the tree
+            if (spec.is_host_call)
+            {
+                continue;
+            }
+            const std::u32string source = single_instruction_source(spec);
+            CAPTURE(source);
+            auto program = compile_source(source);
+            const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+            check_same_as_raw(program, entry, 8);
+            check_native(program, entry);
+        }
+    }
+
+    TEST_CASE("loops and yields match the interpreter")
+    {
+        auto program = compile_source(UR"(
+.fork_size 16
+@entry:
+    set.u32 $0, #5
+loop:
+    fork.load $4, #0, #4
+    add.u32.imm $4, $4, #3
+    fork.store $4, #0, #4
+    add.u32.imm $8, $8, #2
+    add.u32.imm $8, $8, #1
+    __unittest.put.u32 $8
+    sub.u32.imm $0, $0, #1
+    if.zero #done, $0
+    goto #loop
+done:
+    yield_to #after
+@after:
+    mov.b32 $12, $8
+    __unittest.put.u32 $12
+    fork.load $4, #4, #16
+    add.u32.imm $4, $4, #1
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        check_native(program, entry);
+        check_same_as_raw(program, entry, 64);
+        const magix::u16 after = program.raw->entry_points.find("after")->value();
+        check_same_as_raw(program, after, 8);
+    }
+
+    TEST_CASE("actions without a hand written translation get a stencil")
+    {
+        if (!magix::execute::jit_available())
+        {
+            return;
+        }
+        for (magix::compile::SrcView mnenomic : {U"get_bound_mana", U"mov.b32", U"fork.load", U"__fused.add.u32.imm__add.u32.imm"})
+        {
+            CAPTURE(mnenomic);
+            const magix::compile::InstructionSpec *spec = magix::compile::get_instruction_spec(mnenomic);
+            REQUIRE_NE(spec, nullptr);
+            CHECK_NE(magix::execute::find_stencil(spec->opcode), nullptr);
+        }
+    }
+
+    TEST_CASE("unverified entries fall back to the interpreter")
+    {
+        auto program = compile_source(UR"(
+@entry:
+    get_stack $0
+    add.u32.imm $0, $0, #4096
+    set_stack $0
+    __unittest.put.u32 $0
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        CHECK(!program.jit.find(entry).has_value());
+        check_same_as_raw(program, entry, 8);
+    }
+}
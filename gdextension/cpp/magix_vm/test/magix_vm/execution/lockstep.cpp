@@ -0,0 +1,261 @@
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/lockstep.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <array>
+#include <cstring>
+#include <doctest.h>
+#include <memory>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+struct Compiled
+{
+    std::unique_ptr<magix::compile::ByteCodeRaw> raw;
+    std::unique_ptr<magix::execute::DecodedByteCode> decoded;
+    magix::execute::LockstepProgram lockstep;
+};
+
+auto
+compile_source(magix::compile::SrcView source) -> Compiled
+{
+    CAPTURE(source);
+    auto tokens = magix::compile::lex(source);
+    Compiled out{std::make_unique<magix::compile::ByteCodeRaw>(), std::make_unique<magix::execute::DecodedByteCode>(), {}};
+    auto errors = magix::compile::assemble(tokens, *out.raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    CHECK_RANGE_EQ(errors, expect_error);
+    *out.decoded = magix::execute::decode(*out.raw);
+    magix::execute::verify(*out.decoded);
+    out.lockstep = magix::execute::lockstep_compile(*out.decoded);
+    return out;
+}
+
+using Fork = std::array<std::byte, 16>;
+
+/** Everything the instances of one run can change, they share the stack, the shared page and the test output. */
+struct Instances
+{
+    std::unique_ptr<magix::execute::ExecStack> stack = std::make_unique<magix::execute::ExecStack>();
+    std::vector<Fork> forks;
+    std::array<std::byte, 16> shared{};
+    magix::execute::ExecutionContext context{magix::execute::PageInfo{}};
+    std::vector<magix::execute::ExecResult> results;
+
+    explicit Instances(size_t count) : forks(count)
+    {
+        for (auto lane : magix::ranges::num_range(count))
+        {
+            for (auto index : magix::ranges::num_range(forks[lane].size()))
+            {
+                forks[lane][index] = static_cast<std::byte>(lane * 13 + index * 7 + 1);
+            }
+        }
+    }
+
+    void
+    use_fork(size_t lane)
+    {
+        context.page_info = magix::execute::PageInfo{
+            stack.get(), stack->stack.size(), stack->objbank.size(), shared, forks[lane], {}, {},
+        };
+    }
+};
+
+/** Run the instances in lockstep and one after another on a zeroed stack each, everything observable must match. */
+auto
+check_same_as_sequential(const Compiled &program, magix::u16 entry, size_t count, size_t steps) -> magix::execute::LockstepBatch
+{
+    REQUIRE(program.lockstep.can_run(entry, magix::execute::stack_size_default));
+    Instances sequential{count};
+    for (auto lane : magix::ranges::num_range(count))
+    {
+        sequential.stack->clear();
+        sequential.use_fork(lane);
+        sequential.results.push_back(magix::execute::execute(*program.decoded, entry, steps, sequential.context));
+    }
+
+    Instances batched{count};
+    batched.stack->clear();
+    std::vector<magix::span<std::byte>> forks(batched.forks.begin(), batched.forks.end());
+    magix::execute::LockstepBatch batch;
+    batch.run(program.lockstep, entry, forks, steps);
+    for (auto lane : magix::ranges::num_range(count))
+    {
+        batched.use_fork(lane);
+        batched.results.push_back(batch.finish(lane, batched.context));
+    }
+
+    for (auto lane : magix::ranges::num_range(count))
+    {
+        CAPTURE(lane);
+        CHECK_EQ(sequential.results[lane].type, batched.results[lane].type);
+        CHECK_EQ(sequential.results[lane].instruction_pointer, batched.results[lane].instruction_pointer);
+        CHECK_EQ(std::memcmp(sequential.forks[lane].data(), batched.forks[lane].data(), sizeof(Fork)), 0);
+    }
+    CHECK_EQ(std::memcmp(sequential.shared.data(), batched.shared.data(), sequential.shared.size()), 0);
+    CHECK_RANGE_EQ(sequential.context.test_output, batched.context.test_output);
+    return batch;
+}
+
+/** Run with every step budget up to steps and a few lane counts. */
+void
+check_all_budgets(const Compiled &program, magix::u16 entry, size_t steps)
+{
+    for (size_t count : {size_t{1}, size_t{3}, magix::execute::lockstep_lane_count})
+    {
+        for (auto step_budget : magix::ranges::num_range(steps + 1))
+        {
+            CAPTURE(count);
+            CAPTURE(step_budget);
+            (void)check_same_as_sequential(program, entry, count, step_budget);
+        }
+    }
+}
+
+[[nodiscard]] auto
+diverged_lanes(const magix::execute::LockstepBatch &batch) -> size_t
+{
+    size_t count = 0;
+    for (const magix::execute::LaneExit &exit : batch.exits())
+    {
+        count += exit.diverged ? 1 : 0;
+    }
+    return count;
+}
+
+} // namespace
+
+TEST_SUITE("execution/lockstep")
+{
+    TEST_CASE("lanes on the same path stay together")
+    {
+        auto program = compile_source(UR"(
+.fork_size 16
+@entry:
+    set.u32 $0, #5
+loop:
+    fork.load $4, #0, #4
+    add.u32.imm $4, $4, #3
+    fork.store $4, #0, #4
+    add.u32 $8, $8, $4
+    sub.u32.imm $0, $0, #1
+    if.zero #done, $0
+    goto #loop
+done:
+    fork.store $8, #4, #4
+    yield_to #entry
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        check_all_budgets(program, entry, 40);
+        auto batch = check_same_as_sequential(program, entry, magix::execute::lockstep_lane_count, 100);
+        CHECK_EQ(diverged_lanes(batch), 0);
+    }
+
+    TEST_CASE("lanes that branch the other way go on alone")
+    {
+        auto program = compile_source(UR"(
+.fork_size 16
+@entry:
+    set.u32 $0, #0
+    fork.load $0, #0, #1
+    set.u32 $4, #7
+loop:
+    sub.u32.imm $4, $4, #1
+    if.zero #odd, $0
+    add.u32.imm $8, $8, #2
+    sub.u32.imm $0, $0, #1
+    if.zero #done, $4
+    goto #loop
+odd:
+    add.u32.imm $8, $8, #1
+done:
+    fork.store $8, #8, #4
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        check_all_budgets(program, entry, 48);
+        auto batch = check_same_as_sequential(program, entry, magix::execute::lockstep_lane_count, 100);
+        CHECK_GT(diverged_lanes(batch), 0);
+        CHECK_LT(diverged_lanes(batch), magix::execute::lockstep_lane_count);
+    }
+
+    TEST_CASE("instructions outside the lane run in instance order")
+    {
+        auto program = compile_source(UR"(
+.fork_size 16
+.shared_size 16
+value:
+.u64 1311768467463790320
+@entry:
+    fork.load $0, #0, #8
+    load.b64 $8, #value
+    set.u16 $16, #65535
+    mov.b8 $18, $0
+    mov.b16 $20, $2
+    mov.b64 $24, $8
+    stack_resize #32
+    get_stack $0
+    addr_of $4, $8
+    stack_resize #-32
+    shared.load $40, #0, #4
+    add.u32 $40, $40, $0
+    shared.store $40, #0, #4
+    __unittest.put.u64 $8
+    __unittest.put.u16 $16
+    __unittest.put.u8 $18
+    __unittest.put.u16 $20
+    __unittest.put.u64 $24
+    __unittest.put.u32 $32
+    __unittest.put.u32 $36
+    __unittest.put.u32 $40
+    fork.store $16, #0, #16
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        check_all_budgets(program, entry, 24);
+        auto batch = check_same_as_sequential(program, entry, magix::execute::lockstep_lane_count, 100);
+        CHECK_EQ(diverged_lanes(batch), magix::execute::lockstep_lane_count);
+    }
+
+    TEST_CASE("traps are the same for every lane")
+    {
+        auto program = compile_source(UR"(
+.fork_size 16
+@entry:
+    fork.load $0, #4, #4
+    add.u32.imm $0, $0, #1
+    fork.store $0, #14, #4
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        check_all_budgets(program, entry, 4);
+    }
+
+    TEST_CASE("unverified entries can not run in lockstep")
+    {
+        auto program = compile_source(UR"(
+@entry:
+    get_stack $0
+    add.u32.imm $0, $0, #4096
+    set_stack $0
+    __unittest.put.u32 $0
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        CHECK(!program.lockstep.can_run(entry, magix::execute::stack_size_default));
+    }
+}
@@ -5,9 +5,16 @@
 #include "magix_vm/MagixCaster.hpp"
 #include "magix_vm/compilation/printing.hpp"
 #include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/config.hpp"
+#include "magix_vm/ranges.hpp"
 #include "magix_vm/types.hpp"
 #include "magix_vm/unique_node.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
 #ifndef MAGIX_BUILD_TESTS
 #error TEST FILE BUILT WITHOUT TESTS ENABLED
 #endif
@@ -156,3 +163,507 @@ loop:
         }
     }
 }
+
+TEST_CASE("users run the same on any worker count")
+{
+    godot::Ref<magix::MagixAsmProgram> pure;
+    pure.instantiate();
+    pure->set_asm_source(UR"(
+.fork_size 4
+@one:
+    set.u32 $0, #1
+    goto #put
+@two:
+    set.u32 $0, #2
+    goto #put
+@three:
+    set.u32 $0, #3
+put:
+    fork.load $4, #0, #4
+    add.u32 $0, $0, $4
+    __unittest.put.u32 $0
+    exit
+)");
+    godot::Ref<magix::MagixAsmProgram> host;
+    host.instantiate();
+    host->set_asm_source(UR"(
+mana_amount:
+.f32 2.0
+@one:
+    load.f32 $0, #mana_amount
+    allocate_mana $0, $0
+    __unittest.put.f32 $0
+    yield_to #one
+)");
+    godot::Ref<magix::MagixByteCode> pure_bc = pure->get_bytecode();
+    godot::Ref<magix::MagixByteCode> host_bc = host->get_bytecode();
+    if (!CHECK_NE(pure_bc, nullptr) || !CHECK_NE(host_bc, nullptr))
+    {
+        return;
+    }
+    CHECK(!pure_bc->get_decoded().calls_host);
+    CHECK(host_bc->get_decoded().calls_host);
+
+    magix::execute::ExecRunner serial;
+    magix::execute::ExecRunner parallel;
+    parallel.set_worker_count(4);
+    CHECK_EQ(parallel.get_worker_count(), 4);
+
+    std::vector<magix::UniqueNode<magix::MagixCaster>> casters;
+    for (auto index : magix::ranges::num_range(8))
+    {
+        casters.emplace_back(magix::make_unique_node<magix::MagixCaster>());
+    }
+    auto cast = [&](const godot::Ref<magix::MagixByteCode> &bc, size_t caster, const char *entry) {
+        for (magix::execute::ExecRunner *runner : {&serial, &parallel})
+        {
+            runner->enqueue_cast_spell(casters[caster].get(), bc, bc->get_code().entry_points.find(entry)->value());
+        }
+    };
+    // the host calling spells keep yielding, the others exit and are cast again every round
+    for (size_t caster = 0; caster < casters.size(); caster += 3)
+    {
+        cast(host_bc, caster, "one");
+    }
+
+    for (auto round : magix::ranges::num_range(3))
+    {
+        CAPTURE(round);
+        for (auto caster : magix::ranges::num_range(casters.size()))
+        {
+            cast(pure_bc, caster, "one");
+        }
+        // one caster has more instances than fit a chunk, in an order the records show
+        for (auto index : magix::ranges::num_range(3 * magix::execute::instance_chunk_size))
+        {
+            const char *entries[] = {"one", "two", "three"};
+            cast(pure_bc, 1, entries[(index * 7 / 5) % 3]);
+        }
+        // both runners get the same mana to allocate from
+        for (auto &caster : casters)
+        {
+            caster->set_available_mana(5.0);
+        }
+        auto serial_result = serial.run_all();
+        for (auto &caster : casters)
+        {
+            caster->set_available_mana(5.0);
+        }
+        auto parallel_result = parallel.run_all();
+        if (CHECK_EQ(serial_result.test_records.size(), parallel_result.test_records.size()))
+        {
+            for (auto index : magix::ranges::num_range(serial_result.test_records.size()))
+            {
+                CAPTURE(index);
+                CHECK_RANGE_EQ(serial_result.test_records[index], parallel_result.test_records[index]);
+            }
+        }
+    }
+}
+
+TEST_CASE("casts by one caster share a user")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+@entry:
+    exit
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+    const magix::u16 entry = bc->get_code().entry_points.find("entry")->value();
+
+    magix::execute::ExecRunner runner;
+    auto caster = magix::make_unique_node<magix::MagixCaster>();
+    auto other = magix::make_unique_node<magix::MagixCaster>();
+    const magix::execute::UserHandle first = runner.enqueue_cast_spell(caster.get(), bc, entry);
+    const magix::execute::UserHandle second = runner.enqueue_cast_spell(caster.get(), bc, entry);
+    const magix::execute::UserHandle third = runner.enqueue_cast_spell(other.get(), bc, entry);
+    CHECK(first.is_valid());
+    CHECK_EQ(first, second);
+    CHECK_NE(first, third);
+    if (CHECK_NE(runner.find_user(first), nullptr))
+    {
+        CHECK_EQ(runner.find_user(first)->instances.size(), 2);
+    }
+
+    // a gone caster takes its users with it
+    other = nullptr;
+    (void)runner.run_all();
+    CHECK_NE(runner.find_user(first), nullptr);
+    CHECK_EQ(runner.find_user(third), nullptr);
+
+    runner.clear();
+    CHECK_EQ(runner.find_user(first), nullptr);
+}
+
+TEST_CASE("a frame budget runs users in fair rounds")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+@entry:
+    set.u32 $0, #1
+    __unittest.put.u32 $0
+    exit
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+    const magix::u16 entry = bc->get_code().entry_points.find("entry")->value();
+
+    magix::execute::ExecRunner runner;
+    std::vector<magix::UniqueNode<magix::MagixCaster>> casters;
+    std::vector<magix::execute::UserHandle> users;
+    auto cast = [&]() {
+        casters.emplace_back(magix::make_unique_node<magix::MagixCaster>());
+        users.push_back(runner.enqueue_cast_spell(casters.back().get(), bc, entry));
+    };
+    // the program exits, so a user that ran has no instances left
+    auto not_run = [&]() {
+        size_t count = 0;
+        for (const magix::execute::UserHandle &user : users)
+        {
+            count += runner.find_user(user)->instances.size();
+        }
+        return count;
+    };
+    for (auto index : magix::ranges::num_range(5))
+    {
+        cast();
+    }
+
+    // without any budget every call runs one user
+    const magix::execute::ExecRunner::BudgetMetrics &metrics = runner.budget_metrics();
+    auto result = runner.run_budgeted(std::chrono::microseconds{0});
+    CHECK_EQ(result.test_records.size(), 1);
+    CHECK_EQ(metrics.users_run, 1);
+    CHECK_EQ(metrics.users_waiting, 4);
+    CHECK_EQ(not_run(), 4);
+
+    // a user cast during the round waits for the next one
+    cast();
+    for (auto call : magix::ranges::num_range(4))
+    {
+        CAPTURE(call);
+        result = runner.run_budgeted(std::chrono::microseconds{0});
+        CHECK_EQ(result.test_records.size(), 1);
+    }
+    CHECK_EQ(metrics.rounds_completed, 1);
+    CHECK_EQ(metrics.users_waiting, 0);
+    CHECK_EQ(not_run(), 1);
+    CHECK_EQ(runner.find_user(users.back())->instances.size(), 1);
+
+    // with plenty of time a call finishes the round, but never runs a user twice
+    result = runner.run_budgeted(std::chrono::microseconds{0});
+    CHECK_EQ(metrics.users_waiting, 5);
+    result = runner.run_budgeted(std::chrono::hours{1});
+    CHECK_EQ(result.test_records.size(), 5);
+    CHECK_EQ(metrics.users_run, 5);
+    CHECK_EQ(metrics.rounds_completed, 2);
+    CHECK_EQ(metrics.overrun.count(), 0);
+    CHECK_EQ(not_run(), 0);
+}
+
+TEST_CASE("sleeping instances wake after their ticks")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+.fork_size 4
+mana_amount:
+.f32 1.0
+@entry:
+    load.f32 $0, #mana_amount
+    allocate_mana $0, $0
+loop:
+    fork.load $4, #0, #4
+    add.u32.imm $4, $4, #1
+    fork.store $4, #0, #4
+    __unittest.put.u32 $4
+    sleep_ticks.imm #3
+    yield_to #loop
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+
+    magix::execute::ExecRunner runner;
+    auto caster = magix::make_unique_node<magix::MagixCaster>();
+    caster->set_available_mana(1.0);
+    const magix::execute::UserHandle user = runner.enqueue_cast_spell(caster.get(), bc, bc->get_code().entry_points.find("entry")->value());
+    const magix::execute::PerIDData *per_id = runner.find_user(user);
+    REQUIRE_NE(per_id, nullptr);
+
+    std::vector<magix::u32> ran_at;
+    for (auto tick : magix::ranges::num_range(10))
+    {
+        auto result = runner.run_all();
+        REQUIRE_EQ(result.test_records.size(), 1);
+        if (!result.test_records[0].empty())
+        {
+            ran_at.push_back(static_cast<magix::u32>(tick));
+            CHECK_EQ(result.test_records[0][0], magix::execute::PrimitiveUnion{static_cast<magix::u32>(ran_at.size())});
+        }
+        // asleep, the user has no instance to run but still counts it
+        CHECK_EQ(per_id->instances.size(), 0);
+        CHECK_EQ(per_id->sleeping, 1);
+    }
+    CHECK_EQ(ran_at, std::vector<magix::u32>{0, 3, 6, 9});
+
+    // every tick slept costs upkeep, so a long sleep the instance can not pay for ends it
+    runner.clear();
+    godot::Ref<magix::MagixAsmProgram> sleepy;
+    sleepy.instantiate();
+    sleepy->set_asm_source(UR"(
+@entry:
+    set.u32 $0, #1000
+    sleep_ticks $0
+    yield_to #entry
+)");
+    godot::Ref<magix::MagixByteCode> sleepy_bc = sleepy->get_bytecode();
+    if (!CHECK_NE(sleepy_bc, nullptr))
+    {
+        return;
+    }
+    const magix::execute::UserHandle poor =
+        runner.enqueue_cast_spell(caster.get(), sleepy_bc, sleepy_bc->get_code().entry_points.find("entry")->value());
+    (void)runner.run_all();
+    REQUIRE_NE(runner.find_user(poor), nullptr);
+    CHECK_EQ(runner.find_user(poor)->sleeping, 0);
+    CHECK_EQ(runner.find_user(poor)->instances.size(), 0);
+}
+
+TEST_CASE("a mana ledger reserves once per tick and settles what is left")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+mana_amount:
+.f32 2.0
+@entry:
+    load.f32 $0, #mana_amount
+    allocate_mana $0, $0
+    __unittest.put.f32 $0
+    exit
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+    const magix::u16 entry = bc->get_code().entry_points.find("entry")->value();
+
+    magix::execute::ExecRunner runner;
+    runner.set_mana_ledger(true);
+    auto caster = magix::make_unique_node<magix::MagixCaster>();
+    caster->set_available_mana(5.0f);
+    for (auto index : magix::ranges::num_range(3))
+    {
+        runner.enqueue_cast_spell(caster.get(), bc, entry);
+    }
+    // the third request does not fit what is left, the rest goes back to the caster
+    auto result = runner.run_all();
+    using PUnion = magix::execute::PrimitiveUnion;
+    if (CHECK_EQ(result.test_records.size(), 1))
+    {
+        CHECK_RANGE_EQ(result.test_records[0], magix::make_std_array<PUnion>(2.0f, 2.0f, 0.0f));
+    }
+    CHECK_EQ(caster->get_available_mana(), 1.0f);
+
+    runner.enqueue_cast_spell(caster.get(), bc, entry);
+    result = runner.run_all();
+    if (CHECK_EQ(result.test_records.size(), 1))
+    {
+        CHECK_RANGE_EQ(result.test_records[0], magix::make_std_array<PUnion>(0.0f));
+    }
+    CHECK_EQ(caster->get_available_mana(), 1.0f);
+}
+
+TEST_CASE("a mana ledger settles after every budgeted call, not every round")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+mana_amount:
+.f32 2.0
+@entry:
+    load.f32 $0, #mana_amount
+    allocate_mana $0, $0
+    __unittest.put.f32 $0
+    exit
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+    const magix::u16 entry = bc->get_code().entry_points.find("entry")->value();
+
+    magix::execute::ExecRunner runner;
+    runner.set_mana_ledger(true);
+    auto first = magix::make_unique_node<magix::MagixCaster>();
+    auto second = magix::make_unique_node<magix::MagixCaster>();
+    first->set_available_mana(5.0f);
+    second->set_available_mana(5.0f);
+    runner.enqueue_cast_spell(first.get(), bc, entry);
+    runner.enqueue_cast_spell(second.get(), bc, entry);
+
+    // the round spans two calls, the caster that ran has its mana back in between
+    const magix::execute::ExecRunner::BudgetMetrics &metrics = runner.budget_metrics();
+    (void)runner.run_budgeted(std::chrono::microseconds{0});
+    CHECK_EQ(metrics.users_waiting, 1);
+    CHECK_EQ(std::min(first->get_available_mana(), second->get_available_mana()), 3.0f);
+    CHECK_EQ(std::max(first->get_available_mana(), second->get_available_mana()), 5.0f);
+
+    (void)runner.run_budgeted(std::chrono::microseconds{0});
+    CHECK_EQ(metrics.rounds_completed, 1);
+    CHECK_EQ(first->get_available_mana(), 3.0f);
+    CHECK_EQ(second->get_available_mana(), 3.0f);
+
+    // what goes back never exceeds the max, even if the caster was refilled meanwhile
+    auto refilled = magix::make_unique_node<magix::MagixCaster>();
+    refilled->set_max_mana(5.0f);
+    refilled->set_available_mana(5.0f);
+    const magix::f32 reserved = refilled->reserve_mana();
+    refilled->set_available_mana(4.0f);
+    refilled->settle_mana(reserved, 1.0f);
+    CHECK_EQ(refilled->get_available_mana(), 5.0f);
+}
+
+TEST_CASE("host requests are answered in one batch before the instance resumes")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+.fork_size 128
+mana_amount:
+.f32 1.0
+@entry:
+    load.f32 $0, #mana_amount
+    allocate_mana $0, $0
+    fork.load $4, #0, #4
+    fork.store $4, #64, #4
+    host_request #7, #64
+    yield_to #resume
+@resume:
+    fork.load $0, #64, #4
+    __unittest.put.u32 $0
+    exit
+@out_of_fork:
+    host_request #7, #65
+    exit
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+
+    magix::execute::ExecRunner runner;
+    std::vector<std::vector<magix::u32>> batches;
+    runner.set_host_call_handler([&](magix::u16 kind, magix::span<magix::execute::HostCall> calls) {
+        CHECK_EQ(kind, 7);
+        std::vector<magix::u32> &batch = batches.emplace_back();
+        for (magix::execute::HostCall &call : calls)
+        {
+            CHECK_EQ(call.record.size(), magix::execute::host_request_record_size);
+            magix::u32 value;
+            std::memcpy(&value, call.record.data(), sizeof(value));
+            batch.push_back(value);
+            value += 100;
+            std::memcpy(call.record.data(), &value, sizeof(value));
+        }
+    });
+
+    std::vector<magix::UniqueNode<magix::MagixCaster>> casters;
+    for (auto index : magix::ranges::num_range(2))
+    {
+        casters.emplace_back(magix::make_unique_node<magix::MagixCaster>());
+        casters.back()->set_available_mana(10.0f);
+        for (auto instance : magix::ranges::num_range(3))
+        {
+            runner.enqueue_cast_spell(casters.back().get(), bc, bc->get_code().entry_points.find("entry")->value());
+        }
+    }
+    auto result = runner.run_all();
+    REQUIRE_EQ(batches.size(), 1);
+    CHECK_EQ(batches[0].size(), 6);
+
+    // the results are there when the instances go on
+    using PUnion = magix::execute::PrimitiveUnion;
+    result = runner.run_all();
+    CHECK_EQ(batches.size(), 1);
+    if (CHECK_EQ(result.test_records.size(), 2))
+    {
+        const auto expected = magix::make_std_array<PUnion>(magix::u32{100}, magix::u32{100}, magix::u32{100});
+        CHECK_RANGE_EQ(result.test_records[0], expected);
+        CHECK_RANGE_EQ(result.test_records[1], expected);
+    }
+
+    // the whole record has to be in the fork page
+    const magix::execute::UserHandle trapping =
+        runner.enqueue_cast_spell(casters[0].get(), bc, bc->get_code().entry_points.find("out_of_fork")->value());
+    (void)runner.run_all();
+    CHECK_EQ(runner.find_user(trapping), nullptr);
+    CHECK_EQ(batches.size(), 1);
+}
+
+TEST_CASE("render.push draws into the buffer of the program for one tick")
+{
+    godot::Ref<magix::MagixAsmProgram> prog;
+    prog.instantiate();
+    prog->set_asm_source(UR"(
+@entry:
+    set.u32 $0, #1
+    set.u32 $60, #2
+    render.push $0
+    set.u32 $60, #3
+    render.push $0
+    yield_to #resume
+@resume:
+    exit
+)");
+    godot::Ref<magix::MagixByteCode> bc = prog->get_bytecode();
+    if (!CHECK_NE(bc, nullptr))
+    {
+        return;
+    }
+
+    magix::execute::ExecRunner runner;
+    std::vector<magix::UniqueNode<magix::MagixCaster>> casters;
+    for (auto index : magix::ranges::num_range(2))
+    {
+        casters.emplace_back(magix::make_unique_node<magix::MagixCaster>());
+        casters.back()->set_available_mana(10.0f);
+        for (auto instance : magix::ranges::num_range(3))
+        {
+            runner.enqueue_cast_spell(casters.back().get(), bc, bc->get_code().entry_points.find("entry")->value());
+        }
+    }
+    CHECK_EQ(runner.render_buffer(bc.ptr()).size(), 0);
+
+    (void)runner.run_all();
+    const magix::span<const magix::f32> items = runner.render_buffer(bc.ptr());
+    REQUIRE_EQ(items.size(), 12 * magix::execute::render_item_floats);
+    for (auto item : magix::ranges::num_range(12))
+    {
+        magix::u32 first;
+        magix::u32 last;
+        std::memcpy(&first, &items[item * magix::execute::render_item_floats], sizeof(first));
+        std::memcpy(&last, &items[(item + 1) * magix::execute::render_item_floats - 1], sizeof(last));
+        CHECK_EQ(first, 1);
+        CHECK_EQ(last, item % 2 == 0 ? 2 : 3);
+    }
+
+    // nothing is drawn in the next tick
+    (void)runner.run_all();
+    CHECK_EQ(runner.render_buffer(bc.ptr()).size(), 0);
+}
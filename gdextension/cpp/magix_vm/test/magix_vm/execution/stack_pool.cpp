@@ -0,0 +1,135 @@
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/config.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/stack_pool.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <doctest.h>
+#include <memory>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+TEST_SUITE("execution/stack_pool")
+{
+    TEST_CASE("size classes double from the smallest up to the defaults")
+    {
+        using Pool = magix::execute::ExecStackPool;
+        CHECK_EQ(Pool::stack_size_class(0), magix::execute::stack_size_class_min);
+        CHECK_EQ(Pool::stack_size_class(1024), 1024);
+        CHECK_EQ(Pool::stack_size_class(1025), 2048);
+        CHECK_EQ(Pool::stack_size_class(magix::execute::stack_size_default), magix::execute::stack_size_default);
+        CHECK_EQ(Pool::stack_size_class(magix::execute::stack_size_default + 1), magix::execute::stack_size_default);
+        CHECK_EQ(Pool::objbank_size_class(0), magix::execute::objbank_size_class_min);
+        CHECK_EQ(Pool::objbank_size_class(17), 32);
+        CHECK_EQ(Pool::objbank_size_class(1u << 20), magix::execute::objbank_size_default);
+    }
+
+    TEST_CASE("stacks are reused per size class and cleared")
+    {
+        magix::execute::ExecStackPool pool;
+        magix::execute::ExecStack &small = pool.acquire(100, 4);
+        CHECK_EQ(small.stack.size(), 1024);
+        CHECK_EQ(small.objbank.size(), 16);
+        CHECK_EQ(reinterpret_cast<std::uintptr_t>(small.stack.data()) % magix::execute::memory_granularity, 0);
+        CHECK_EQ(reinterpret_cast<std::uintptr_t>(small.objbank.data()) % magix::execute::memory_granularity, 0);
+
+        small.stack[10] = std::byte{7};
+        small.mark_stack_dirty(11);
+        small.objbank[3].id = 5;
+        small.mark_objbank_dirty(4);
+
+        magix::execute::ExecStack &large = pool.acquire(5000, 4);
+        CHECK_NE(&large, &small);
+        CHECK_EQ(large.stack.size(), 8192);
+
+        magix::execute::ExecStack &again = pool.acquire(1000, 10);
+        CHECK_EQ(&again, &small);
+        CHECK_EQ(again.stack[10], std::byte{0});
+        CHECK_EQ(again.objbank[3].id, 0);
+
+        magix::execute::ExecStack &more_objects = pool.acquire(1000, 100);
+        CHECK_NE(&more_objects, &small);
+        CHECK_EQ(more_objects.objbank.size(), 128);
+    }
+
+    TEST_CASE("programs declare their stack size")
+    {
+        auto tokens = magix::compile::lex(UR"(
+.stack_size 256
+.objcount 8
+@entry:
+    exit
+)");
+        auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+        auto errors = magix::compile::assemble(tokens, *raw);
+        magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+        CHECK_RANGE_EQ(errors, expect_error);
+        CHECK_EQ(raw->stack_size, 256);
+        CHECK_EQ(raw->obj_count, 8);
+
+        magix::execute::ExecStackPool pool;
+        magix::execute::ExecStack &stack = pool.acquire(raw->stack_size, raw->obj_count);
+        CHECK_EQ(stack.stack.size(), magix::execute::stack_size_class_min);
+        CHECK_EQ(stack.objbank.size(), magix::execute::objbank_size_class_min);
+    }
+
+    TEST_CASE("stack registers stop at the page stack size, not the size class")
+    {
+        auto tokens = magix::compile::lex(UR"(
+.stack_size 16
+@entry:
+    set.u32 $12, #1
+    set.u32 $16, #1
+    exit
+)");
+        auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+        auto errors = magix::compile::assemble(tokens, *raw);
+        magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+        CHECK_RANGE_EQ(errors, expect_error);
+
+        magix::execute::ExecStackPool pool;
+        magix::execute::ExecStack &stack = pool.acquire(raw->stack_size, raw->obj_count);
+        magix::execute::ExecutionContext context{magix::execute::PageInfo{
+            &stack, std::min<size_t>(raw->stack_size, stack.stack.size()), stack.objbank.size(), {}, {}, {}, {},
+        }};
+        const magix::u16 entry = raw->entry_points.find("entry")->value();
+        auto result = magix::execute::execute(*raw, entry, 10, context);
+        CHECK_EQ(result.type, magix::execute::ExecResult::Type::TRAP_MEM_ACCESS_SP);
+        CHECK_EQ(stack.stack[12], std::byte{1});
+        CHECK_EQ(stack.stack[16], std::byte{0});
+    }
+
+    TEST_CASE("copies below the stack pointer do not wrap around")
+    {
+        auto tokens = magix::compile::lex(UR"(
+.fork_size 16
+@entry:
+    fork.load $-4, #0, #8
+    exit
+)");
+        auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+        auto errors = magix::compile::assemble(tokens, *raw);
+        magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+        CHECK_RANGE_EQ(errors, expect_error);
+
+        magix::execute::ExecStackPool pool;
+        magix::execute::ExecStack &stack = pool.acquire(raw->stack_size, raw->obj_count);
+        std::array<std::byte, 16> fork{};
+        magix::execute::ExecutionContext context{magix::execute::PageInfo{
+            &stack, stack.stack.size(), stack.objbank.size(), {}, fork, {}, {},
+        }};
+        const magix::u16 entry = raw->entry_points.find("entry")->value();
+        auto result = magix::execute::execute(*raw, entry, 10, context);
+        CHECK_EQ(result.type, magix::execute::ExecResult::Type::TRAP_MEM_ACCESS_USER);
+    }
+}
@@ -0,0 +1,274 @@
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/instruction_data.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/execution/jit.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <array>
+#include <cstring>
+#include <doctest.h>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+auto
+assemble_source(magix::compile::SrcView source) -> std::unique_ptr<magix::compile::ByteCodeRaw>
+{
+    auto tokens = magix::compile::lex(source);
+    auto raw = std::make_unique<magix::compile::ByteCodeRaw>();
+    auto errors = magix::compile::assemble(tokens, *raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    CHECK_RANGE_EQ(errors, expect_error);
+    return raw;
+}
+
+auto
+opcode_at(const magix::compile::ByteCodeRaw &raw, size_t address) -> magix::code_word
+{
+    magix::code_word word;
+    std::memcpy(&word, &raw.code[address], sizeof(word));
+    return word;
+}
+
+auto
+opcode_of(magix::compile::SrcView mnenomic) -> magix::code_word
+{
+    const magix::compile::InstructionSpec *spec = magix::compile::get_instruction_spec(mnenomic);
+    REQUIRE_NE(spec, nullptr);
+    return spec->opcode;
+}
+
+/** A program with everything the executors need, the decoded stream and the jits point into it. */
+struct Prepared
+{
+    const magix::compile::ByteCodeRaw *raw;
+    magix::execute::DecodedByteCode decoded;
+    magix::execute::JitProgram jit;
+    magix::execute::JitProgram stencil_jit;
+    magix::u16 entry;
+};
+
+auto
+prepare(const magix::compile::ByteCodeRaw &raw) -> std::unique_ptr<Prepared>
+{
+    auto out = std::make_unique<Prepared>();
+    out->raw = &raw;
+    out->decoded = magix::execute::decode(raw);
+    magix::execute::verify(out->decoded);
+    out->jit = magix::execute::jit_compile(out->decoded);
+    out->stencil_jit = magix::execute::jit_compile(out->decoded, true);
+    out->entry = raw.entry_points.find("entry")->value();
+    return out;
+}
+
+enum class Executor
+{
+    RAW,
+    DECODED,
+    JIT,
+    STENCIL_JIT,
+};
+
+/** Memory a single execution can touch. */
+struct Memory
+{
+    std::unique_ptr<magix::execute::ExecStack> stack = std::make_unique<magix::execute::ExecStack>();
+    std::array<std::byte, 16> fork{};
+    std::vector<magix::execute::PrimitiveUnion> output;
+};
+
+auto
+run(const Prepared &program, Executor executor, size_t steps, Memory &memory) -> magix::execute::ExecResult
+{
+    memory.stack->clear();
+    magix::execute::ExecutionContext context{magix::execute::PageInfo{
+        memory.stack.get(), memory.stack->stack.size(), memory.stack->objbank.size(), {}, memory.fork, {}, {},
+    }};
+    magix::execute::ExecResult result{};
+    switch (executor)
+    {
+    case Executor::RAW:
+    {
+        result = magix::execute::execute(*program.raw, program.entry, steps, context);
+        break;
+    }
+    case Executor::DECODED:
+    {
+        result = magix::execute::execute(program.decoded, program.entry, steps, context);
+        break;
+    }
+    case Executor::JIT:
+    {
+        result = magix::execute::execute(program.jit, program.entry, steps, context);
+        break;
+    }
+    case Executor::STENCIL_JIT:
+    {
+        result = magix::execute::execute(program.stencil_jit, program.entry, steps, context);
+        break;
+    }
+    }
+    memory.output = std::move(context.test_output);
+    return result;
+}
+
+/** Run the entry of both programs with every step budget up to steps, on the raw and decoded executors and both jits. Every part
+ * of a superinstruction is a step at its own address, so everything observable must match.
+ */
+void
+check_same_behaviour(const magix::compile::ByteCodeRaw &fused, const magix::compile::ByteCodeRaw &unfused, size_t steps)
+{
+    const std::unique_ptr<Prepared> fused_program = prepare(fused);
+    const std::unique_ptr<Prepared> unfused_program = prepare(unfused);
+    if (magix::execute::jit_available())
+    {
+        CHECK(fused_program->jit.find(fused_program->entry).has_value());
+        CHECK(fused_program->stencil_jit.find(fused_program->entry).has_value());
+    }
+
+    for (Executor executor : {Executor::RAW, Executor::DECODED, Executor::JIT, Executor::STENCIL_JIT})
+    {
+        for (auto step_budget : magix::ranges::num_range(steps + 1))
+        {
+            CAPTURE(static_cast<int>(executor));
+            CAPTURE(step_budget);
+            Memory fused_memory;
+            Memory unfused_memory;
+            auto fused_result = run(*fused_program, executor, step_budget, fused_memory);
+            auto unfused_result = run(*unfused_program, Executor::RAW, step_budget, unfused_memory);
+            CHECK_EQ(fused_result.type, unfused_result.type);
+            CHECK_EQ(fused_result.instruction_pointer, unfused_result.instruction_pointer);
+            CHECK_RANGE_EQ(fused_memory.output, unfused_memory.output);
+            const size_t stack_size = fused_memory.stack->stack.size();
+            CHECK_EQ(std::memcmp(fused_memory.stack->stack.data(), unfused_memory.stack->stack.data(), stack_size), 0);
+            CHECK_EQ(std::memcmp(fused_memory.fork.data(), unfused_memory.fork.data(), fused_memory.fork.size()), 0);
+        }
+    }
+}
+
+} // namespace
+
+TEST_SUITE("execution/superinstructions")
+{
+    TEST_CASE("sequences are fused")
+    {
+        auto raw = assemble_source(UR"(
+@entry:
+    fork.load $4, #0, #4
+    add.u32.imm $4, $4, #1
+    add.u32.imm $0, $0, #1
+    add.u32.imm $8, $8, #1
+    exit
+)");
+        const magix::u16 entry = raw->entry_points.find("entry")->value();
+        CHECK_EQ(opcode_at(*raw, entry), opcode_of(U"__fused.fork.load__add.u32.imm"));
+        // encoded like the parts, fork.load and add take 3 registers each
+        CHECK_EQ(opcode_at(*raw, entry + 4 * 2), opcode_of(U"add.u32.imm"));
+        CHECK_EQ(opcode_at(*raw, entry + 8 * 2), opcode_of(U"__fused.add.u32.imm__add.u32.imm"));
+        CHECK_EQ(opcode_at(*raw, entry + 12 * 2), opcode_of(U"add.u32.imm"));
+        CHECK_EQ(opcode_at(*raw, entry + 16 * 2), opcode_of(U"exit"));
+    }
+
+    TEST_CASE("labels split sequences")
+    {
+        auto raw = assemble_source(UR"(
+@entry:
+    add.u32.imm $0, $0, #1
+target:
+    add.u32.imm $0, $0, #1
+    goto #target
+)");
+        const magix::u16 entry = raw->entry_points.find("entry")->value();
+        CHECK_EQ(opcode_at(*raw, entry), opcode_of(U"add.u32.imm"));
+        CHECK_EQ(opcode_at(*raw, entry + 4 * 2), opcode_of(U"add.u32.imm"));
+    }
+
+    TEST_CASE("fused and unfused run the same")
+    {
+        // labels between instructions stop the assembler from fusing
+        auto fused = assemble_source(UR"(
+.fork_size 16
+@entry:
+    set.u32 $0, #4
+loop:
+    fork.load $4, #0, #4
+    add.u32.imm $4, $4, #3
+    fork.store $4, #0, #4
+    add.u32.imm $8, $8, #2
+    add.u32.imm $8, $8, #1
+    __unittest.put.u32 $8
+    sub.u32.imm $0, $0, #1
+    if.zero #done, $0
+    goto #loop
+done:
+    fork.load $4, #4, #16
+    add.u32.imm $4, $4, #1
+)");
+        auto unfused = assemble_source(UR"(
+.fork_size 16
+@entry:
+    set.u32 $0, #4
+loop:
+    fork.load $4, #0, #4
+split_0:
+    add.u32.imm $4, $4, #3
+split_1:
+    fork.store $4, #0, #4
+split_2:
+    add.u32.imm $8, $8, #2
+split_3:
+    add.u32.imm $8, $8, #1
+    __unittest.put.u32 $8
+    sub.u32.imm $0, $0, #1
+split_4:
+    if.zero #done, $0
+    goto #loop
+done:
+    fork.load $4, #4, #16
+split_5:
+    add.u32.imm $4, $4, #1
+)");
+        check_same_behaviour(*fused, *unfused, 64);
+    }
+
+    TEST_CASE("later parts trap at their own address")
+    {
+        auto fused = assemble_source(UR"(
+.fork_size 16
+@entry:
+    add.u32.imm $0, $0, #1
+    fork.store $0, #12, #8
+    exit
+)");
+        auto unfused = assemble_source(UR"(
+.fork_size 16
+@entry:
+    add.u32.imm $0, $0, #1
+split:
+    fork.store $0, #12, #8
+    exit
+)");
+        const magix::u16 entry = fused->entry_points.find("entry")->value();
+        CHECK_EQ(opcode_at(*fused, entry), opcode_of(U"__fused.add.u32.imm__fork.store"));
+        check_same_behaviour(*fused, *unfused, 4);
+
+        const std::unique_ptr<Prepared> program = prepare(*fused);
+        Memory memory;
+        const magix::execute::ExecResult result = run(*program, Executor::DECODED, 100, memory);
+        CHECK_EQ(result.type, magix::execute::ExecResult::Type::TRAP_MEM_ACCESS_USER);
+        CHECK_EQ(result.instruction_pointer, entry + 4 * 2);
+    }
+}
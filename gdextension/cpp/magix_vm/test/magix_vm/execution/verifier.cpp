@@ -0,0 +1,238 @@
+#include "magix_vm/compilation/assembler.hpp"
+#include "magix_vm/compilation/compiled.hpp"
+#include "magix_vm/compilation/lexer.hpp"
+#include "magix_vm/compilation/printing.hpp"
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/decoded.hpp"
+#include "magix_vm/execution/executor.hpp"
+#include "magix_vm/ranges.hpp"
+#include "magix_vm/utility.hpp"
+
+#include <array>
+#include <cstring>
+#include <doctest.h>
+#include <memory>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+namespace
+{
+
+struct Verified
+{
+    std::unique_ptr<magix::compile::ByteCodeRaw> raw;
+    magix::execute::DecodedByteCode decoded;
+};
+
+auto
+assemble_and_verify(magix::compile::SrcView source) -> Verified
+{
+    auto tokens = magix::compile::lex(source);
+    Verified out{std::make_unique<magix::compile::ByteCodeRaw>(), {}};
+    auto errors = magix::compile::assemble(tokens, *out.raw);
+    magix::ranges::empty_range<magix::compile::AssemblerError> expect_error;
+    CHECK_RANGE_EQ(errors, expect_error);
+    out.decoded = magix::execute::decode(*out.raw);
+    magix::execute::verify(out.decoded);
+    return out;
+}
+
+/** Whatever executor the decoded program picks, it has to behave like the raw one. */
+void
+check_same_as_raw(const Verified &program, magix::u16 entry, size_t steps)
+{
+    auto raw_stack = std::make_unique<magix::execute::ExecStack>();
+    auto decoded_stack = std::make_unique<magix::execute::ExecStack>();
+    raw_stack->clear();
+    decoded_stack->clear();
+    magix::execute::ExecutionContext raw_context{magix::execute::PageInfo{
+        raw_stack.get(), raw_stack->stack.size(), raw_stack->objbank.size(), {}, {}, {}, {},
+    }};
+    magix::execute::ExecutionContext decoded_context{magix::execute::PageInfo{
+        decoded_stack.get(), decoded_stack->stack.size(), decoded_stack->objbank.size(), {}, {}, {}, {},
+    }};
+
+    auto raw_result = magix::execute::execute(*program.raw, entry, steps, raw_context);
+    auto decoded_result = magix::execute::execute(program.decoded, entry, steps, decoded_context);
+    CHECK_EQ(raw_result.type, decoded_result.type);
+    CHECK_EQ(raw_result.instruction_pointer, decoded_result.instruction_pointer);
+    CHECK_RANGE_EQ(raw_context.test_output, decoded_context.test_output);
+    CHECK_EQ(std::memcmp(raw_stack->stack.data(), decoded_stack->stack.data(), raw_stack->stack.size()), 0);
+}
+
+} // namespace
+
+TEST_SUITE("execution/verifier")
+{
+    TEST_CASE("entries and yield targets are verified")
+    {
+        auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $0, #2
+loop:
+    sub.u32.imm $0, $0, #1
+    __unittest.put.u32 $0
+    if.zero #done, $0
+    goto #loop
+done:
+    yield_to #after
+after:
+    set.i16 $4, #-2
+    __unittest.put.i16 $4
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        CHECK_EQ(program.decoded.verified_stack_size, 6);
+        CHECK(program.decoded.is_verified(entry, 6));
+        CHECK_FALSE(program.decoded.is_verified(entry, 5));
+        CHECK_EQ(program.decoded.verified_entries.size(), 2);
+
+        for (auto steps : magix::ranges::num_range(size_t{20}))
+        {
+            CAPTURE(steps);
+            check_same_as_raw(program, entry, steps);
+        }
+        check_same_as_raw(program, program.decoded.verified_entries.back(), 10);
+    }
+
+    TEST_CASE("constant stack resize")
+    {
+        auto program = assemble_and_verify(UR"(
+@entry:
+    stack_resize #8
+    set.u32 $4, #1
+    __unittest.put.u32 $4
+    stack_resize #-8
+    set.u32 $0, #2
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        CHECK(program.decoded.is_verified(entry, 16));
+        CHECK_EQ(program.decoded.verified_stack_size, 16);
+        check_same_as_raw(program, entry, 10);
+    }
+
+    TEST_CASE("copies count towards the stack size")
+    {
+        auto program = assemble_and_verify(UR"(
+.fork_size 16
+@entry:
+    set.u32 $0, #1
+    fork.load $2, #0, #10
+    fork.store $6, #4, #12
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        CHECK(program.decoded.is_verified(entry, 18));
+        CHECK_EQ(program.decoded.verified_stack_size, 18);
+    }
+
+    TEST_CASE("clearing the stack zeroes what was used")
+    {
+        auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $0, #3
+    set.u32 $12, #7
+    get_caster $0
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        auto stack = std::make_unique<magix::execute::ExecStack>();
+        magix::execute::ExecutionContext context{magix::execute::PageInfo{
+            stack.get(), stack->stack.size(), stack->objbank.size(), {}, {}, {}, {},
+        }};
+        context.caster_id = 42;
+        auto result = magix::execute::execute(program.decoded, entry, 10, context);
+        CHECK_EQ(result.type, magix::execute::ExecResult::Type::OK_EXIT);
+        CHECK_EQ(stack->stack_dirty, 16);
+        CHECK_EQ(stack->objbank_dirty, 4);
+        CHECK_EQ(stack->objbank[3].id, 42);
+
+        stack->clear();
+        CHECK_EQ(stack->stack_dirty, 0);
+        CHECK_EQ(stack->objbank_dirty, 0);
+        const auto fresh = std::make_unique<magix::execute::ExecStack>();
+        CHECK_EQ(std::memcmp(stack->stack.data(), fresh->stack.data(), stack->stack.size()), 0);
+        CHECK_EQ(std::memcmp(stack->objbank.data(), fresh->objbank.data(), stack->objbank.as_const_bytes().size()), 0);
+    }
+
+    TEST_CASE("unprovable programs mark only the stack they wrote")
+    {
+        // the stack pointer is only known at runtime, so every write is checked
+        auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $0, #8
+    set_stack $0
+    set.u32 $0, #1
+    fork.load $4, #0, #2
+    exit
+)");
+        const magix::u16 entry = program.raw->entry_points.find("entry")->value();
+        CHECK_FALSE(program.decoded.is_verified(entry, 64));
+        std::array<std::byte, 4> fork{};
+        for (bool decoded : {false, true})
+        {
+            CAPTURE(decoded);
+            auto stack = std::make_unique<magix::execute::ExecStack>();
+            magix::execute::ExecutionContext context{magix::execute::PageInfo{
+                stack.get(), stack->stack.size(), stack->objbank.size(), {}, fork, {}, {},
+            }};
+            auto result = decoded ? magix::execute::execute(program.decoded, entry, 10, context)
+                                  : magix::execute::execute(*program.raw, entry, 10, context);
+            CHECK_EQ(result.type, magix::execute::ExecResult::Type::OK_EXIT);
+            CHECK_EQ(stack->stack_dirty, 14);
+        }
+    }
+
+    TEST_CASE("unprovable programs stay checked")
+    {
+        SUBCASE("runtime stack pointer")
+        {
+            auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $0, #8
+    set_stack $0
+    set.u32 $0, #1
+    exit
+)");
+            CHECK(program.decoded.verified_entries.empty());
+            check_same_as_raw(program, program.raw->entry_points.find("entry")->value(), 10);
+        }
+        SUBCASE("stack pointer depends on path")
+        {
+            auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $0, #0
+loop:
+    stack_resize #4
+    set.u32 $0, #0
+    if.zero #loop, $0
+    exit
+)");
+            CHECK(program.decoded.verified_entries.empty());
+            check_same_as_raw(program, program.raw->entry_points.find("entry")->value(), 10);
+        }
+        SUBCASE("misaligned local")
+        {
+            auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $2, #1
+    exit
+)");
+            CHECK(program.decoded.verified_entries.empty());
+            check_same_as_raw(program, program.raw->entry_points.find("entry")->value(), 10);
+        }
+        SUBCASE("negative local")
+        {
+            auto program = assemble_and_verify(UR"(
+@entry:
+    set.u32 $-4, #1
+    exit
+)");
+            CHECK(program.decoded.verified_entries.empty());
+            check_same_as_raw(program, program.raw->entry_points.find("entry")->value(), 10);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/execution/worker_pool.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <doctest.h>
+#include <thread>
+#include <vector>
+
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE BUILT WITHOUT TESTS ENABLED
+#endif
+
+TEST_SUITE("execution/worker_pool")
+{
+    TEST_CASE("every index runs exactly once")
+    {
+        for (size_t worker_count : {size_t{1}, size_t{2}, size_t{5}})
+        {
+            magix::execute::WorkerPool pool{worker_count};
+            CHECK_EQ(pool.worker_count(), worker_count);
+            for (size_t count : {size_t{0}, size_t{1}, size_t{3}, size_t{100}})
+            {
+                CAPTURE(worker_count);
+                CAPTURE(count);
+                std::vector<std::atomic<int>> runs(count);
+                pool.run(count, [&](size_t, size_t index) { runs[index].fetch_add(1); });
+                for (auto index : magix::ranges::num_range(count))
+                {
+                    CHECK_EQ(runs[index].load(), 1);
+                }
+            }
+        }
+    }
+
+    TEST_CASE("idle workers steal from a slow one")
+    {
+        magix::execute::WorkerPool pool{4};
+        std::vector<size_t> ran_on(40);
+        pool.run(ran_on.size(), [&](size_t worker, size_t index) {
+            // the share of worker 0 is slow
+            if (index < ran_on.size() / 4)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            ran_on[index] = worker;
+        });
+        size_t stolen = 0;
+        for (auto index : magix::ranges::num_range(ran_on.size() / 4))
+        {
+            stolen += ran_on[index] != 0 ? 1 : 0;
+        }
+        CHECK_GT(stolen, 0);
+    }
+
+    TEST_CASE("a single worker runs everything on the calling thread")
+    {
+        magix::execute::WorkerPool pool;
+        const auto caller = std::this_thread::get_id();
+        bool all_on_caller = true;
+        pool.run(10, [&](size_t worker, size_t) { all_on_caller = all_on_caller && worker == 0 && std::this_thread::get_id() == caller; });
+        CHECK(all_on_caller);
+    }
+}
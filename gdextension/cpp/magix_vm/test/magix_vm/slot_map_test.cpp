@@ -0,0 +1,67 @@
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE INCLUDED IN NON TEST BUILD!
+#endif
+
+#include "magix_vm/slot_map.hpp"
+
+#include "magix_vm/doctest_helper.hpp"
+
+#include <memory>
+
+TEST_SUITE("slot_map")
+{
+    TEST_CASE("handles find their value until it is erased")
+    {
+        magix::SlotMap<int> map;
+        const magix::SlotHandle one = map.emplace(1);
+        const magix::SlotHandle two = map.emplace(2);
+        const magix::SlotHandle three = map.emplace(3);
+        CHECK_EQ(map.size(), 3);
+        CHECK_EQ(*map.find(two), 2);
+
+        CHECK(map.erase(one));
+        CHECK(!map.erase(one));
+        CHECK_EQ(map.find(one), nullptr);
+        CHECK_EQ(*map.find(two), 2);
+        CHECK_EQ(*map.find(three), 3);
+        CHECK_EQ(map.size(), 2);
+
+        // the slot is reused, the old handle still does not match
+        const magix::SlotHandle four = map.emplace(4);
+        CHECK_EQ(four.slot, one.slot);
+        CHECK_NE(four, one);
+        CHECK_EQ(map.find(one), nullptr);
+        CHECK_EQ(*map.find(four), 4);
+        CHECK_EQ(map.find(magix::SlotHandle{}), nullptr);
+    }
+
+    TEST_CASE("values stay dense")
+    {
+        magix::SlotMap<int> map;
+        magix::SlotHandle handles[6];
+        for (int value = 0; value < 6; ++value)
+        {
+            handles[value] = map.emplace(value);
+        }
+        map.erase(handles[1]);
+        map.erase(handles[4]);
+        int expected[] = {0, 5, 2, 3};
+        CHECK_RANGE_EQ(map.values(), expected);
+        for (size_t index = 0; index < map.size(); ++index)
+        {
+            CHECK_EQ(map.find(map.handle_at(index)), &map.values()[index]);
+        }
+    }
+
+    TEST_CASE("clear invalidates every handle")
+    {
+        magix::SlotMap<std::unique_ptr<int>> map;
+        const magix::SlotHandle one = map.emplace(std::make_unique<int>(1));
+        const magix::SlotHandle two = map.emplace(std::make_unique<int>(2));
+        map.clear();
+        CHECK_EQ(map.size(), 0);
+        CHECK_EQ(map.find(one), nullptr);
+        CHECK_EQ(map.find(two), nullptr);
+        CHECK_EQ(**map.find(map.emplace(std::make_unique<int>(3))), 3);
+    }
+}
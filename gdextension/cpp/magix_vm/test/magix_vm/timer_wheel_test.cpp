@@ -0,0 +1,89 @@
+#ifndef MAGIX_BUILD_TESTS
+#error TEST FILE INCLUDED IN NON TEST BUILD!
+#endif
+
+#include "magix_vm/timer_wheel.hpp"
+
+#include "magix_vm/doctest_helper.hpp"
+#include "magix_vm/ranges.hpp"
+
+#include <algorithm>
+#include <random>
+#include <utility>
+#include <vector>
+
+TEST_SUITE("timer_wheel")
+{
+    TEST_CASE("values wake after their delay")
+    {
+        magix::TimerWheel<int> wheel;
+        wheel.schedule(1, 1);
+        wheel.schedule(3, 3);
+        wheel.schedule(0, 0);
+        CHECK_EQ(wheel.size(), 3);
+
+        std::vector<int> woken;
+        auto wake = [&](int value) { woken.push_back(value); };
+        wheel.advance(wake);
+        CHECK_EQ(woken, std::vector<int>{1, 0});
+        woken.clear();
+        wheel.advance(wake);
+        CHECK(woken.empty());
+        wheel.advance(wake);
+        CHECK_EQ(woken, std::vector<int>{3});
+        CHECK_EQ(wheel.size(), 0);
+    }
+
+    TEST_CASE("delays across every level wake on time")
+    {
+        magix::TimerWheel<std::pair<magix::u64, magix::u64>> wheel;
+        std::mt19937_64 random{7};
+        magix::u64 now = 0;
+        size_t scheduled = 0;
+        size_t woken = 0;
+        auto wake = [&](std::pair<magix::u64, magix::u64> value) {
+            CHECK_EQ(value.first, now);
+            ++woken;
+            // schedule again from inside a wake
+            const magix::u64 delay = random() % 5000 + 1;
+            if (value.second != 0 && now + delay < 300000)
+            {
+                wheel.schedule(delay, {now + delay, value.second - 1});
+                ++scheduled;
+            }
+        };
+        for (auto tick : magix::ranges::num_range(300000))
+        {
+            if (tick % 7 == 0)
+            {
+                // mostly short delays, some long enough for the top levels
+                const magix::u64 delay = tick % 49 == 0 ? random() % (magix::u64{1} << 20) : random() % 300;
+                const magix::u64 due = now + std::max<magix::u64>(delay, 1);
+                if (due < 300000)
+                {
+                    wheel.schedule(delay, {due, 3});
+                    ++scheduled;
+                }
+            }
+            ++now;
+            wheel.advance(wake);
+        }
+        CHECK_EQ(woken, scheduled);
+        CHECK_EQ(wheel.size(), 0);
+    }
+
+    TEST_CASE("long delays are cut to the range of the wheel")
+    {
+        magix::TimerWheel<int> wheel;
+        wheel.schedule(magix::TimerWheel<int>::max_delay * 4, 1);
+        size_t ticks = 0;
+        bool woken = false;
+        while (!woken && ticks <= magix::TimerWheel<int>::max_delay)
+        {
+            ++ticks;
+            wheel.advance([&](int) { woken = true; });
+        }
+        CHECK(woken);
+        CHECK_EQ(ticks, magix::TimerWheel<int>::max_delay);
+    }
+}